@@ -45,6 +45,9 @@ typedef struct _PCatManagerMainConfigData
 
     gchar *pm_serial_device;
     guint pm_serial_baud;
+    gboolean pm_serial_low_latency;
+    guint pm_serial_read_vmin;
+    guint pm_serial_read_vtime;
     guint pm_auto_shutdown_voltage_general;
     guint pm_auto_shutdown_voltage_lte;
     guint pm_auto_shutdown_voltage_5g;
@@ -62,6 +65,18 @@ typedef struct _PCatManagerMainConfigData
     guint pm_charger_fast_voltage;
     guint pm_battery_full_threshold;
 
+    guint ctrl_output_queue_size_max;
+    guint ctrl_output_queue_message_max;
+    guint ctrl_connection_max;
+    guint ctrl_connection_idle_timeout;
+    guint ctrl_connection_write_timeout;
+    guint ctrl_read_command_rate;
+    guint ctrl_read_command_burst;
+    guint ctrl_write_command_rate;
+    guint ctrl_write_command_burst;
+    gchar *ctrl_http_address;
+    guint ctrl_http_port;
+
     gboolean debug_modem_external_exec_stdout_log;
     gboolean debug_output_log;
 }PCatManagerMainConfigData;
@@ -79,10 +94,18 @@ typedef struct _PCatManagerPowerScheduleData
     guint8 dow_bits;
 }PCatManagerPowerScheduleData;
 
+/*
+ * User config snapshots are immutable once published, take a reference with
+ * pcat_main_user_config_data_get(). Writers take a private copy with
+ * pcat_main_user_config_data_edit() and publish it with
+ * pcat_main_user_config_data_commit(). The schedule array is shared between
+ * snapshots, replace it instead of modifying it. Commit returns FALSE when
+ * the change could not be saved to the configuration file.
+ */
 typedef struct _PCatManagerUserConfigData
 {
-    gboolean valid;
-    gboolean dirty;
+    gint ref_count;
+    guint version;
 
     GPtrArray *power_schedule_data;
     gboolean charger_on_auto_start;
@@ -98,11 +121,14 @@ typedef struct _PCatManagerUserConfigData
 }PCatManagerUserConfigData;
 
 PCatManagerMainConfigData *pcat_main_config_data_get();
-PCatManagerUserConfigData *pcat_main_user_config_data_get();
-void pcat_main_user_config_data_sync();
+const PCatManagerUserConfigData *pcat_main_user_config_data_get();
+void pcat_main_user_config_data_unref(const PCatManagerUserConfigData *data);
+PCatManagerUserConfigData *pcat_main_user_config_data_edit();
+gboolean pcat_main_user_config_data_commit(PCatManagerUserConfigData *data);
 void pcat_main_request_shutdown(gboolean send_pmu_request);
 PCatManagerRouteMode pcat_main_network_route_mode_get();
 gboolean pcat_main_is_running_on_distro();
+void pcat_main_loop_latency_sample();
 
 G_END_DECLS
 
@@ -0,0 +1,839 @@
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+#include <glib.h>
+
+#define PCAT_BENCH_SOCKET_FILE "/tmp/pcat-manager.sock"
+#define PCAT_BENCH_SEQPACKET_SOCKET_FILE "/tmp/pcat-manager-seqpacket.sock"
+#define PCAT_BENCH_DAEMON_NAME "pcat-manager"
+#define PCAT_BENCH_READ_BUFFER_SIZE 65536
+#define PCAT_BENCH_DEFAULT_MIX "pmu-status:4,modem-status-get:2," \
+    "network-route-mode-get:1,pmu-fw-version-get:1," \
+    "schedule-power-event-get:1,charger-on-auto-start-get:1"
+
+typedef struct _PCatBenchCommandData
+{
+    gchar *command;
+    gchar *request;
+    gsize request_size;
+    guint weight;
+    guint64 sent;
+    guint64 received;
+    GArray *latencies;
+}PCatBenchCommandData;
+
+typedef struct _PCatBenchPendingData
+{
+    guint command_index;
+    gint64 send_time;
+}PCatBenchPendingData;
+
+typedef struct _PCatBenchConnectionData
+{
+    gint fd;
+    GByteArray *output_buffer;
+    GByteArray *input_buffer;
+    GQueue *pending_queue;
+}PCatBenchConnectionData;
+
+typedef struct _PCatBenchProcessData
+{
+    guint64 cpu_ticks;
+    guint64 rss_kb;
+    guint64 hwm_kb;
+    guint64 context_switches;
+}PCatBenchProcessData;
+
+typedef struct _PCatBenchData
+{
+    PCatBenchConnectionData *connections;
+    guint connection_count;
+    GPtrArray *commands;
+    guint weight_total;
+    guint64 sent;
+    guint64 received;
+    guint64 unmatched;
+    guint64 events;
+}PCatBenchData;
+
+static gchar *g_pcat_bench_cmd_socket = NULL;
+static gint g_pcat_bench_cmd_connections = 16;
+static gint g_pcat_bench_cmd_rate = 1000;
+static gint g_pcat_bench_cmd_duration = 10;
+static gchar *g_pcat_bench_cmd_mix = NULL;
+static gint g_pcat_bench_cmd_pid = 0;
+static gboolean g_pcat_bench_cmd_seqpacket = FALSE;
+static gint g_pcat_bench_cmd_idle_connections = 0;
+
+/* controller-idle-check.sh runs the idle connection comparison. */
+static GOptionEntry g_pcat_bench_cmd_entries[] =
+{
+    { "socket", 's', 0, G_OPTION_ARG_FILENAME, &g_pcat_bench_cmd_socket,
+        "Controller socket path (default: "PCAT_BENCH_SOCKET_FILE")",
+        "PATH" },
+    { "seqpacket", 'S', 0, G_OPTION_ARG_NONE, &g_pcat_bench_cmd_seqpacket,
+        "Use SOCK_SEQPACKET framing (default path: "
+        PCAT_BENCH_SEQPACKET_SOCKET_FILE")", NULL },
+    { "connections", 'c', 0, G_OPTION_ARG_INT,
+        &g_pcat_bench_cmd_connections,
+        "Number of concurrent connections (default: 16)", "N" },
+    { "rate", 'r', 0, G_OPTION_ARG_INT, &g_pcat_bench_cmd_rate,
+        "Total request rate per second (default: 1000)", "RATE" },
+    { "duration", 'd', 0, G_OPTION_ARG_INT, &g_pcat_bench_cmd_duration,
+        "Test duration in seconds (default: 10)", "SECONDS" },
+    { "mix", 'm', 0, G_OPTION_ARG_STRING, &g_pcat_bench_cmd_mix,
+        "Command mix as command:weight,... (default: read commands)",
+        "MIX" },
+    { "idle", 'i', 0, G_OPTION_ARG_INT, &g_pcat_bench_cmd_idle_connections,
+        "Extra connections kept open without traffic (default: 0)", "N" },
+    { "pid", 'p', 0, G_OPTION_ARG_INT, &g_pcat_bench_cmd_pid,
+        "Daemon PID for RSS/CPU report (default: search by name)", "PID" },
+    { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+};
+
+static void pcat_bench_command_data_free(PCatBenchCommandData *data)
+{
+    if(data==NULL)
+    {
+        return;
+    }
+
+    if(data->latencies!=NULL)
+    {
+        g_array_unref(data->latencies);
+    }
+    g_free(data->request);
+    g_free(data->command);
+    g_free(data);
+}
+
+static gboolean pcat_bench_mix_parse(PCatBenchData *bench_data,
+    const gchar *mix)
+{
+    gchar **items;
+    gchar **fields;
+    guint i;
+    gint weight;
+    PCatBenchCommandData *command_data;
+
+    bench_data->commands = g_ptr_array_new_with_free_func(
+        (GDestroyNotify)pcat_bench_command_data_free);
+
+    items = g_strsplit(mix, ",", -1);
+    for(i=0;items[i]!=NULL;i++)
+    {
+        g_strstrip(items[i]);
+        if(items[i][0]=='\0')
+        {
+            continue;
+        }
+
+        fields = g_strsplit(items[i], ":", 2);
+        weight = 1;
+        if(fields[1]!=NULL)
+        {
+            weight = atoi(fields[1]);
+        }
+        if(weight <= 0)
+        {
+            g_printerr("Invalid weight in command mix item %s!\n",
+                items[i]);
+            g_strfreev(fields);
+            g_strfreev(items);
+
+            return FALSE;
+        }
+
+        command_data = g_new0(PCatBenchCommandData, 1);
+        command_data->command = g_strdup(fields[0]);
+        command_data->request = g_strdup_printf("{\"command\":\"%s\"}",
+            fields[0]);
+        /* Include the terminating NUL, it is the message delimiter. */
+        command_data->request_size = strlen(command_data->request) + 1;
+        command_data->weight = weight;
+        command_data->latencies = g_array_new(FALSE, FALSE, sizeof(gint64));
+        g_ptr_array_add(bench_data->commands, command_data);
+
+        bench_data->weight_total += weight;
+
+        g_strfreev(fields);
+    }
+    g_strfreev(items);
+
+    return (bench_data->commands->len > 0);
+}
+
+static guint pcat_bench_command_pick(PCatBenchData *bench_data)
+{
+    guint i;
+    guint value;
+    PCatBenchCommandData *command_data;
+
+    value = g_random_int_range(0, bench_data->weight_total);
+    for(i=0;i<bench_data->commands->len;i++)
+    {
+        command_data = g_ptr_array_index(bench_data->commands, i);
+        if(value < command_data->weight)
+        {
+            return i;
+        }
+        value -= command_data->weight;
+    }
+
+    return 0;
+}
+
+static gint pcat_bench_connection_open(const gchar *path)
+{
+    struct sockaddr_un addr;
+    gint fd;
+
+    fd = socket(AF_UNIX, (g_pcat_bench_cmd_seqpacket ? SOCK_SEQPACKET :
+        SOCK_STREAM) | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+    {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    g_strlcpy(addr.sun_path, path, sizeof(addr.sun_path));
+
+    if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+
+        return -1;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    return fd;
+}
+
+static gboolean pcat_bench_connection_write(
+    PCatBenchConnectionData *connection_data)
+{
+    gssize wsize;
+
+    while(connection_data->output_buffer->len > 0)
+    {
+        wsize = write(connection_data->fd,
+            connection_data->output_buffer->data,
+            connection_data->output_buffer->len);
+        if(wsize < 0)
+        {
+            if(errno==EAGAIN || errno==EINTR)
+            {
+                return TRUE;
+            }
+
+            return FALSE;
+        }
+
+        g_byte_array_remove_range(connection_data->output_buffer, 0, wsize);
+    }
+
+    return TRUE;
+}
+
+static gboolean pcat_bench_connection_read(PCatBenchData *bench_data,
+    PCatBenchConnectionData *connection_data)
+{
+    guint8 buffer[PCAT_BENCH_READ_BUFFER_SIZE];
+    gssize rsize;
+    guint8 *end;
+    gsize message_size;
+    gint64 now;
+    PCatBenchPendingData *pending;
+    PCatBenchCommandData *command_data;
+    gint64 latency;
+
+    while(TRUE)
+    {
+        rsize = read(connection_data->fd, buffer, sizeof(buffer));
+        if(rsize < 0)
+        {
+            if(errno==EAGAIN || errno==EINTR)
+            {
+                break;
+            }
+
+            return FALSE;
+        }
+        else if(rsize==0)
+        {
+            return FALSE;
+        }
+
+        g_byte_array_append(connection_data->input_buffer, buffer, rsize);
+
+        /* Packets carry no delimiter, add one to share the parser below. */
+        if(g_pcat_bench_cmd_seqpacket)
+        {
+            g_byte_array_append(connection_data->input_buffer,
+                (const guint8 *)"", 1);
+        }
+    }
+
+    now = g_get_monotonic_time();
+
+    while((end=memchr(connection_data->input_buffer->data, 0,
+        connection_data->input_buffer->len))!=NULL)
+    {
+        message_size = end - connection_data->input_buffer->data + 1;
+
+        if(g_strstr_len((const gchar *)connection_data->input_buffer->data,
+            message_size, "\"command\":\"event\"")!=NULL)
+        {
+            bench_data->events++;
+        }
+        else if((pending=g_queue_pop_head(
+            connection_data->pending_queue))!=NULL)
+        {
+            command_data = g_ptr_array_index(bench_data->commands,
+                pending->command_index);
+            latency = now - pending->send_time;
+            g_array_append_val(command_data->latencies, latency);
+            command_data->received++;
+            bench_data->received++;
+
+            g_free(pending);
+        }
+        else
+        {
+            bench_data->unmatched++;
+        }
+
+        g_byte_array_remove_range(connection_data->input_buffer, 0,
+            message_size);
+    }
+
+    return TRUE;
+}
+
+static void pcat_bench_request_send(PCatBenchData *bench_data,
+    PCatBenchConnectionData *connection_data)
+{
+    guint command_index;
+    PCatBenchCommandData *command_data;
+    PCatBenchPendingData *pending;
+
+    command_index = pcat_bench_command_pick(bench_data);
+    command_data = g_ptr_array_index(bench_data->commands, command_index);
+
+    /* Packet mode needs one write per request, so skip the buffer. */
+    if(g_pcat_bench_cmd_seqpacket)
+    {
+        if(send(connection_data->fd, command_data->request,
+            command_data->request_size - 1, MSG_DONTWAIT)!=
+            (gssize)command_data->request_size - 1)
+        {
+            return;
+        }
+    }
+    else
+    {
+        g_byte_array_append(connection_data->output_buffer,
+            (const guint8 *)command_data->request,
+            command_data->request_size);
+    }
+
+    pending = g_new0(PCatBenchPendingData, 1);
+    pending->command_index = command_index;
+    pending->send_time = g_get_monotonic_time();
+    g_queue_push_tail(connection_data->pending_queue, pending);
+
+    command_data->sent++;
+    bench_data->sent++;
+}
+
+static gint pcat_bench_daemon_pid_find()
+{
+    DIR *dir;
+    struct dirent *entry;
+    gchar *path;
+    gchar *comm;
+    gint pid = 0;
+
+    dir = opendir("/proc");
+    if(dir==NULL)
+    {
+        return 0;
+    }
+
+    while(pid==0 && (entry=readdir(dir))!=NULL)
+    {
+        if(!g_ascii_isdigit(entry->d_name[0]))
+        {
+            continue;
+        }
+
+        path = g_strdup_printf("/proc/%s/comm", entry->d_name);
+        if(g_file_get_contents(path, &comm, NULL, NULL))
+        {
+            g_strstrip(comm);
+            if(g_strcmp0(comm, PCAT_BENCH_DAEMON_NAME)==0)
+            {
+                pid = atoi(entry->d_name);
+            }
+            g_free(comm);
+        }
+        g_free(path);
+    }
+
+    closedir(dir);
+
+    return pid;
+}
+
+static guint64 pcat_bench_process_context_switches_get(gint pid)
+{
+    DIR *dir;
+    struct dirent *entry;
+    gchar *path;
+    gchar *contents;
+    gchar *line;
+    guint64 total = 0;
+
+    /* Sum over all threads, a sleeping daemon barely moves this. */
+    path = g_strdup_printf("/proc/%d/task", pid);
+    dir = opendir(path);
+    g_free(path);
+    if(dir==NULL)
+    {
+        return 0;
+    }
+
+    while((entry=readdir(dir))!=NULL)
+    {
+        if(!g_ascii_isdigit(entry->d_name[0]))
+        {
+            continue;
+        }
+
+        path = g_strdup_printf("/proc/%d/task/%s/status", pid,
+            entry->d_name);
+        if(g_file_get_contents(path, &contents, NULL, NULL))
+        {
+            line = strstr(contents, "voluntary_ctxt_switches:");
+            if(line!=NULL)
+            {
+                total += g_ascii_strtoull(line + 24, NULL, 10);
+            }
+            line = strstr(contents, "nonvoluntary_ctxt_switches:");
+            if(line!=NULL)
+            {
+                total += g_ascii_strtoull(line + 27, NULL, 10);
+            }
+            g_free(contents);
+        }
+        g_free(path);
+    }
+
+    closedir(dir);
+
+    return total;
+}
+
+static gboolean pcat_bench_process_data_get(gint pid,
+    PCatBenchProcessData *process_data)
+{
+    gchar *path;
+    gchar *contents = NULL;
+    gchar *line;
+    gchar **fields;
+    guint64 utime, stime;
+
+    memset(process_data, 0, sizeof(PCatBenchProcessData));
+
+    path = g_strdup_printf("/proc/%d/stat", pid);
+    if(!g_file_get_contents(path, &contents, NULL, NULL))
+    {
+        g_free(path);
+
+        return FALSE;
+    }
+    g_free(path);
+
+    /* Skip "pid (comm) ", comm may contain spaces. */
+    line = strrchr(contents, ')');
+    if(line==NULL)
+    {
+        g_free(contents);
+
+        return FALSE;
+    }
+
+    fields = g_strsplit(line + 2, " ", -1);
+    if(g_strv_length(fields) > 12)
+    {
+        utime = g_ascii_strtoull(fields[11], NULL, 10);
+        stime = g_ascii_strtoull(fields[12], NULL, 10);
+        process_data->cpu_ticks = utime + stime;
+    }
+    g_strfreev(fields);
+    g_free(contents);
+
+    path = g_strdup_printf("/proc/%d/status", pid);
+    if(g_file_get_contents(path, &contents, NULL, NULL))
+    {
+        line = strstr(contents, "VmRSS:");
+        if(line!=NULL)
+        {
+            process_data->rss_kb = g_ascii_strtoull(line + 6, NULL, 10);
+        }
+        line = strstr(contents, "VmHWM:");
+        if(line!=NULL)
+        {
+            process_data->hwm_kb = g_ascii_strtoull(line + 6, NULL, 10);
+        }
+        g_free(contents);
+    }
+    g_free(path);
+
+    process_data->context_switches =
+        pcat_bench_process_context_switches_get(pid);
+
+    return TRUE;
+}
+
+static gint pcat_bench_latency_compare(gconstpointer a, gconstpointer b)
+{
+    gint64 va = *(const gint64 *)a;
+    gint64 vb = *(const gint64 *)b;
+
+    return (va > vb) - (va < vb);
+}
+
+static gint64 pcat_bench_latency_percentile(GArray *latencies,
+    gdouble percentile)
+{
+    guint index;
+
+    if(latencies->len==0)
+    {
+        return 0;
+    }
+
+    index = (guint)(percentile * (latencies->len - 1) + 0.5);
+
+    return g_array_index(latencies, gint64, index);
+}
+
+static void pcat_bench_report(PCatBenchData *bench_data, gdouble elapsed,
+    gint pid, const PCatBenchProcessData *process_start,
+    const PCatBenchProcessData *process_end)
+{
+    guint i;
+    PCatBenchCommandData *command_data;
+    GArray *latencies;
+    glong clock_ticks;
+
+    printf("\n%-28s %10s %10s %10s %10s %10s %10s\n", "command", "sent",
+        "received", "req/s", "p50(us)", "p99(us)", "p999(us)");
+
+    for(i=0;i<bench_data->commands->len;i++)
+    {
+        command_data = g_ptr_array_index(bench_data->commands, i);
+        latencies = command_data->latencies;
+        g_array_sort(latencies, pcat_bench_latency_compare);
+
+        printf("%-28s %10"G_GUINT64_FORMAT" %10"G_GUINT64_FORMAT
+            " %10.1f %10"G_GINT64_FORMAT" %10"G_GINT64_FORMAT
+            " %10"G_GINT64_FORMAT"\n", command_data->command,
+            command_data->sent, command_data->received,
+            command_data->received / elapsed,
+            pcat_bench_latency_percentile(latencies, 0.5),
+            pcat_bench_latency_percentile(latencies, 0.99),
+            pcat_bench_latency_percentile(latencies, 0.999));
+    }
+
+    printf("\nTotal: sent %"G_GUINT64_FORMAT", received %"G_GUINT64_FORMAT
+        " (%.1f req/s) in %.2f s, events %"G_GUINT64_FORMAT
+        ", unmatched %"G_GUINT64_FORMAT"\n", bench_data->sent,
+        bench_data->received, bench_data->received / elapsed, elapsed,
+        bench_data->events, bench_data->unmatched);
+
+    if(pid <= 0)
+    {
+        printf("Daemon process not found, no RSS/CPU report.\n");
+
+        return;
+    }
+
+    clock_ticks = sysconf(_SC_CLK_TCK);
+    if(clock_ticks <= 0)
+    {
+        clock_ticks = 100;
+    }
+
+    printf("Daemon (PID %d): CPU time %.2f s (%.1f%%), RSS %"
+        G_GUINT64_FORMAT" -> %"G_GUINT64_FORMAT" KiB, peak %"
+        G_GUINT64_FORMAT" KiB\n", pid,
+        (gdouble)(process_end->cpu_ticks - process_start->cpu_ticks) /
+        clock_ticks,
+        (gdouble)(process_end->cpu_ticks - process_start->cpu_ticks) /
+        clock_ticks / elapsed * 100, process_start->rss_kb,
+        process_end->rss_kb, process_end->hwm_kb);
+    printf("Daemon context switches: %"G_GUINT64_FORMAT" (%.1f/s)\n",
+        process_end->context_switches - process_start->context_switches,
+        (process_end->context_switches - process_start->context_switches) /
+        elapsed);
+}
+
+static void pcat_bench_fd_limit_raise(guint count)
+{
+    struct rlimit limit;
+
+    if(getrlimit(RLIMIT_NOFILE, &limit)!=0 || limit.rlim_cur >= count)
+    {
+        return;
+    }
+
+    limit.rlim_cur = (limit.rlim_max!=RLIM_INFINITY &&
+        limit.rlim_max < count) ? limit.rlim_max : count;
+    setrlimit(RLIMIT_NOFILE, &limit);
+}
+
+int main(int argc, char *argv[])
+{
+    GError *error = NULL;
+    GOptionContext *context;
+    PCatBenchData bench_data = {0};
+    PCatBenchConnectionData *connection_data;
+    PCatBenchProcessData process_start = {0}, process_end = {0};
+    struct pollfd *pfds;
+    gint *idle_fds = NULL;
+    guint idle_count = 0;
+    const gchar *socket_path;
+    gint64 start_time, end_time, next_send_time, now;
+    gint64 send_interval;
+    gint timeout;
+    gint pid;
+    guint next_connection = 0;
+    guint i;
+    gint ret = 0;
+
+    context = g_option_context_new("- PCat Manager controller benchmark");
+    g_option_context_add_main_entries(context, g_pcat_bench_cmd_entries,
+        NULL);
+    if(!g_option_context_parse(context, &argc, &argv, &error))
+    {
+        g_printerr("Option parsing failed: %s\n", error->message);
+        g_clear_error(&error);
+        g_option_context_free(context);
+
+        return 1;
+    }
+    g_option_context_free(context);
+
+    if(g_pcat_bench_cmd_connections <= 0 || g_pcat_bench_cmd_rate <= 0 ||
+       g_pcat_bench_cmd_duration <= 0 || g_pcat_bench_cmd_idle_connections < 0)
+    {
+        g_printerr("Connections, rate and duration must be positive!\n");
+
+        return 1;
+    }
+
+    pcat_bench_fd_limit_raise(g_pcat_bench_cmd_connections +
+        g_pcat_bench_cmd_idle_connections + 64);
+
+    if(g_pcat_bench_cmd_socket!=NULL)
+    {
+        socket_path = g_pcat_bench_cmd_socket;
+    }
+    else if(g_pcat_bench_cmd_seqpacket)
+    {
+        socket_path = PCAT_BENCH_SEQPACKET_SOCKET_FILE;
+    }
+    else
+    {
+        socket_path = PCAT_BENCH_SOCKET_FILE;
+    }
+
+    if(!pcat_bench_mix_parse(&bench_data, g_pcat_bench_cmd_mix!=NULL ?
+        g_pcat_bench_cmd_mix : PCAT_BENCH_DEFAULT_MIX))
+    {
+        g_printerr("Invalid command mix!\n");
+
+        return 1;
+    }
+
+    bench_data.connection_count = g_pcat_bench_cmd_connections;
+    bench_data.connections = g_new0(PCatBenchConnectionData,
+        bench_data.connection_count);
+    pfds = g_new0(struct pollfd, bench_data.connection_count);
+
+    for(i=0;i<bench_data.connection_count;i++)
+    {
+        connection_data = &(bench_data.connections[i]);
+        connection_data->fd = pcat_bench_connection_open(socket_path);
+        if(connection_data->fd < 0)
+        {
+            g_printerr("Failed to connect to %s: %s\n", socket_path,
+                g_strerror(errno));
+            bench_data.connection_count = i;
+            ret = 1;
+
+            break;
+        }
+        connection_data->output_buffer = g_byte_array_new();
+        connection_data->input_buffer = g_byte_array_new();
+        connection_data->pending_queue = g_queue_new();
+    }
+
+    idle_fds = g_new0(gint, g_pcat_bench_cmd_idle_connections + 1);
+    for(i=0;ret==0 && i<(guint)g_pcat_bench_cmd_idle_connections;i++)
+    {
+        idle_fds[i] = pcat_bench_connection_open(socket_path);
+        if(idle_fds[i] < 0)
+        {
+            g_printerr("Failed to open idle connection %u: %s\n", i,
+                g_strerror(errno));
+            ret = 1;
+
+            break;
+        }
+        idle_count++;
+    }
+
+    pid = g_pcat_bench_cmd_pid > 0 ? g_pcat_bench_cmd_pid :
+        pcat_bench_daemon_pid_find();
+    if(pid > 0)
+    {
+        pcat_bench_process_data_get(pid, &process_start);
+    }
+
+    printf("Running %d connections (%u idle) at %d req/s for %d s "
+        "against %s...\n", bench_data.connection_count, idle_count,
+        g_pcat_bench_cmd_rate, g_pcat_bench_cmd_duration, socket_path);
+
+    send_interval = G_USEC_PER_SEC / g_pcat_bench_cmd_rate;
+    if(send_interval <= 0)
+    {
+        send_interval = 1;
+    }
+    start_time = g_get_monotonic_time();
+    end_time = start_time + (gint64)g_pcat_bench_cmd_duration *
+        G_USEC_PER_SEC;
+    next_send_time = start_time;
+
+    while(ret==0)
+    {
+        now = g_get_monotonic_time();
+
+        /* Open-loop pacing: requests are issued on schedule regardless of
+         * outstanding responses, so queueing delay shows in latency. */
+        while(now < end_time && next_send_time <= now)
+        {
+            connection_data = &(bench_data.connections[next_connection]);
+            pcat_bench_request_send(&bench_data, connection_data);
+            next_connection = (next_connection + 1) %
+                bench_data.connection_count;
+            next_send_time += send_interval;
+        }
+
+        if(now >= end_time && bench_data.received +
+           bench_data.unmatched >= bench_data.sent)
+        {
+            break;
+        }
+        if(now >= end_time + G_USEC_PER_SEC * 5)
+        {
+            g_printerr("Timed out waiting for %"G_GUINT64_FORMAT
+                " responses.\n", bench_data.sent - bench_data.received);
+
+            break;
+        }
+
+        for(i=0;i<bench_data.connection_count;i++)
+        {
+            connection_data = &(bench_data.connections[i]);
+            if(!pcat_bench_connection_write(connection_data))
+            {
+                g_printerr("Connection %u write failed: %s\n", i,
+                    g_strerror(errno));
+                ret = 1;
+            }
+
+            pfds[i].fd = connection_data->fd;
+            pfds[i].events = POLLIN;
+            if(connection_data->output_buffer->len > 0)
+            {
+                pfds[i].events |= POLLOUT;
+            }
+            pfds[i].revents = 0;
+        }
+
+        if(now < end_time)
+        {
+            timeout = (next_send_time - now + 999) / 1000;
+        }
+        else
+        {
+            timeout = 100;
+        }
+
+        if(poll(pfds, bench_data.connection_count, timeout) < 0 &&
+           errno!=EINTR)
+        {
+            g_printerr("Poll failed: %s\n", g_strerror(errno));
+            ret = 1;
+
+            break;
+        }
+
+        for(i=0;i<bench_data.connection_count;i++)
+        {
+            if(pfds[i].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                if(!pcat_bench_connection_read(&bench_data,
+                    &(bench_data.connections[i])))
+                {
+                    g_printerr("Connection %u closed by daemon.\n", i);
+                    ret = 1;
+                }
+            }
+        }
+    }
+
+    if(bench_data.connection_count > 0)
+    {
+        if(pid > 0)
+        {
+            pcat_bench_process_data_get(pid, &process_end);
+        }
+
+        pcat_bench_report(&bench_data,
+            (gdouble)(g_get_monotonic_time() - start_time) / G_USEC_PER_SEC,
+            pid, &process_start, &process_end);
+    }
+
+    for(i=0;i<bench_data.connection_count;i++)
+    {
+        connection_data = &(bench_data.connections[i]);
+        close(connection_data->fd);
+        g_byte_array_unref(connection_data->output_buffer);
+        g_byte_array_unref(connection_data->input_buffer);
+        g_queue_free_full(connection_data->pending_queue, g_free);
+    }
+    for(i=0;i<idle_count;i++)
+    {
+        close(idle_fds[i]);
+    }
+    g_free(idle_fds);
+    g_free(bench_data.connections);
+    g_free(pfds);
+    g_ptr_array_unref(bench_data.commands);
+
+    return ret;
+}
@@ -0,0 +1,867 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <json.h>
+#include "controller-codec.h"
+#include "controller-request.h"
+
+#define PCAT_CODEC_BENCH_REQUEST_SIZE_MAX 4096
+#define PCAT_CODEC_BENCH_STREAM_CHUNK_SIZE 4096
+#define PCAT_CODEC_BENCH_STREAM_MESSAGE_SIZE 1048576
+
+typedef void (*PCatCodecBenchTreeFunc)(struct json_object *rroot);
+typedef void (*PCatCodecBenchWriterFunc)(PCatControllerCodecWriter *writer);
+
+typedef struct _PCatCodecBenchCaseData
+{
+    const gchar *name;
+    PCatCodecBenchTreeFunc tree_func;
+    PCatCodecBenchWriterFunc writer_func;
+}PCatCodecBenchCaseData;
+
+typedef struct _PCatCodecBenchRequestData
+{
+    const gchar *name;
+    const gchar *data;
+}PCatCodecBenchRequestData;
+
+typedef struct _PCatCodecBenchResultData
+{
+    gdouble ns_per_response;
+    gdouble allocs_per_response;
+    gsize size;
+}PCatCodecBenchResultData;
+
+static gint g_pcat_codec_bench_cmd_iterations = 200000;
+static gint g_pcat_codec_bench_cmd_fuzz = 100000;
+static gint g_pcat_codec_bench_cmd_seed = 1;
+static gint g_pcat_codec_bench_cmd_stream_size = 8;
+
+static GOptionEntry g_pcat_codec_bench_cmd_entries[] =
+{
+    { "iterations", 'n', 0, G_OPTION_ARG_INT,
+        &g_pcat_codec_bench_cmd_iterations,
+        "Messages encoded or parsed per case (default: 200000)", "N" },
+    { "fuzz", 'f', 0, G_OPTION_ARG_INT, &g_pcat_codec_bench_cmd_fuzz,
+        "Mutated requests checked against json-c (default: 100000)", "N" },
+    { "seed", 0, 0, G_OPTION_ARG_INT, &g_pcat_codec_bench_cmd_seed,
+        "Random seed of the request mutations (default: 1)", "SEED" },
+    { "stream-size", 0, 0, G_OPTION_ARG_INT,
+        &g_pcat_codec_bench_cmd_stream_size,
+        "Pipelined input framed per run in MB (default: 8)", "MB" },
+    { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+};
+
+static const PCatCodecBenchRequestData g_pcat_codec_bench_requests[] =
+{
+    { "pmu-status", "{\"command\":\"pmu-status\"}" },
+    { "charger-on-auto-start-set",
+        "{\"command\":\"charger-on-auto-start-set\",\"state\":1,"
+        "\"timeout\":60}" },
+    { "modem-network-setup",
+        "{\"command\":\"modem-network-setup\",\"apn\":\"cmnet\","
+        "\"user\":\"u\\\"ser\",\"password\":\"p\\u00e4ss\","
+        "\"auth\":\"pap\",\"connection-5g-fail-auto-reset\":0}" },
+    { "schedule-power-event-set",
+        "{ \"command\": \"schedule-power-event-set\", \"event-list\": ["
+        "{ \"action\": 1, \"enabled\": 1, \"year\": 2024, "
+        "\"month\": 3, \"day\": 1, \"hour\": 7, \"minute\": 30, "
+        "\"dow-bits\": 127 }, { \"action\": 0, \"enabled\": 1, "
+        "\"enable-bits\": 16, \"hour\": 23, \"minute\": 0 } ] }" },
+    { "schedule-12-events",
+        "{\"command\":\"schedule-power-event-set\",\"event-list\":["
+        "{\"action\":1,\"enabled\":1,\"enable-bits\":16,"
+        "\"hour\":6,\"minute\":0},"
+        "{\"action\":1,\"enabled\":1,\"enable-bits\":16,"
+        "\"hour\":7,\"minute\":5},"
+        "{\"action\":1,\"enabled\":1,\"enable-bits\":16,"
+        "\"hour\":8,\"minute\":10},"
+        "{\"action\":1,\"enabled\":1,\"enable-bits\":16,"
+        "\"hour\":9,\"minute\":15},"
+        "{\"action\":1,\"enabled\":1,\"enable-bits\":16,"
+        "\"hour\":10,\"minute\":20},"
+        "{\"action\":1,\"enabled\":1,\"enable-bits\":16,"
+        "\"hour\":11,\"minute\":25},"
+        "{\"action\":0,\"enabled\":1,\"enable-bits\":16,"
+        "\"hour\":12,\"minute\":30},"
+        "{\"action\":0,\"enabled\":1,\"enable-bits\":16,"
+        "\"hour\":13,\"minute\":35},"
+        "{\"action\":0,\"enabled\":1,\"enable-bits\":16,"
+        "\"hour\":14,\"minute\":40},"
+        "{\"action\":0,\"enabled\":1,\"enable-bits\":16,"
+        "\"hour\":15,\"minute\":45},"
+        "{\"action\":0,\"enabled\":1,\"enable-bits\":16,"
+        "\"hour\":16,\"minute\":50},"
+        "{\"action\":0,\"enabled\":1,\"enable-bits\":16,"
+        "\"hour\":17,\"minute\":55}"
+        "]}" },
+    { "subscribe",
+        "{\"command\":\"subscribe\",\"topics\":[\"battery\",\"modem\"],"
+        "\"min-interval\":{\"battery\":5}}" },
+    { "batch",
+        "{\"command\":\"batch\",\"commands\":["
+        "{\"command\":\"pmu-status\"},"
+        "{\"command\":\"modem-status-get\"}]}" }
+};
+
+#ifdef __GLIBC__
+
+/* Count heap allocations by wrapping the glibc allocator, GLib and
+ * json-c both end up here. The benchmark is single threaded. */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static guint64 g_pcat_codec_bench_alloc_count = 0;
+
+void *malloc(size_t size)
+{
+    g_pcat_codec_bench_alloc_count++;
+
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    g_pcat_codec_bench_alloc_count++;
+
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    g_pcat_codec_bench_alloc_count++;
+
+    return __libc_realloc(ptr, size);
+}
+
+#define PCAT_CODEC_BENCH_ALLOC_COUNT g_pcat_codec_bench_alloc_count
+
+#else
+
+#define PCAT_CODEC_BENCH_ALLOC_COUNT 0
+
+#endif
+
+static void pcat_codec_bench_modem_status_tree(struct json_object *rroot)
+{
+    struct json_object *child;
+
+    child = json_object_new_string("modem-status-get");
+    json_object_object_add(rroot, "command", child);
+
+    child = json_object_new_int(0);
+    json_object_object_add(rroot, "code", child);
+
+    child = json_object_new_string("lte");
+    json_object_object_add(rroot, "mode", child);
+
+    child = json_object_new_int(0);
+    json_object_object_add(rroot, "rfkill-state", child);
+
+    child = json_object_new_string("ready");
+    json_object_object_add(rroot, "sim-state", child);
+
+    child = json_object_new_string("China Mobile");
+    json_object_object_add(rroot, "isp-name", child);
+
+    child = json_object_new_string("46000");
+    json_object_object_add(rroot, "isp-lpmn", child);
+
+    child = json_object_new_int(-87);
+    json_object_object_add(rroot, "signal-strength", child);
+}
+
+static void pcat_codec_bench_modem_status_writer(
+    PCatControllerCodecWriter *writer)
+{
+    pcat_controller_codec_writer_string(writer, "command",
+        "modem-status-get");
+    pcat_controller_codec_writer_int(writer, "code", 0);
+    pcat_controller_codec_writer_string(writer, "mode", "lte");
+    pcat_controller_codec_writer_int(writer, "rfkill-state", 0);
+    pcat_controller_codec_writer_string(writer, "sim-state", "ready");
+    pcat_controller_codec_writer_string(writer, "isp-name", "China Mobile");
+    pcat_controller_codec_writer_string(writer, "isp-lpmn", "46000");
+    pcat_controller_codec_writer_int(writer, "signal-strength", -87);
+}
+
+static void pcat_codec_bench_hello_tree(struct json_object *rroot)
+{
+    struct json_object *child, *array;
+
+    child = json_object_new_string("hello");
+    json_object_object_add(rroot, "command", child);
+
+    child = json_object_new_int(0);
+    json_object_object_add(rroot, "code", child);
+
+    child = json_object_new_string("json");
+    json_object_object_add(rroot, "encoding", child);
+
+    array = json_object_new_array();
+    json_object_array_add(array, json_object_new_string("json"));
+    json_object_array_add(array, json_object_new_string("msgpack"));
+    json_object_array_add(array, json_object_new_string("cbor"));
+    json_object_object_add(rroot, "encodings", array);
+
+    array = json_object_new_array();
+    json_object_array_add(array, json_object_new_string("pmu-status"));
+    json_object_array_add(array, json_object_new_string("modem"));
+    json_object_array_add(array, json_object_new_string("route"));
+    json_object_object_add(rroot, "topics", array);
+
+    child = json_object_new_double(0.25);
+    json_object_object_add(rroot, "load", child);
+
+    child = json_object_new_boolean(TRUE);
+    json_object_object_add(rroot, "on-battery", child);
+}
+
+static void pcat_codec_bench_hello_writer(PCatControllerCodecWriter *writer)
+{
+    pcat_controller_codec_writer_string(writer, "command", "hello");
+    pcat_controller_codec_writer_int(writer, "code", 0);
+    pcat_controller_codec_writer_string(writer, "encoding", "json");
+
+    pcat_controller_codec_writer_array_begin(writer, "encodings");
+    pcat_controller_codec_writer_string(writer, NULL, "json");
+    pcat_controller_codec_writer_string(writer, NULL, "msgpack");
+    pcat_controller_codec_writer_string(writer, NULL, "cbor");
+    pcat_controller_codec_writer_array_end(writer);
+
+    pcat_controller_codec_writer_array_begin(writer, "topics");
+    pcat_controller_codec_writer_string(writer, NULL, "pmu-status");
+    pcat_controller_codec_writer_string(writer, NULL, "modem");
+    pcat_controller_codec_writer_string(writer, NULL, "route");
+    pcat_controller_codec_writer_array_end(writer);
+
+    pcat_controller_codec_writer_double(writer, "load", 0.25);
+    pcat_controller_codec_writer_boolean(writer, "on-battery", TRUE);
+}
+
+static const PCatCodecBenchCaseData g_pcat_codec_bench_cases[] =
+{
+    { "modem-status-get", pcat_codec_bench_modem_status_tree,
+        pcat_codec_bench_modem_status_writer },
+    { "hello", pcat_codec_bench_hello_tree, pcat_codec_bench_hello_writer },
+};
+
+static GBytes *pcat_codec_bench_tree_encode(
+    const PCatCodecBenchCaseData *case_data, PCatControllerCodecType codec)
+{
+    struct json_object *rroot;
+    GBytes *message;
+
+    rroot = json_object_new_object();
+    case_data->tree_func(rroot);
+    message = pcat_controller_codec_encode(codec, rroot);
+    json_object_put(rroot);
+
+    return message;
+}
+
+static GBytes *pcat_codec_bench_writer_encode(
+    const PCatCodecBenchCaseData *case_data, PCatControllerCodecType codec)
+{
+    PCatControllerCodecWriter writer;
+
+    pcat_controller_codec_writer_init(&writer, codec);
+    pcat_controller_codec_writer_object_begin(&writer, NULL);
+    case_data->writer_func(&writer);
+    pcat_controller_codec_writer_object_end(&writer);
+
+    return pcat_controller_codec_writer_finish(&writer);
+}
+
+static gboolean pcat_codec_bench_verify(
+    const PCatCodecBenchCaseData *case_data, PCatControllerCodecType codec)
+{
+    GBytes *expected_message, *message;
+    struct json_object *expected = NULL, *root = NULL;
+    const guint8 *payload;
+    gsize size;
+    gboolean ret = FALSE;
+
+    expected_message = pcat_codec_bench_tree_encode(case_data, codec);
+    message = pcat_codec_bench_writer_encode(case_data, codec);
+
+    if(expected_message!=NULL && message!=NULL)
+    {
+        payload = pcat_controller_codec_payload_get(codec, expected_message,
+            &size);
+        expected = pcat_controller_codec_decode(codec, payload, size);
+        payload = pcat_controller_codec_payload_get(codec, message, &size);
+        root = pcat_controller_codec_decode(codec, payload, size);
+    }
+
+    if(expected!=NULL && root!=NULL)
+    {
+        ret = json_object_equal(expected, root);
+    }
+
+    if(expected!=NULL)
+    {
+        json_object_put(expected);
+    }
+    if(root!=NULL)
+    {
+        json_object_put(root);
+    }
+    if(expected_message!=NULL)
+    {
+        g_bytes_unref(expected_message);
+    }
+    if(message!=NULL)
+    {
+        g_bytes_unref(message);
+    }
+
+    return ret;
+}
+
+static void pcat_codec_bench_run(const PCatCodecBenchCaseData *case_data,
+    PCatControllerCodecType codec, gboolean use_writer, guint iterations,
+    PCatCodecBenchResultData *result)
+{
+    GBytes *message;
+    guint64 alloc_start;
+    gint64 start_time;
+    guint i;
+
+    result->size = 0;
+    alloc_start = PCAT_CODEC_BENCH_ALLOC_COUNT;
+    start_time = g_get_monotonic_time();
+
+    for(i=0;i<iterations;i++)
+    {
+        if(use_writer)
+        {
+            message = pcat_codec_bench_writer_encode(case_data, codec);
+        }
+        else
+        {
+            message = pcat_codec_bench_tree_encode(case_data, codec);
+        }
+
+        if(message!=NULL)
+        {
+            result->size = g_bytes_get_size(message);
+            g_bytes_unref(message);
+        }
+    }
+
+    result->ns_per_response = (gdouble)(g_get_monotonic_time() -
+        start_time) * 1000.0 / iterations;
+    result->allocs_per_response = (gdouble)(PCAT_CODEC_BENCH_ALLOC_COUNT -
+        alloc_start) / iterations;
+}
+
+static gboolean pcat_codec_bench_request_verify(const gchar *data,
+    gsize len, guint64 *pull_count)
+{
+    gchar buffer[PCAT_CODEC_BENCH_REQUEST_SIZE_MAX];
+    PCatControllerRequest request;
+    struct json_tokener *tokener;
+    struct json_object *expected, *root;
+    gboolean ret = TRUE;
+
+    tokener = json_tokener_new();
+    expected = json_tokener_parse_ex(tokener, data, len);
+    json_tokener_free(tokener);
+
+    memcpy(buffer, data, len);
+    if(pcat_controller_request_parse(&request, buffer, len))
+    {
+        (*pull_count)++;
+
+        root = pcat_controller_request_json_new(&request, 0);
+        if(expected==NULL || root==NULL)
+        {
+            ret = (expected==root);
+        }
+        else
+        {
+            ret = json_object_equal(expected, root);
+        }
+
+        /* Members read as strings must match json_object_get_string(). */
+        if(ret && json_object_is_type(expected, json_type_object))
+        {
+            json_object_object_foreach(expected, key, child)
+            {
+                if(g_strcmp0(json_object_get_string(child),
+                   pcat_controller_request_string_get(&request, 0, key))!=0)
+                {
+                    ret = FALSE;
+                }
+            }
+        }
+
+        if(root!=NULL)
+        {
+            json_object_put(root);
+        }
+    }
+    pcat_controller_request_clear(&request);
+
+    if(expected!=NULL)
+    {
+        json_object_put(expected);
+    }
+
+    return ret;
+}
+
+static gboolean pcat_codec_bench_request_fuzz(guint rounds, guint32 seed)
+{
+    static const gchar alphabet[] = "{}[],:\"\\ 0123456789-+.eEtrufalsnu"
+        "\x01\x7f\xc3\xa9\xff";
+    gchar buffer[PCAT_CODEC_BENCH_REQUEST_SIZE_MAX];
+    const gchar *request;
+    GRand *rand;
+    guint64 pull_count = 0, mismatch_count = 0;
+    gsize len, pos;
+    guint i, j, edits;
+
+    rand = g_rand_new_with_seed(seed);
+
+    for(i=0;i<rounds;i++)
+    {
+        request = g_pcat_codec_bench_requests[g_rand_int_range(rand, 0,
+            G_N_ELEMENTS(g_pcat_codec_bench_requests))].data;
+        len = strlen(request);
+        memcpy(buffer, request, len);
+
+        /* Keep one round in eight intact. */
+        edits = (i % 8==0) ? 0 : g_rand_int_range(rand, 1, 4);
+        for(j=0;j<edits;j++)
+        {
+            pos = g_rand_int_range(rand, 0, len);
+            switch(g_rand_int_range(rand, 0, 3))
+            {
+                case 0:
+                {
+                    buffer[pos] = alphabet[g_rand_int_range(rand, 0,
+                        sizeof(alphabet) - 1)];
+                    break;
+                }
+                case 1:
+                {
+                    if(len + 1 < sizeof(buffer))
+                    {
+                        memmove(buffer + pos + 1, buffer + pos, len - pos);
+                        buffer[pos] = alphabet[g_rand_int_range(rand, 0,
+                            sizeof(alphabet) - 1)];
+                        len++;
+                    }
+                    break;
+                }
+                default:
+                {
+                    if(len > 1)
+                    {
+                        memmove(buffer + pos, buffer + pos + 1,
+                            len - pos - 1);
+                        len--;
+                    }
+                    break;
+                }
+            }
+        }
+
+        if(!pcat_codec_bench_request_verify(buffer, len, &pull_count))
+        {
+            mismatch_count++;
+            if(mismatch_count <= 8)
+            {
+                g_printerr("Request parser differs from json-c on: "
+                    "%.*s\n", (gint)len, buffer);
+            }
+        }
+    }
+
+    g_rand_free(rand);
+
+    printf("request fuzz: %u rounds, %"G_GUINT64_FORMAT" parsed in place, "
+        "%"G_GUINT64_FORMAT" left to json-c, %"G_GUINT64_FORMAT
+        " mismatches\n", rounds, pull_count, rounds - pull_count,
+        mismatch_count);
+
+    return mismatch_count==0;
+}
+
+static void pcat_codec_bench_request_run(const gchar *data,
+    gboolean use_pull, guint iterations, PCatCodecBenchResultData *result)
+{
+    gchar buffer[PCAT_CODEC_BENCH_REQUEST_SIZE_MAX];
+    PCatControllerRequest request;
+    struct json_tokener *tokener;
+    struct json_object *root, *child;
+    const gchar *command;
+    guint64 alloc_start;
+    gint64 start_time;
+    gsize len;
+    guint i;
+
+    len = strlen(data);
+    tokener = json_tokener_new();
+
+    result->size = len;
+    alloc_start = PCAT_CODEC_BENCH_ALLOC_COUNT;
+    start_time = g_get_monotonic_time();
+
+    for(i=0;i<iterations;i++)
+    {
+        /* The pull parser works in place, copy in both cases. */
+        memcpy(buffer, data, len);
+
+        if(use_pull)
+        {
+            if(pcat_controller_request_parse(&request, buffer, len))
+            {
+                command = pcat_controller_request_string_get(&request, 0,
+                    "command");
+                (void)command;
+            }
+            pcat_controller_request_clear(&request);
+        }
+        else
+        {
+            json_tokener_reset(tokener);
+            root = json_tokener_parse_ex(tokener, buffer, len);
+            if(root!=NULL)
+            {
+                if(json_object_object_get_ex(root, "command", &child))
+                {
+                    command = json_object_get_string(child);
+                    (void)command;
+                }
+                json_object_put(root);
+            }
+        }
+    }
+
+    result->ns_per_response = (gdouble)(g_get_monotonic_time() -
+        start_time) * 1000.0 / iterations;
+    result->allocs_per_response = (gdouble)(PCAT_CODEC_BENCH_ALLOC_COUNT -
+        alloc_start) / iterations;
+
+    json_tokener_free(tokener);
+}
+
+static GByteArray *pcat_codec_bench_stream_new(guint size)
+{
+    GByteArray *stream;
+    const gchar *event = "{\"action\":1,\"enabled\":1,"
+        "\"enable-bits\":16,\"hour\":6,\"minute\":0},";
+    const gchar *data;
+    gsize start;
+    guint i;
+
+    stream = g_byte_array_new();
+
+    /* A large schedule request just under the input limit, followed by
+     * the small requests, repeated until the stream is full. */
+    while(stream->len < size)
+    {
+        data = "{\"command\":\"schedule-power-event-set\","
+            "\"event-list\":[";
+        g_byte_array_append(stream, (const guint8 *)data, strlen(data));
+        start = stream->len;
+        while(stream->len - start < PCAT_CODEC_BENCH_STREAM_MESSAGE_SIZE)
+        {
+            g_byte_array_append(stream, (const guint8 *)event,
+                strlen(event));
+        }
+        stream->data[stream->len-1] = ']';
+        g_byte_array_append(stream, (const guint8 *)"}", 2);
+
+        for(i=0;i<G_N_ELEMENTS(g_pcat_codec_bench_requests);i++)
+        {
+            data = g_pcat_codec_bench_requests[i].data;
+            g_byte_array_append(stream, (const guint8 *)data,
+                strlen(data) + 1);
+        }
+    }
+
+    return stream;
+}
+
+static guint pcat_codec_bench_stream_rescan_run(const GByteArray *stream,
+    gint64 *read_time_max)
+{
+    GByteArray *buffer;
+    struct json_tokener *tokener;
+    struct json_object *root;
+    const gchar *start;
+    gsize offset, chunk, i, used_size;
+    gint64 read_time;
+    guint count = 0;
+
+    /* The framing before the incremental parser: every read is appended
+     * and the whole buffer is scanned again, with one tokener per
+     * message. */
+    buffer = g_byte_array_new();
+
+    for(offset=0;offset<stream->len;offset+=chunk)
+    {
+        chunk = MIN(PCAT_CODEC_BENCH_STREAM_CHUNK_SIZE,
+            stream->len - offset);
+        read_time = g_get_monotonic_time();
+        g_byte_array_append(buffer, stream->data + offset, chunk);
+
+        used_size = 0;
+        start = (const gchar *)buffer->data;
+        for(i=0;i<buffer->len;i++)
+        {
+            if(buffer->data[i]!=0)
+            {
+                continue;
+            }
+
+            if(i > used_size)
+            {
+                tokener = json_tokener_new();
+                root = json_tokener_parse_ex(tokener, start, i - used_size);
+                json_tokener_free(tokener);
+
+                if(root!=NULL)
+                {
+                    count++;
+                    json_object_put(root);
+                }
+            }
+
+            used_size = i + 1;
+            start = (const gchar *)buffer->data + i + 1;
+        }
+
+        if(used_size > 0)
+        {
+            g_byte_array_remove_range(buffer, 0, used_size);
+        }
+
+        read_time = g_get_monotonic_time() - read_time;
+        *read_time_max = MAX(*read_time_max, read_time);
+    }
+
+    g_byte_array_unref(buffer);
+
+    return count;
+}
+
+static guint pcat_codec_bench_stream_incremental_run(
+    const GByteArray *stream, gint64 *read_time_max)
+{
+    struct json_tokener *tokener;
+    struct json_object *root, *input_root = NULL;
+    const guint8 *data, *end;
+    gsize offset, len, segment_size;
+    gint64 read_time;
+    guint count = 0;
+
+    /* The framing of the controller input path: only new bytes are
+     * searched and one tokener is fed per connection. */
+    tokener = json_tokener_new();
+
+    for(offset=0;offset<stream->len;offset+=PCAT_CODEC_BENCH_STREAM_CHUNK_SIZE)
+    {
+        data = stream->data + offset;
+        len = MIN(PCAT_CODEC_BENCH_STREAM_CHUNK_SIZE, stream->len - offset);
+        read_time = g_get_monotonic_time();
+
+        while(len > 0)
+        {
+            end = memchr(data, 0, len);
+            segment_size = (end!=NULL) ? (gsize)(end - data) : len;
+
+            if(input_root==NULL && segment_size > 0)
+            {
+                root = json_tokener_parse_ex(tokener, (const gchar *)data,
+                    segment_size);
+                if(root!=NULL)
+                {
+                    input_root = root;
+                }
+            }
+
+            if(end==NULL)
+            {
+                break;
+            }
+
+            if(input_root!=NULL)
+            {
+                count++;
+                json_object_put(input_root);
+                input_root = NULL;
+            }
+
+            json_tokener_reset(tokener);
+
+            data = end + 1;
+            len -= segment_size + 1;
+        }
+
+        read_time = g_get_monotonic_time() - read_time;
+        *read_time_max = MAX(*read_time_max, read_time);
+    }
+
+    if(input_root!=NULL)
+    {
+        json_object_put(input_root);
+    }
+    json_tokener_free(tokener);
+
+    return count;
+}
+
+static gboolean pcat_codec_bench_stream_run(guint size)
+{
+    GByteArray *stream;
+    gint64 start_time, rescan_time, incremental_time;
+    gint64 rescan_read_max = 0, incremental_read_max = 0;
+    guint rescan_count, incremental_count;
+    gdouble size_mb;
+
+    stream = pcat_codec_bench_stream_new(size);
+
+    start_time = g_get_monotonic_time();
+    rescan_count = pcat_codec_bench_stream_rescan_run(stream,
+        &rescan_read_max);
+    rescan_time = MAX(g_get_monotonic_time() - start_time, 1);
+
+    start_time = g_get_monotonic_time();
+    incremental_count = pcat_codec_bench_stream_incremental_run(stream,
+        &incremental_read_max);
+    incremental_time = MAX(g_get_monotonic_time() - start_time, 1);
+
+    /* Throughput over the whole stream, and the longest time one 4 KB
+     * read kept the loop busy. */
+    size_mb = stream->len / 1048576.0;
+    printf("%-14s %8s %11s %11s %11s %11s %8s\n", "stream framing",
+        "MB", "rescan MB/s", "incr MB/s", "rescan ms", "incr ms",
+        "messages");
+    printf("%-14s %8.1f %11.1f %11.1f %11.2f %11.2f %8u\n", "4 KB reads",
+        size_mb, size_mb * G_USEC_PER_SEC / rescan_time,
+        size_mb * G_USEC_PER_SEC / incremental_time,
+        rescan_read_max / 1000.0, incremental_read_max / 1000.0,
+        incremental_count);
+
+    g_byte_array_unref(stream);
+
+    return rescan_count==incremental_count && incremental_count > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    GError *error = NULL;
+    GOptionContext *context;
+    const PCatCodecBenchCaseData *case_data;
+    PCatCodecBenchResultData tree_result, writer_result;
+    guint i, codec;
+    gint ret = 0;
+
+    context = g_option_context_new("- PCat Manager codec and request "
+        "parser benchmark");
+    g_option_context_add_main_entries(context,
+        g_pcat_codec_bench_cmd_entries, NULL);
+    if(!g_option_context_parse(context, &argc, &argv, &error))
+    {
+        g_printerr("Option parsing failed: %s\n", error->message);
+        g_clear_error(&error);
+        g_option_context_free(context);
+
+        return 1;
+    }
+    g_option_context_free(context);
+
+    if(g_pcat_codec_bench_cmd_iterations <= 0 ||
+       g_pcat_codec_bench_cmd_fuzz < 0 ||
+       g_pcat_codec_bench_cmd_stream_size < 0)
+    {
+        g_printerr("Iterations must be positive!\n");
+
+        return 1;
+    }
+
+#ifndef __GLIBC__
+    g_printerr("Allocation counting needs glibc, reporting 0.\n");
+#endif
+
+    printf("%-18s %-8s %12s %12s %10s %10s %8s %8s\n", "response", "codec",
+        "json-c ns", "writer ns", "json-c al", "writer al", "json-c B",
+        "writer B");
+
+    for(i=0;i<G_N_ELEMENTS(g_pcat_codec_bench_cases);i++)
+    {
+        case_data = &(g_pcat_codec_bench_cases[i]);
+
+        for(codec=0;codec<PCAT_CONTROLLER_CODEC_LAST;codec++)
+        {
+            if(!pcat_codec_bench_verify(case_data, codec))
+            {
+                g_printerr("Writer output of %s differs in %s encoding!\n",
+                    case_data->name, pcat_controller_codec_name_get(codec));
+                ret = 1;
+
+                continue;
+            }
+
+            pcat_codec_bench_run(case_data, codec, FALSE,
+                g_pcat_codec_bench_cmd_iterations, &tree_result);
+            pcat_codec_bench_run(case_data, codec, TRUE,
+                g_pcat_codec_bench_cmd_iterations, &writer_result);
+
+            printf("%-18s %-8s %12.1f %12.1f %10.2f %10.2f %8"
+                G_GSIZE_FORMAT" %8"G_GSIZE_FORMAT"\n", case_data->name,
+                pcat_controller_codec_name_get(codec),
+                tree_result.ns_per_response, writer_result.ns_per_response,
+                tree_result.allocs_per_response,
+                writer_result.allocs_per_response, tree_result.size,
+                writer_result.size);
+        }
+    }
+
+    printf("\n%-30s %12s %12s %10s %10s %8s\n", "request", "json-c ns",
+        "pull ns", "json-c al", "pull al", "bytes");
+
+    for(i=0;i<G_N_ELEMENTS(g_pcat_codec_bench_requests);i++)
+    {
+        pcat_codec_bench_request_run(g_pcat_codec_bench_requests[i].data,
+            FALSE, g_pcat_codec_bench_cmd_iterations, &tree_result);
+        pcat_codec_bench_request_run(g_pcat_codec_bench_requests[i].data,
+            TRUE, g_pcat_codec_bench_cmd_iterations, &writer_result);
+
+        printf("%-30s %12.1f %12.1f %10.2f %10.2f %8"G_GSIZE_FORMAT"\n",
+            g_pcat_codec_bench_requests[i].name,
+            tree_result.ns_per_response, writer_result.ns_per_response,
+            tree_result.allocs_per_response,
+            writer_result.allocs_per_response, tree_result.size);
+    }
+
+    if(g_pcat_codec_bench_cmd_stream_size > 0)
+    {
+        printf("\n");
+        if(!pcat_codec_bench_stream_run(
+            (guint)g_pcat_codec_bench_cmd_stream_size * 1048576))
+        {
+            g_printerr("Stream framings parsed different messages!\n");
+            ret = 1;
+        }
+    }
+
+    if(g_pcat_codec_bench_cmd_fuzz > 0)
+    {
+        printf("\n");
+        if(!pcat_codec_bench_request_fuzz(g_pcat_codec_bench_cmd_fuzz,
+            g_pcat_codec_bench_cmd_seed))
+        {
+            ret = 1;
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,1860 @@
+#include <string.h>
+#include "controller-codec.h"
+
+#define PCAT_CONTROLLER_CODEC_DEPTH_MAX 32
+
+typedef struct _PCatControllerCodecReader
+{
+    const guint8 *data;
+    gsize len;
+    gsize offset;
+}PCatControllerCodecReader;
+
+static const gchar * const g_pcat_controller_codec_name_list[
+    PCAT_CONTROLLER_CODEC_LAST] =
+{
+    [PCAT_CONTROLLER_CODEC_JSON] = "json",
+    [PCAT_CONTROLLER_CODEC_MSGPACK] = "msgpack",
+    [PCAT_CONTROLLER_CODEC_CBOR] = "cbor"
+};
+
+static inline void pcat_controller_codec_be_append(GByteArray *buffer,
+    guint64 value, guint size)
+{
+    guint8 bytes[8];
+    guint i;
+
+    for(i=0;i<size;i++)
+    {
+        bytes[i] = (value >> ((size - i - 1) * 8)) & 0xFF;
+    }
+
+    g_byte_array_append(buffer, bytes, size);
+}
+
+static inline gboolean pcat_controller_codec_be_read(
+    PCatControllerCodecReader *reader, guint size, guint64 *value)
+{
+    guint64 v = 0;
+    guint i;
+
+    if(reader->len - reader->offset < size)
+    {
+        return FALSE;
+    }
+
+    for(i=0;i<size;i++)
+    {
+        v = (v << 8) | reader->data[reader->offset + i];
+    }
+    reader->offset += size;
+
+    *value = v;
+
+    return TRUE;
+}
+
+static inline void pcat_controller_codec_code_append(GByteArray *buffer,
+    guint8 code)
+{
+    g_byte_array_append(buffer, &code, 1);
+}
+
+static inline guint64 pcat_controller_codec_double_to_bits(gdouble value)
+{
+    guint64 bits;
+
+    memcpy(&bits, &value, 8);
+
+    return bits;
+}
+
+static inline gdouble pcat_controller_codec_bits_to_double(guint64 bits)
+{
+    gdouble value;
+
+    memcpy(&value, &bits, 8);
+
+    return value;
+}
+
+static inline gdouble pcat_controller_codec_bits_to_float(guint32 bits)
+{
+    gfloat value;
+
+    memcpy(&value, &bits, 4);
+
+    return value;
+}
+
+static gdouble pcat_controller_codec_half_to_double(guint16 half)
+{
+    guint32 sign = (guint32)(half & 0x8000) << 16;
+    guint32 exp = (half >> 10) & 0x1F;
+    guint32 mant = half & 0x3FF;
+    guint32 bits;
+
+    if(exp==0x1F)
+    {
+        bits = sign | 0x7F800000 | (mant << 13);
+    }
+    else if(exp==0)
+    {
+        if(mant==0)
+        {
+            bits = sign;
+        }
+        else
+        {
+            exp = 127 - 15 + 1;
+            while(!(mant & 0x400))
+            {
+                mant <<= 1;
+                exp--;
+            }
+            mant &= 0x3FF;
+            bits = sign | (exp << 23) | (mant << 13);
+        }
+    }
+    else
+    {
+        bits = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+    }
+
+    return pcat_controller_codec_bits_to_float(bits);
+}
+
+static struct json_object *pcat_controller_codec_uint_new(guint64 value)
+{
+    if(value > G_MAXINT64)
+    {
+        return json_object_new_double((gdouble)value);
+    }
+
+    return json_object_new_int64(value);
+}
+
+static void pcat_controller_codec_msgpack_int_append(GByteArray *buffer,
+    gint64 value)
+{
+    if(value >= 0)
+    {
+        if(value < 128)
+        {
+            pcat_controller_codec_code_append(buffer, value);
+        }
+        else if(value <= G_MAXUINT8)
+        {
+            pcat_controller_codec_code_append(buffer, 0xCC);
+            pcat_controller_codec_be_append(buffer, value, 1);
+        }
+        else if(value <= G_MAXUINT16)
+        {
+            pcat_controller_codec_code_append(buffer, 0xCD);
+            pcat_controller_codec_be_append(buffer, value, 2);
+        }
+        else if(value <= G_MAXUINT32)
+        {
+            pcat_controller_codec_code_append(buffer, 0xCE);
+            pcat_controller_codec_be_append(buffer, value, 4);
+        }
+        else
+        {
+            pcat_controller_codec_code_append(buffer, 0xCF);
+            pcat_controller_codec_be_append(buffer, value, 8);
+        }
+    }
+    else
+    {
+        if(value >= -32)
+        {
+            pcat_controller_codec_code_append(buffer, value & 0xFF);
+        }
+        else if(value >= G_MININT8)
+        {
+            pcat_controller_codec_code_append(buffer, 0xD0);
+            pcat_controller_codec_be_append(buffer, value, 1);
+        }
+        else if(value >= G_MININT16)
+        {
+            pcat_controller_codec_code_append(buffer, 0xD1);
+            pcat_controller_codec_be_append(buffer, value, 2);
+        }
+        else if(value >= G_MININT32)
+        {
+            pcat_controller_codec_code_append(buffer, 0xD2);
+            pcat_controller_codec_be_append(buffer, value, 4);
+        }
+        else
+        {
+            pcat_controller_codec_code_append(buffer, 0xD3);
+            pcat_controller_codec_be_append(buffer, value, 8);
+        }
+    }
+}
+
+static void pcat_controller_codec_msgpack_length_append(GByteArray *buffer,
+    guint8 fix_code, gsize fix_max, guint8 code8, guint8 code16,
+    guint8 code32, gsize len)
+{
+    if(len <= fix_max)
+    {
+        pcat_controller_codec_code_append(buffer, fix_code | len);
+    }
+    else if(code8!=0 && len <= G_MAXUINT8)
+    {
+        pcat_controller_codec_code_append(buffer, code8);
+        pcat_controller_codec_be_append(buffer, len, 1);
+    }
+    else if(len <= G_MAXUINT16)
+    {
+        pcat_controller_codec_code_append(buffer, code16);
+        pcat_controller_codec_be_append(buffer, len, 2);
+    }
+    else
+    {
+        pcat_controller_codec_code_append(buffer, code32);
+        pcat_controller_codec_be_append(buffer, len, 4);
+    }
+}
+
+static gboolean pcat_controller_codec_msgpack_value_append(
+    GByteArray *buffer, struct json_object *value, guint depth)
+{
+    gsize len;
+    gsize i;
+    const gchar *str;
+
+    if(depth > PCAT_CONTROLLER_CODEC_DEPTH_MAX)
+    {
+        return FALSE;
+    }
+
+    switch(json_object_get_type(value))
+    {
+        case json_type_boolean:
+        {
+            pcat_controller_codec_code_append(buffer,
+                json_object_get_boolean(value) ? 0xC3 : 0xC2);
+            break;
+        }
+        case json_type_int:
+        {
+            pcat_controller_codec_msgpack_int_append(buffer,
+                json_object_get_int64(value));
+            break;
+        }
+        case json_type_double:
+        {
+            pcat_controller_codec_code_append(buffer, 0xCB);
+            pcat_controller_codec_be_append(buffer,
+                pcat_controller_codec_double_to_bits(
+                json_object_get_double(value)), 8);
+            break;
+        }
+        case json_type_string:
+        {
+            str = json_object_get_string(value);
+            len = json_object_get_string_len(value);
+            pcat_controller_codec_msgpack_length_append(buffer, 0xA0, 31,
+                0xD9, 0xDA, 0xDB, len);
+            g_byte_array_append(buffer, (const guint8 *)str, len);
+            break;
+        }
+        case json_type_array:
+        {
+            len = json_object_array_length(value);
+            pcat_controller_codec_msgpack_length_append(buffer, 0x90, 15,
+                0, 0xDC, 0xDD, len);
+            for(i=0;i<len;i++)
+            {
+                if(!pcat_controller_codec_msgpack_value_append(buffer,
+                    json_object_array_get_idx(value, i), depth + 1))
+                {
+                    return FALSE;
+                }
+            }
+            break;
+        }
+        case json_type_object:
+        {
+            len = json_object_object_length(value);
+            pcat_controller_codec_msgpack_length_append(buffer, 0x80, 15,
+                0, 0xDE, 0xDF, len);
+            json_object_object_foreach(value, key, child)
+            {
+                len = strlen(key);
+                pcat_controller_codec_msgpack_length_append(buffer, 0xA0,
+                    31, 0xD9, 0xDA, 0xDB, len);
+                g_byte_array_append(buffer, (const guint8 *)key, len);
+
+                if(!pcat_controller_codec_msgpack_value_append(buffer,
+                    child, depth + 1))
+                {
+                    return FALSE;
+                }
+            }
+            break;
+        }
+        default:
+        {
+            pcat_controller_codec_code_append(buffer, 0xC0);
+            break;
+        }
+    }
+
+    return TRUE;
+}
+
+static gboolean pcat_controller_codec_msgpack_value_read(
+    PCatControllerCodecReader *reader, guint depth,
+    struct json_object **value);
+
+static gboolean pcat_controller_codec_msgpack_container_read(
+    PCatControllerCodecReader *reader, guint depth, gboolean is_map,
+    guint64 count, struct json_object **value)
+{
+    struct json_object *container, *key, *child;
+    guint64 i;
+
+    if(count > reader->len - reader->offset)
+    {
+        return FALSE;
+    }
+
+    container = is_map ? json_object_new_object() : json_object_new_array();
+
+    for(i=0;i<count;i++)
+    {
+        key = NULL;
+        if(is_map)
+        {
+            if(!pcat_controller_codec_msgpack_value_read(reader, depth + 1,
+                &key) || !json_object_is_type(key, json_type_string))
+            {
+                json_object_put(key);
+                json_object_put(container);
+
+                return FALSE;
+            }
+        }
+
+        if(!pcat_controller_codec_msgpack_value_read(reader, depth + 1,
+            &child))
+        {
+            json_object_put(key);
+            json_object_put(container);
+
+            return FALSE;
+        }
+
+        if(is_map)
+        {
+            json_object_object_add(container, json_object_get_string(key),
+                child);
+            json_object_put(key);
+        }
+        else
+        {
+            json_object_array_add(container, child);
+        }
+    }
+
+    *value = container;
+
+    return TRUE;
+}
+
+static gboolean pcat_controller_codec_string_read(
+    PCatControllerCodecReader *reader, guint64 len,
+    struct json_object **value)
+{
+    if(len > reader->len - reader->offset || len > G_MAXINT)
+    {
+        return FALSE;
+    }
+
+    *value = json_object_new_string_len(
+        (const gchar *)reader->data + reader->offset, len);
+    reader->offset += len;
+
+    return TRUE;
+}
+
+static gboolean pcat_controller_codec_msgpack_value_read(
+    PCatControllerCodecReader *reader, guint depth,
+    struct json_object **value)
+{
+    guint8 code;
+    guint64 v;
+
+    *value = NULL;
+
+    if(depth > PCAT_CONTROLLER_CODEC_DEPTH_MAX ||
+       reader->offset >= reader->len)
+    {
+        return FALSE;
+    }
+
+    code = reader->data[reader->offset];
+    reader->offset++;
+
+    if(code <= 0x7F)
+    {
+        *value = json_object_new_int64(code);
+
+        return TRUE;
+    }
+    else if(code >= 0xE0)
+    {
+        *value = json_object_new_int64((gint8)code);
+
+        return TRUE;
+    }
+    else if((code & 0xF0)==0x80)
+    {
+        return pcat_controller_codec_msgpack_container_read(reader, depth,
+            TRUE, code & 0x0F, value);
+    }
+    else if((code & 0xF0)==0x90)
+    {
+        return pcat_controller_codec_msgpack_container_read(reader, depth,
+            FALSE, code & 0x0F, value);
+    }
+    else if((code & 0xE0)==0xA0)
+    {
+        return pcat_controller_codec_string_read(reader, code & 0x1F, value);
+    }
+
+    switch(code)
+    {
+        case 0xC0:
+        {
+            return TRUE;
+        }
+        case 0xC2:
+        case 0xC3:
+        {
+            *value = json_object_new_boolean(code==0xC3);
+
+            return TRUE;
+        }
+        case 0xC4:
+        case 0xC5:
+        case 0xC6:
+        case 0xD9:
+        case 0xDA:
+        case 0xDB:
+        {
+            if(!pcat_controller_codec_be_read(reader,
+                1 << ((code >= 0xD9 ? code - 0xD9 : code - 0xC4)), &v))
+            {
+                return FALSE;
+            }
+
+            return pcat_controller_codec_string_read(reader, v, value);
+        }
+        case 0xCA:
+        {
+            if(!pcat_controller_codec_be_read(reader, 4, &v))
+            {
+                return FALSE;
+            }
+            *value = json_object_new_double(
+                pcat_controller_codec_bits_to_float(v));
+
+            return TRUE;
+        }
+        case 0xCB:
+        {
+            if(!pcat_controller_codec_be_read(reader, 8, &v))
+            {
+                return FALSE;
+            }
+            *value = json_object_new_double(
+                pcat_controller_codec_bits_to_double(v));
+
+            return TRUE;
+        }
+        case 0xCC:
+        case 0xCD:
+        case 0xCE:
+        case 0xCF:
+        {
+            if(!pcat_controller_codec_be_read(reader, 1 << (code - 0xCC),
+                &v))
+            {
+                return FALSE;
+            }
+            *value = pcat_controller_codec_uint_new(v);
+
+            return TRUE;
+        }
+        case 0xD0:
+        {
+            if(!pcat_controller_codec_be_read(reader, 1, &v))
+            {
+                return FALSE;
+            }
+            *value = json_object_new_int64((gint8)v);
+
+            return TRUE;
+        }
+        case 0xD1:
+        {
+            if(!pcat_controller_codec_be_read(reader, 2, &v))
+            {
+                return FALSE;
+            }
+            *value = json_object_new_int64((gint16)v);
+
+            return TRUE;
+        }
+        case 0xD2:
+        {
+            if(!pcat_controller_codec_be_read(reader, 4, &v))
+            {
+                return FALSE;
+            }
+            *value = json_object_new_int64((gint32)v);
+
+            return TRUE;
+        }
+        case 0xD3:
+        {
+            if(!pcat_controller_codec_be_read(reader, 8, &v))
+            {
+                return FALSE;
+            }
+            *value = json_object_new_int64((gint64)v);
+
+            return TRUE;
+        }
+        case 0xDC:
+        case 0xDD:
+        case 0xDE:
+        case 0xDF:
+        {
+            if(!pcat_controller_codec_be_read(reader,
+                (code & 0x01) ? 4 : 2, &v))
+            {
+                return FALSE;
+            }
+
+            return pcat_controller_codec_msgpack_container_read(reader,
+                depth, code >= 0xDE, v, value);
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    return FALSE;
+}
+
+static void pcat_controller_codec_cbor_head_append(GByteArray *buffer,
+    guint8 major, guint64 value)
+{
+    major <<= 5;
+
+    if(value < 24)
+    {
+        pcat_controller_codec_code_append(buffer, major | value);
+    }
+    else if(value <= G_MAXUINT8)
+    {
+        pcat_controller_codec_code_append(buffer, major | 24);
+        pcat_controller_codec_be_append(buffer, value, 1);
+    }
+    else if(value <= G_MAXUINT16)
+    {
+        pcat_controller_codec_code_append(buffer, major | 25);
+        pcat_controller_codec_be_append(buffer, value, 2);
+    }
+    else if(value <= G_MAXUINT32)
+    {
+        pcat_controller_codec_code_append(buffer, major | 26);
+        pcat_controller_codec_be_append(buffer, value, 4);
+    }
+    else
+    {
+        pcat_controller_codec_code_append(buffer, major | 27);
+        pcat_controller_codec_be_append(buffer, value, 8);
+    }
+}
+
+static gboolean pcat_controller_codec_cbor_value_append(GByteArray *buffer,
+    struct json_object *value, guint depth)
+{
+    gsize len;
+    gsize i;
+    gint64 iv;
+    const gchar *str;
+
+    if(depth > PCAT_CONTROLLER_CODEC_DEPTH_MAX)
+    {
+        return FALSE;
+    }
+
+    switch(json_object_get_type(value))
+    {
+        case json_type_boolean:
+        {
+            pcat_controller_codec_code_append(buffer,
+                json_object_get_boolean(value) ? 0xF5 : 0xF4);
+            break;
+        }
+        case json_type_int:
+        {
+            iv = json_object_get_int64(value);
+            if(iv >= 0)
+            {
+                pcat_controller_codec_cbor_head_append(buffer, 0, iv);
+            }
+            else
+            {
+                pcat_controller_codec_cbor_head_append(buffer, 1,
+                    (guint64)(-1 - iv));
+            }
+            break;
+        }
+        case json_type_double:
+        {
+            pcat_controller_codec_code_append(buffer, 0xFB);
+            pcat_controller_codec_be_append(buffer,
+                pcat_controller_codec_double_to_bits(
+                json_object_get_double(value)), 8);
+            break;
+        }
+        case json_type_string:
+        {
+            str = json_object_get_string(value);
+            len = json_object_get_string_len(value);
+            pcat_controller_codec_cbor_head_append(buffer, 3, len);
+            g_byte_array_append(buffer, (const guint8 *)str, len);
+            break;
+        }
+        case json_type_array:
+        {
+            len = json_object_array_length(value);
+            pcat_controller_codec_cbor_head_append(buffer, 4, len);
+            for(i=0;i<len;i++)
+            {
+                if(!pcat_controller_codec_cbor_value_append(buffer,
+                    json_object_array_get_idx(value, i), depth + 1))
+                {
+                    return FALSE;
+                }
+            }
+            break;
+        }
+        case json_type_object:
+        {
+            pcat_controller_codec_cbor_head_append(buffer, 5,
+                json_object_object_length(value));
+            json_object_object_foreach(value, key, child)
+            {
+                len = strlen(key);
+                pcat_controller_codec_cbor_head_append(buffer, 3, len);
+                g_byte_array_append(buffer, (const guint8 *)key, len);
+
+                if(!pcat_controller_codec_cbor_value_append(buffer, child,
+                    depth + 1))
+                {
+                    return FALSE;
+                }
+            }
+            break;
+        }
+        default:
+        {
+            pcat_controller_codec_code_append(buffer, 0xF6);
+            break;
+        }
+    }
+
+    return TRUE;
+}
+
+static gboolean pcat_controller_codec_cbor_value_read(
+    PCatControllerCodecReader *reader, guint depth,
+    struct json_object **value)
+{
+    guint8 initial, major, info;
+    guint64 v = 0;
+    guint64 i;
+    struct json_object *container, *key, *child;
+
+    *value = NULL;
+
+    if(depth > PCAT_CONTROLLER_CODEC_DEPTH_MAX ||
+       reader->offset >= reader->len)
+    {
+        return FALSE;
+    }
+
+    initial = reader->data[reader->offset];
+    reader->offset++;
+    major = initial >> 5;
+    info = initial & 0x1F;
+
+    if(major==7)
+    {
+        switch(info)
+        {
+            case 20:
+            case 21:
+            {
+                *value = json_object_new_boolean(info==21);
+
+                return TRUE;
+            }
+            case 22:
+            case 23:
+            {
+                return TRUE;
+            }
+            case 25:
+            {
+                if(!pcat_controller_codec_be_read(reader, 2, &v))
+                {
+                    return FALSE;
+                }
+                *value = json_object_new_double(
+                    pcat_controller_codec_half_to_double(v));
+
+                return TRUE;
+            }
+            case 26:
+            {
+                if(!pcat_controller_codec_be_read(reader, 4, &v))
+                {
+                    return FALSE;
+                }
+                *value = json_object_new_double(
+                    pcat_controller_codec_bits_to_float(v));
+
+                return TRUE;
+            }
+            case 27:
+            {
+                if(!pcat_controller_codec_be_read(reader, 8, &v))
+                {
+                    return FALSE;
+                }
+                *value = json_object_new_double(
+                    pcat_controller_codec_bits_to_double(v));
+
+                return TRUE;
+            }
+            default:
+            {
+                return FALSE;
+            }
+        }
+    }
+
+    if(info < 24)
+    {
+        v = info;
+    }
+    else if(info <= 27)
+    {
+        if(!pcat_controller_codec_be_read(reader, 1 << (info - 24), &v))
+        {
+            return FALSE;
+        }
+    }
+    else
+    {
+        return FALSE;
+    }
+
+    switch(major)
+    {
+        case 0:
+        {
+            *value = pcat_controller_codec_uint_new(v);
+
+            return TRUE;
+        }
+        case 1:
+        {
+            if(v > G_MAXINT64)
+            {
+                *value = json_object_new_double(-1.0 - (gdouble)v);
+            }
+            else
+            {
+                *value = json_object_new_int64(-1 - (gint64)v);
+            }
+
+            return TRUE;
+        }
+        case 2:
+        case 3:
+        {
+            return pcat_controller_codec_string_read(reader, v, value);
+        }
+        case 4:
+        case 5:
+        {
+            if(v > reader->len - reader->offset)
+            {
+                return FALSE;
+            }
+
+            container = (major==5) ? json_object_new_object() :
+                json_object_new_array();
+
+            for(i=0;i<v;i++)
+            {
+                key = NULL;
+                if(major==5)
+                {
+                    if(!pcat_controller_codec_cbor_value_read(reader,
+                        depth + 1, &key) ||
+                       !json_object_is_type(key, json_type_string))
+                    {
+                        json_object_put(key);
+                        json_object_put(container);
+
+                        return FALSE;
+                    }
+                }
+
+                if(!pcat_controller_codec_cbor_value_read(reader,
+                    depth + 1, &child))
+                {
+                    json_object_put(key);
+                    json_object_put(container);
+
+                    return FALSE;
+                }
+
+                if(major==5)
+                {
+                    json_object_object_add(container,
+                        json_object_get_string(key), child);
+                    json_object_put(key);
+                }
+                else
+                {
+                    json_object_array_add(container, child);
+                }
+            }
+
+            *value = container;
+
+            return TRUE;
+        }
+        case 6:
+        {
+            return pcat_controller_codec_cbor_value_read(reader, depth + 1,
+                value);
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    return FALSE;
+}
+
+const gchar *pcat_controller_codec_name_get(PCatControllerCodecType type)
+{
+    if(type >= PCAT_CONTROLLER_CODEC_LAST)
+    {
+        return NULL;
+    }
+
+    return g_pcat_controller_codec_name_list[type];
+}
+
+gboolean pcat_controller_codec_name_parse(const gchar *name,
+    PCatControllerCodecType *type)
+{
+    guint i;
+
+    if(name==NULL)
+    {
+        return FALSE;
+    }
+
+    for(i=0;i<PCAT_CONTROLLER_CODEC_LAST;i++)
+    {
+        if(g_ascii_strcasecmp(name, g_pcat_controller_codec_name_list[i])==0)
+        {
+            if(type!=NULL)
+            {
+                *type = i;
+            }
+
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+GBytes *pcat_controller_codec_encode(PCatControllerCodecType type,
+    struct json_object *root)
+{
+    const gchar *json_data;
+    GByteArray *buffer;
+    gboolean ret = FALSE;
+    gsize len;
+
+    if(type==PCAT_CONTROLLER_CODEC_JSON)
+    {
+        json_data = json_object_to_json_string(root);
+        if(json_data==NULL)
+        {
+            return NULL;
+        }
+
+        return g_bytes_new(json_data, strlen(json_data)+1);
+    }
+
+    buffer = g_byte_array_sized_new(256);
+    g_byte_array_set_size(buffer, PCAT_CONTROLLER_CODEC_FRAME_HEADER_SIZE);
+
+    switch(type)
+    {
+        case PCAT_CONTROLLER_CODEC_MSGPACK:
+        {
+            ret = pcat_controller_codec_msgpack_value_append(buffer, root,
+                0);
+            break;
+        }
+        case PCAT_CONTROLLER_CODEC_CBOR:
+        {
+            ret = pcat_controller_codec_cbor_value_append(buffer, root, 0);
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    if(!ret)
+    {
+        g_byte_array_unref(buffer);
+
+        return NULL;
+    }
+
+    len = buffer->len - PCAT_CONTROLLER_CODEC_FRAME_HEADER_SIZE;
+    buffer->data[0] = (len >> 24) & 0xFF;
+    buffer->data[1] = (len >> 16) & 0xFF;
+    buffer->data[2] = (len >> 8) & 0xFF;
+    buffer->data[3] = len & 0xFF;
+
+    return g_byte_array_free_to_bytes(buffer);
+}
+
+struct json_object *pcat_controller_codec_decode(
+    PCatControllerCodecType type, const guint8 *data, gsize len)
+{
+    PCatControllerCodecReader reader;
+    struct json_tokener *tokener;
+    struct json_object *root = NULL;
+    gboolean ret = FALSE;
+
+    if(data==NULL || len==0)
+    {
+        return NULL;
+    }
+
+    reader.data = data;
+    reader.len = len;
+    reader.offset = 0;
+
+    switch(type)
+    {
+        case PCAT_CONTROLLER_CODEC_JSON:
+        {
+            if(len > G_MAXINT)
+            {
+                return NULL;
+            }
+
+            tokener = json_tokener_new();
+            root = json_tokener_parse_ex(tokener, (const gchar *)data, len);
+            json_tokener_free(tokener);
+
+            return root;
+        }
+        case PCAT_CONTROLLER_CODEC_MSGPACK:
+        {
+            ret = pcat_controller_codec_msgpack_value_read(&reader, 0,
+                &root);
+            break;
+        }
+        case PCAT_CONTROLLER_CODEC_CBOR:
+        {
+            ret = pcat_controller_codec_cbor_value_read(&reader, 0, &root);
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    if(!ret || reader.offset!=reader.len)
+    {
+        json_object_put(root);
+
+        return NULL;
+    }
+
+    return root;
+}
+
+const guint8 *pcat_controller_codec_payload_get(PCatControllerCodecType type,
+    GBytes *message, gsize *size)
+{
+    const guint8 *data;
+    gsize len;
+
+    data = g_bytes_get_data(message, &len);
+
+    if(type==PCAT_CONTROLLER_CODEC_JSON)
+    {
+        *size = len > 0 ? len - 1 : 0;
+
+        return data;
+    }
+
+    if(len < PCAT_CONTROLLER_CODEC_FRAME_HEADER_SIZE)
+    {
+        *size = 0;
+
+        return data;
+    }
+
+    *size = len - PCAT_CONTROLLER_CODEC_FRAME_HEADER_SIZE;
+
+    return data + PCAT_CONTROLLER_CODEC_FRAME_HEADER_SIZE;
+}
+
+static void pcat_controller_codec_json_string_append(GByteArray *buffer,
+    const gchar *str)
+{
+    const guint8 *p = (const guint8 *)str;
+    const guint8 *start = p;
+    guint8 escape[6] = {'\\', 'u', '0', '0', 0, 0};
+    static const gchar hex_digits[] = "0123456789abcdef";
+
+    pcat_controller_codec_code_append(buffer, '"');
+
+    for(;*p!='\0';p++)
+    {
+        if(*p >= 0x20 && *p!='"' && *p!='\\')
+        {
+            continue;
+        }
+
+        if(p > start)
+        {
+            g_byte_array_append(buffer, start, p - start);
+        }
+        start = p + 1;
+
+        switch(*p)
+        {
+            case '"':
+            case '\\':
+            {
+                escape[1] = *p;
+                g_byte_array_append(buffer, escape, 2);
+                break;
+            }
+            case '\n':
+            {
+                g_byte_array_append(buffer, (const guint8 *)"\\n", 2);
+                break;
+            }
+            case '\r':
+            {
+                g_byte_array_append(buffer, (const guint8 *)"\\r", 2);
+                break;
+            }
+            case '\t':
+            {
+                g_byte_array_append(buffer, (const guint8 *)"\\t", 2);
+                break;
+            }
+            default:
+            {
+                escape[1] = 'u';
+                escape[4] = hex_digits[*p >> 4];
+                escape[5] = hex_digits[*p & 0x0F];
+                g_byte_array_append(buffer, escape, 6);
+                break;
+            }
+        }
+    }
+
+    if(p > start)
+    {
+        g_byte_array_append(buffer, start, p - start);
+    }
+
+    pcat_controller_codec_code_append(buffer, '"');
+}
+
+static void pcat_controller_codec_writer_tree_add(
+    PCatControllerCodecWriter *writer, const gchar *key,
+    struct json_object *value)
+{
+    guint depth = writer->depth;
+
+    if(depth==0)
+    {
+        if(writer->root!=NULL)
+        {
+            json_object_put(writer->root);
+            writer->failed = TRUE;
+        }
+        writer->root = value;
+    }
+    else if(writer->is_map[depth-1])
+    {
+        if(key==NULL)
+        {
+            json_object_put(value);
+            writer->failed = TRUE;
+
+            return;
+        }
+
+        json_object_object_add(writer->container[depth-1], key, value);
+    }
+    else
+    {
+        json_object_array_add(writer->container[depth-1], value);
+    }
+}
+
+static gboolean pcat_controller_codec_writer_value_begin(
+    PCatControllerCodecWriter *writer, const gchar *key)
+{
+    GByteArray *buffer = writer->buffer;
+    guint depth = writer->depth;
+    gsize len;
+
+    if(writer->failed)
+    {
+        return FALSE;
+    }
+    if(depth==0)
+    {
+        return TRUE;
+    }
+
+    if(writer->is_map[depth-1] && key==NULL)
+    {
+        writer->failed = TRUE;
+
+        return FALSE;
+    }
+
+    if(writer->type==PCAT_CONTROLLER_CODEC_JSON)
+    {
+        if(writer->count[depth-1] > 0)
+        {
+            pcat_controller_codec_code_append(buffer, ',');
+        }
+        if(writer->is_map[depth-1])
+        {
+            pcat_controller_codec_json_string_append(buffer, key);
+            pcat_controller_codec_code_append(buffer, ':');
+        }
+    }
+    else if(writer->is_map[depth-1])
+    {
+        len = strlen(key);
+        if(writer->type==PCAT_CONTROLLER_CODEC_MSGPACK)
+        {
+            pcat_controller_codec_msgpack_length_append(buffer, 0xA0, 31,
+                0xD9, 0xDA, 0xDB, len);
+        }
+        else
+        {
+            pcat_controller_codec_cbor_head_append(buffer, 3, len);
+        }
+        g_byte_array_append(buffer, (const guint8 *)key, len);
+    }
+
+    writer->count[depth-1]++;
+
+    return TRUE;
+}
+
+static void pcat_controller_codec_writer_container_begin(
+    PCatControllerCodecWriter *writer, const gchar *key, gboolean is_map)
+{
+    struct json_object *container;
+    guint depth = writer->depth;
+
+    if(writer->failed)
+    {
+        return;
+    }
+    if(depth >= PCAT_CONTROLLER_CODEC_WRITER_DEPTH_MAX)
+    {
+        writer->failed = TRUE;
+
+        return;
+    }
+
+    if(writer->tree)
+    {
+        container = is_map ? json_object_new_object() :
+            json_object_new_array();
+        pcat_controller_codec_writer_tree_add(writer, key, container);
+        writer->container[depth] = container;
+    }
+    else
+    {
+        if(!pcat_controller_codec_writer_value_begin(writer, key))
+        {
+            return;
+        }
+
+        writer->header_offset[depth] = writer->buffer->len;
+        if(writer->type==PCAT_CONTROLLER_CODEC_JSON)
+        {
+            pcat_controller_codec_code_append(writer->buffer,
+                is_map ? '{' : '[');
+        }
+        else
+        {
+            /* The element count is unknown yet, reserve the longest
+             * header and shrink it when the container is closed. */
+            g_byte_array_set_size(writer->buffer, writer->buffer->len + 5);
+        }
+    }
+
+    writer->count[depth] = 0;
+    writer->is_map[depth] = is_map;
+    writer->depth++;
+}
+
+static void pcat_controller_codec_writer_container_end(
+    PCatControllerCodecWriter *writer, gboolean is_map)
+{
+    GByteArray *buffer = writer->buffer;
+    guint8 header[5];
+    guint header_len;
+    gsize offset;
+    guint count;
+    guint depth;
+
+    if(writer->failed)
+    {
+        return;
+    }
+    if(writer->depth==0 || writer->is_map[writer->depth-1]!=is_map)
+    {
+        writer->failed = TRUE;
+
+        return;
+    }
+
+    writer->depth--;
+    depth = writer->depth;
+
+    if(writer->tree)
+    {
+        writer->container[depth] = NULL;
+
+        return;
+    }
+    if(writer->type==PCAT_CONTROLLER_CODEC_JSON)
+    {
+        pcat_controller_codec_code_append(buffer, is_map ? '}' : ']');
+
+        return;
+    }
+
+    count = writer->count[depth];
+    if(writer->type==PCAT_CONTROLLER_CODEC_MSGPACK)
+    {
+        if(count <= 15)
+        {
+            header[0] = (is_map ? 0x80 : 0x90) | count;
+            header_len = 1;
+        }
+        else if(count <= G_MAXUINT16)
+        {
+            header[0] = is_map ? 0xDE : 0xDC;
+            header_len = 3;
+        }
+        else
+        {
+            header[0] = is_map ? 0xDF : 0xDD;
+            header_len = 5;
+        }
+    }
+    else
+    {
+        header[0] = (is_map ? 5 : 4) << 5;
+        if(count < 24)
+        {
+            header[0] |= count;
+            header_len = 1;
+        }
+        else if(count <= G_MAXUINT8)
+        {
+            header[0] |= 24;
+            header_len = 2;
+        }
+        else if(count <= G_MAXUINT16)
+        {
+            header[0] |= 25;
+            header_len = 3;
+        }
+        else
+        {
+            header[0] |= 26;
+            header_len = 5;
+        }
+    }
+    if(header_len==2)
+    {
+        header[1] = count & 0xFF;
+    }
+    else if(header_len==3)
+    {
+        header[1] = (count >> 8) & 0xFF;
+        header[2] = count & 0xFF;
+    }
+    else if(header_len==5)
+    {
+        header[1] = (count >> 24) & 0xFF;
+        header[2] = (count >> 16) & 0xFF;
+        header[3] = (count >> 8) & 0xFF;
+        header[4] = count & 0xFF;
+    }
+
+    offset = writer->header_offset[depth];
+    memcpy(buffer->data + offset, header, header_len);
+    if(header_len < 5)
+    {
+        memmove(buffer->data + offset + header_len,
+            buffer->data + offset + 5, buffer->len - offset - 5);
+        g_byte_array_set_size(buffer, buffer->len - (5 - header_len));
+    }
+}
+
+void pcat_controller_codec_writer_init(PCatControllerCodecWriter *writer,
+    PCatControllerCodecType type)
+{
+    memset(writer, 0, sizeof(PCatControllerCodecWriter));
+
+    writer->type = type;
+    writer->buffer = g_byte_array_sized_new(256);
+    if(type!=PCAT_CONTROLLER_CODEC_JSON)
+    {
+        g_byte_array_set_size(writer->buffer,
+            PCAT_CONTROLLER_CODEC_FRAME_HEADER_SIZE);
+    }
+}
+
+void pcat_controller_codec_writer_tree_init(
+    PCatControllerCodecWriter *writer, struct json_object *object)
+{
+    memset(writer, 0, sizeof(PCatControllerCodecWriter));
+
+    writer->type = PCAT_CONTROLLER_CODEC_JSON;
+    writer->tree = TRUE;
+
+    if(object!=NULL)
+    {
+        /* Append members to an existing object, the caller closes it
+         * with object_end() before finishing, or just clears. */
+        writer->root = json_object_get(object);
+        writer->container[0] = object;
+        writer->is_map[0] = TRUE;
+        writer->depth = 1;
+    }
+}
+
+void pcat_controller_codec_writer_clear(PCatControllerCodecWriter *writer)
+{
+    if(writer->buffer!=NULL)
+    {
+        g_byte_array_unref(writer->buffer);
+    }
+    if(writer->root!=NULL)
+    {
+        json_object_put(writer->root);
+    }
+
+    memset(writer, 0, sizeof(PCatControllerCodecWriter));
+}
+
+void pcat_controller_codec_writer_object_begin(
+    PCatControllerCodecWriter *writer, const gchar *key)
+{
+    pcat_controller_codec_writer_container_begin(writer, key, TRUE);
+}
+
+void pcat_controller_codec_writer_object_end(
+    PCatControllerCodecWriter *writer)
+{
+    pcat_controller_codec_writer_container_end(writer, TRUE);
+}
+
+void pcat_controller_codec_writer_array_begin(
+    PCatControllerCodecWriter *writer, const gchar *key)
+{
+    pcat_controller_codec_writer_container_begin(writer, key, FALSE);
+}
+
+void pcat_controller_codec_writer_array_end(
+    PCatControllerCodecWriter *writer)
+{
+    pcat_controller_codec_writer_container_end(writer, FALSE);
+}
+
+void pcat_controller_codec_writer_string(PCatControllerCodecWriter *writer,
+    const gchar *key, const gchar *value)
+{
+    gsize len;
+
+    if(value==NULL)
+    {
+        value = "";
+    }
+
+    if(writer->tree)
+    {
+        if(!writer->failed)
+        {
+            pcat_controller_codec_writer_tree_add(writer, key,
+                json_object_new_string(value));
+        }
+
+        return;
+    }
+    if(!pcat_controller_codec_writer_value_begin(writer, key))
+    {
+        return;
+    }
+
+    switch(writer->type)
+    {
+        case PCAT_CONTROLLER_CODEC_JSON:
+        {
+            pcat_controller_codec_json_string_append(writer->buffer, value);
+            break;
+        }
+        case PCAT_CONTROLLER_CODEC_MSGPACK:
+        {
+            len = strlen(value);
+            pcat_controller_codec_msgpack_length_append(writer->buffer,
+                0xA0, 31, 0xD9, 0xDA, 0xDB, len);
+            g_byte_array_append(writer->buffer, (const guint8 *)value, len);
+            break;
+        }
+        default:
+        {
+            len = strlen(value);
+            pcat_controller_codec_cbor_head_append(writer->buffer, 3, len);
+            g_byte_array_append(writer->buffer, (const guint8 *)value, len);
+            break;
+        }
+    }
+}
+
+void pcat_controller_codec_writer_int(PCatControllerCodecWriter *writer,
+    const gchar *key, gint64 value)
+{
+    gchar number[24];
+    gint len;
+
+    if(writer->tree)
+    {
+        if(!writer->failed)
+        {
+            pcat_controller_codec_writer_tree_add(writer, key,
+                json_object_new_int64(value));
+        }
+
+        return;
+    }
+    if(!pcat_controller_codec_writer_value_begin(writer, key))
+    {
+        return;
+    }
+
+    switch(writer->type)
+    {
+        case PCAT_CONTROLLER_CODEC_JSON:
+        {
+            len = g_snprintf(number, sizeof(number), "%"G_GINT64_FORMAT,
+                value);
+            g_byte_array_append(writer->buffer, (const guint8 *)number,
+                len);
+            break;
+        }
+        case PCAT_CONTROLLER_CODEC_MSGPACK:
+        {
+            pcat_controller_codec_msgpack_int_append(writer->buffer, value);
+            break;
+        }
+        default:
+        {
+            if(value >= 0)
+            {
+                pcat_controller_codec_cbor_head_append(writer->buffer, 0,
+                    value);
+            }
+            else
+            {
+                pcat_controller_codec_cbor_head_append(writer->buffer, 1,
+                    (guint64)(-1 - value));
+            }
+            break;
+        }
+    }
+}
+
+void pcat_controller_codec_writer_double(PCatControllerCodecWriter *writer,
+    const gchar *key, gdouble value)
+{
+    gchar number[G_ASCII_DTOSTR_BUF_SIZE];
+
+    if(writer->tree)
+    {
+        if(!writer->failed)
+        {
+            pcat_controller_codec_writer_tree_add(writer, key,
+                json_object_new_double(value));
+        }
+
+        return;
+    }
+    if(!pcat_controller_codec_writer_value_begin(writer, key))
+    {
+        return;
+    }
+
+    switch(writer->type)
+    {
+        case PCAT_CONTROLLER_CODEC_JSON:
+        {
+            g_ascii_dtostr(number, G_ASCII_DTOSTR_BUF_SIZE, value);
+            g_byte_array_append(writer->buffer, (const guint8 *)number,
+                strlen(number));
+            break;
+        }
+        case PCAT_CONTROLLER_CODEC_MSGPACK:
+        {
+            pcat_controller_codec_code_append(writer->buffer, 0xCB);
+            pcat_controller_codec_be_append(writer->buffer,
+                pcat_controller_codec_double_to_bits(value), 8);
+            break;
+        }
+        default:
+        {
+            pcat_controller_codec_code_append(writer->buffer, 0xFB);
+            pcat_controller_codec_be_append(writer->buffer,
+                pcat_controller_codec_double_to_bits(value), 8);
+            break;
+        }
+    }
+}
+
+void pcat_controller_codec_writer_boolean(PCatControllerCodecWriter *writer,
+    const gchar *key, gboolean value)
+{
+    if(writer->tree)
+    {
+        if(!writer->failed)
+        {
+            pcat_controller_codec_writer_tree_add(writer, key,
+                json_object_new_boolean(value));
+        }
+
+        return;
+    }
+    if(!pcat_controller_codec_writer_value_begin(writer, key))
+    {
+        return;
+    }
+
+    switch(writer->type)
+    {
+        case PCAT_CONTROLLER_CODEC_JSON:
+        {
+            if(value)
+            {
+                g_byte_array_append(writer->buffer, (const guint8 *)"true",
+                    4);
+            }
+            else
+            {
+                g_byte_array_append(writer->buffer, (const guint8 *)"false",
+                    5);
+            }
+            break;
+        }
+        case PCAT_CONTROLLER_CODEC_MSGPACK:
+        {
+            pcat_controller_codec_code_append(writer->buffer,
+                value ? 0xC3 : 0xC2);
+            break;
+        }
+        default:
+        {
+            pcat_controller_codec_code_append(writer->buffer,
+                value ? 0xF5 : 0xF4);
+            break;
+        }
+    }
+}
+
+void pcat_controller_codec_writer_json(PCatControllerCodecWriter *writer,
+    const gchar *key, struct json_object *value)
+{
+    const gchar *json_data;
+    gboolean ret = TRUE;
+
+    if(writer->tree)
+    {
+        if(!writer->failed)
+        {
+            pcat_controller_codec_writer_tree_add(writer, key,
+                json_object_get(value));
+        }
+
+        return;
+    }
+    if(!pcat_controller_codec_writer_value_begin(writer, key))
+    {
+        return;
+    }
+
+    switch(writer->type)
+    {
+        case PCAT_CONTROLLER_CODEC_JSON:
+        {
+            json_data = value!=NULL ? json_object_to_json_string_ext(value,
+                JSON_C_TO_STRING_PLAIN) : "null";
+            g_byte_array_append(writer->buffer, (const guint8 *)json_data,
+                strlen(json_data));
+            break;
+        }
+        case PCAT_CONTROLLER_CODEC_MSGPACK:
+        {
+            ret = pcat_controller_codec_msgpack_value_append(writer->buffer,
+                value, writer->depth);
+            break;
+        }
+        default:
+        {
+            ret = pcat_controller_codec_cbor_value_append(writer->buffer,
+                value, writer->depth);
+            break;
+        }
+    }
+
+    if(!ret)
+    {
+        writer->failed = TRUE;
+    }
+}
+
+static gboolean pcat_controller_codec_map_head_read(
+    PCatControllerCodecType type, const guint8 *data, gsize len,
+    guint64 *count, gsize *head_len)
+{
+    PCatControllerCodecReader reader;
+    guint64 value;
+    guint8 code;
+
+    reader.data = data;
+    reader.len = len;
+    reader.offset = 1;
+
+    if(len==0)
+    {
+        return FALSE;
+    }
+    code = data[0];
+
+    if(type==PCAT_CONTROLLER_CODEC_MSGPACK)
+    {
+        if((code & 0xF0)==0x80)
+        {
+            value = code & 0x0F;
+        }
+        else if(code==0xDE)
+        {
+            if(!pcat_controller_codec_be_read(&reader, 2, &value))
+            {
+                return FALSE;
+            }
+        }
+        else if(code==0xDF)
+        {
+            if(!pcat_controller_codec_be_read(&reader, 4, &value))
+            {
+                return FALSE;
+            }
+        }
+        else
+        {
+            return FALSE;
+        }
+    }
+    else
+    {
+        if((code >> 5)!=5)
+        {
+            return FALSE;
+        }
+
+        value = code & 0x1F;
+        if(value >= 24 && value <= 27)
+        {
+            if(!pcat_controller_codec_be_read(&reader, 1U << (value - 24),
+                &value))
+            {
+                return FALSE;
+            }
+        }
+        else if(value > 27)
+        {
+            return FALSE;
+        }
+    }
+
+    *count = value;
+    *head_len = reader.offset;
+
+    return TRUE;
+}
+
+void pcat_controller_codec_writer_object_merge(
+    PCatControllerCodecWriter *writer, GBytes *message)
+{
+    const guint8 *data, *start, *end;
+    guint64 count;
+    gsize size, head_len;
+    guint depth = writer->depth;
+
+    if(writer->failed || writer->tree)
+    {
+        return;
+    }
+    if(depth==0 || !writer->is_map[depth-1] || message==NULL)
+    {
+        writer->failed = TRUE;
+
+        return;
+    }
+
+    data = pcat_controller_codec_payload_get(writer->type, message, &size);
+
+    if(writer->type==PCAT_CONTROLLER_CODEC_JSON)
+    {
+        start = memchr(data, '{', size);
+        end = data + size;
+        while(end > data && *(end-1)!='}')
+        {
+            end--;
+        }
+        if(start==NULL || end <= start)
+        {
+            writer->failed = TRUE;
+
+            return;
+        }
+
+        for(start++, end--;start < end && g_ascii_isspace(*start);start++);
+        for(;end > start && g_ascii_isspace(*(end-1));end--);
+        if(start==end)
+        {
+            return;
+        }
+
+        if(writer->count[depth-1] > 0)
+        {
+            pcat_controller_codec_code_append(writer->buffer, ',');
+        }
+        g_byte_array_append(writer->buffer, start, end - start);
+        writer->count[depth-1]++;
+
+        return;
+    }
+
+    if(!pcat_controller_codec_map_head_read(writer->type, data, size,
+        &count, &head_len) || count > G_MAXUINT - writer->count[depth-1])
+    {
+        writer->failed = TRUE;
+
+        return;
+    }
+
+    g_byte_array_append(writer->buffer, data + head_len, size - head_len);
+    writer->count[depth-1] += count;
+}
+
+GBytes *pcat_controller_codec_writer_finish(
+    PCatControllerCodecWriter *writer)
+{
+    GByteArray *buffer = writer->buffer;
+    GBytes *message;
+    gsize len;
+
+    if(buffer==NULL || writer->tree || writer->failed || writer->depth > 0)
+    {
+        pcat_controller_codec_writer_clear(writer);
+
+        return NULL;
+    }
+
+    if(writer->type==PCAT_CONTROLLER_CODEC_JSON)
+    {
+        pcat_controller_codec_code_append(buffer, '\0');
+    }
+    else
+    {
+        len = buffer->len - PCAT_CONTROLLER_CODEC_FRAME_HEADER_SIZE;
+        buffer->data[0] = (len >> 24) & 0xFF;
+        buffer->data[1] = (len >> 16) & 0xFF;
+        buffer->data[2] = (len >> 8) & 0xFF;
+        buffer->data[3] = len & 0xFF;
+    }
+
+    writer->buffer = NULL;
+    message = g_byte_array_free_to_bytes(buffer);
+    pcat_controller_codec_writer_clear(writer);
+
+    return message;
+}
+
+struct json_object *pcat_controller_codec_writer_tree_finish(
+    PCatControllerCodecWriter *writer)
+{
+    struct json_object *root = NULL;
+
+    if(writer->tree && !writer->failed && writer->depth==0)
+    {
+        root = writer->root;
+        writer->root = NULL;
+    }
+
+    pcat_controller_codec_writer_clear(writer);
+
+    return root;
+}
@@ -0,0 +1,77 @@
+#ifndef HAVE_PCAT_CONTROLLER_CODEC_H
+#define HAVE_PCAT_CONTROLLER_CODEC_H
+
+#include <glib.h>
+#include <json.h>
+
+G_BEGIN_DECLS
+
+#define PCAT_CONTROLLER_CODEC_FRAME_HEADER_SIZE 4
+#define PCAT_CONTROLLER_CODEC_WRITER_DEPTH_MAX 16
+
+typedef enum
+{
+    PCAT_CONTROLLER_CODEC_JSON = 0,
+    PCAT_CONTROLLER_CODEC_MSGPACK,
+    PCAT_CONTROLLER_CODEC_CBOR,
+    PCAT_CONTROLLER_CODEC_LAST
+}PCatControllerCodecType;
+
+typedef struct _PCatControllerCodecWriter
+{
+    PCatControllerCodecType type;
+    gboolean tree;
+    gboolean failed;
+    GByteArray *buffer;
+    struct json_object *root;
+    guint depth;
+    struct json_object *container[PCAT_CONTROLLER_CODEC_WRITER_DEPTH_MAX];
+    gsize header_offset[PCAT_CONTROLLER_CODEC_WRITER_DEPTH_MAX];
+    guint count[PCAT_CONTROLLER_CODEC_WRITER_DEPTH_MAX];
+    gboolean is_map[PCAT_CONTROLLER_CODEC_WRITER_DEPTH_MAX];
+}PCatControllerCodecWriter;
+
+const gchar *pcat_controller_codec_name_get(PCatControllerCodecType type);
+gboolean pcat_controller_codec_name_parse(const gchar *name,
+    PCatControllerCodecType *type);
+GBytes *pcat_controller_codec_encode(PCatControllerCodecType type,
+    struct json_object *root);
+struct json_object *pcat_controller_codec_decode(
+    PCatControllerCodecType type, const guint8 *data, gsize len);
+const guint8 *pcat_controller_codec_payload_get(PCatControllerCodecType type,
+    GBytes *message, gsize *size);
+
+void pcat_controller_codec_writer_init(PCatControllerCodecWriter *writer,
+    PCatControllerCodecType type);
+void pcat_controller_codec_writer_tree_init(
+    PCatControllerCodecWriter *writer, struct json_object *object);
+void pcat_controller_codec_writer_clear(PCatControllerCodecWriter *writer);
+void pcat_controller_codec_writer_object_begin(
+    PCatControllerCodecWriter *writer, const gchar *key);
+void pcat_controller_codec_writer_object_end(
+    PCatControllerCodecWriter *writer);
+void pcat_controller_codec_writer_array_begin(
+    PCatControllerCodecWriter *writer, const gchar *key);
+void pcat_controller_codec_writer_array_end(
+    PCatControllerCodecWriter *writer);
+void pcat_controller_codec_writer_string(PCatControllerCodecWriter *writer,
+    const gchar *key, const gchar *value);
+void pcat_controller_codec_writer_int(PCatControllerCodecWriter *writer,
+    const gchar *key, gint64 value);
+void pcat_controller_codec_writer_double(PCatControllerCodecWriter *writer,
+    const gchar *key, gdouble value);
+void pcat_controller_codec_writer_boolean(PCatControllerCodecWriter *writer,
+    const gchar *key, gboolean value);
+void pcat_controller_codec_writer_json(PCatControllerCodecWriter *writer,
+    const gchar *key, struct json_object *value);
+void pcat_controller_codec_writer_object_merge(
+    PCatControllerCodecWriter *writer, GBytes *message);
+GBytes *pcat_controller_codec_writer_finish(
+    PCatControllerCodecWriter *writer);
+struct json_object *pcat_controller_codec_writer_tree_finish(
+    PCatControllerCodecWriter *writer);
+
+G_END_DECLS
+
+#endif
+
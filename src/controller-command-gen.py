@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+#
+# Generate the controller command registry header from
+# controller-commands.def: command IDs, per-command metadata and an
+# allocation-free lookup which switches on the command length and then
+# on a character position which tells the remaining candidates apart.
+
+import sys
+
+RATE_CLASSES = ['control', 'read', 'write']
+FLAGS = ['write', 'no-batch']
+
+
+def c_name(name):
+    return name.upper().replace('-', '_')
+
+
+def parse(path):
+    commands = []
+
+    with open(path, 'r') as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.split('#', 1)[0].strip()
+            if not line:
+                continue
+
+            fields = line.split()
+            if len(fields) < 2 or len(fields) > 3:
+                sys.exit('%s:%d: expected "command rate-class [flags]"' %
+                    (path, lineno))
+
+            name, rate_class = fields[0], fields[1]
+            flags = fields[2].split(',') if len(fields) > 2 else []
+
+            if rate_class not in RATE_CLASSES:
+                sys.exit('%s:%d: unknown rate class %s' %
+                    (path, lineno, rate_class))
+            for flag in flags:
+                if flag not in FLAGS:
+                    sys.exit('%s:%d: unknown flag %s' % (path, lineno, flag))
+            if any(c[0]==name for c in commands):
+                sys.exit('%s:%d: duplicated command %s' %
+                    (path, lineno, name))
+
+            commands.append((name, rate_class, flags))
+
+    return commands
+
+
+def distinct_position(names):
+    for i in range(len(names[0])):
+        if len(set(n[i] for n in names))==len(names):
+            return i
+
+    return None
+
+
+def emit_compare(out, indent, index, name):
+    out.append('%sif(memcmp(command, "%s", %d)==0)' %
+        (indent, name, len(name)))
+    out.append('%s{' % indent)
+    out.append('%s    return PCAT_CONTROLLER_COMMAND_%s;' %
+        (indent, c_name(name)))
+    out.append('%s}' % indent)
+
+
+def emit_lookup(out, commands):
+    groups = {}
+    for index, (name, _, _) in enumerate(commands):
+        groups.setdefault(len(name), []).append((index, name))
+
+    out.append('static inline gint pcat_controller_command_lookup(')
+    out.append('    const gchar *command, gsize length)')
+    out.append('{')
+    out.append('    switch(length)')
+    out.append('    {')
+
+    for length in sorted(groups):
+        group = groups[length]
+        out.append('        case %d:' % length)
+        out.append('        {')
+
+        position = None
+        if len(group) > 1:
+            position = distinct_position([n for _, n in group])
+
+        if position is None:
+            for index, name in group:
+                emit_compare(out, ' ' * 12, index, name)
+        else:
+            out.append('            switch(command[%d])' % position)
+            out.append('            {')
+            for index, name in group:
+                out.append("                case '%s':" % name[position])
+                out.append('                {')
+                emit_compare(out, ' ' * 20, index, name)
+                out.append('')
+                out.append('                    break;')
+                out.append('                }')
+            out.append('                default:')
+            out.append('                {')
+            out.append('                    break;')
+            out.append('                }')
+            out.append('            }')
+
+        out.append('')
+        out.append('            break;')
+        out.append('        }')
+
+    out.append('        default:')
+    out.append('        {')
+    out.append('            break;')
+    out.append('        }')
+    out.append('    }')
+    out.append('')
+    out.append('    return -1;')
+    out.append('}')
+
+
+def generate(commands):
+    out = []
+
+    out.append('/* Generated by controller-command-gen.py, do not edit. */')
+    out.append('')
+    out.append('#ifndef HAVE_PCAT_CONTROLLER_COMMAND_REGISTRY_H')
+    out.append('#define HAVE_PCAT_CONTROLLER_COMMAND_REGISTRY_H')
+    out.append('')
+    out.append('#include <string.h>')
+    out.append('#include <glib.h>')
+    out.append('')
+    out.append('G_BEGIN_DECLS')
+    out.append('')
+
+    for i, flag in enumerate(FLAGS):
+        out.append('#define PCAT_CONTROLLER_COMMAND_FLAG_%s (1U << %d)' %
+            (c_name(flag), i))
+    out.append('')
+
+    out.append('typedef enum')
+    out.append('{')
+    for i, rate_class in enumerate(RATE_CLASSES):
+        out.append('    PCAT_CONTROLLER_COMMAND_RATE_CLASS_%s%s,' %
+            (c_name(rate_class), ' = 0' if i==0 else ''))
+    out.append('    PCAT_CONTROLLER_COMMAND_RATE_CLASS_LAST')
+    out.append('}PCatControllerCommandRateClass;')
+    out.append('')
+
+    out.append('typedef enum')
+    out.append('{')
+    for i, (name, _, _) in enumerate(commands):
+        out.append('    PCAT_CONTROLLER_COMMAND_%s%s,' %
+            (c_name(name), ' = 0' if i==0 else ''))
+    out.append('    PCAT_CONTROLLER_COMMAND_LAST')
+    out.append('}PCatControllerCommandType;')
+    out.append('')
+
+    out.append('typedef struct _PCatControllerCommandInfo')
+    out.append('{')
+    out.append('    const gchar *command;')
+    out.append('    PCatControllerCommandRateClass rate_class;')
+    out.append('    guint flags;')
+    out.append('}PCatControllerCommandInfo;')
+    out.append('')
+
+    out.append('static const PCatControllerCommandInfo')
+    out.append('    g_pcat_controller_command_info_list[')
+    out.append('    PCAT_CONTROLLER_COMMAND_LAST] =')
+    out.append('{')
+    for name, rate_class, flags in commands:
+        flag_str = ' | '.join('PCAT_CONTROLLER_COMMAND_FLAG_%s' % c_name(f)
+            for f in flags) if flags else '0'
+        out.append('    [PCAT_CONTROLLER_COMMAND_%s] =' % c_name(name))
+        out.append('    {')
+        out.append('        .command = "%s",' % name)
+        out.append('        .rate_class = '
+            'PCAT_CONTROLLER_COMMAND_RATE_CLASS_%s,' % c_name(rate_class))
+        out.append('        .flags = %s' % flag_str)
+        out.append('    },')
+    out.append('};')
+    out.append('')
+
+    emit_lookup(out, commands)
+    out.append('')
+
+    out.append('G_END_DECLS')
+    out.append('')
+    out.append('#endif')
+    out.append('')
+
+    return '\n'.join(out) + '\n'
+
+
+def main():
+    if len(sys.argv)!=3:
+        sys.exit('Usage: %s <input> <output>' % sys.argv[0])
+
+    data = generate(parse(sys.argv[1]))
+
+    with open(sys.argv[2], 'w') as f:
+        f.write(data)
+
+
+if __name__=='__main__':
+    main()
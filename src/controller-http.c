@@ -0,0 +1,608 @@
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <gio/gio.h>
+#include "controller-http.h"
+
+#define PCAT_CONTROLLER_HTTP_REQUEST_SIZE_MAX 8192
+#define PCAT_CONTROLLER_HTTP_OUTPUT_QUEUE_MAX 64
+#define PCAT_CONTROLLER_HTTP_OUTPUT_VECTOR_MAX 16
+
+typedef struct _PCatControllerHttpConnectionData
+{
+    PCatControllerHttpServer *server;
+    GSocketConnection *connection;
+    GInputStream *input_stream;
+    GOutputStream *output_stream;
+    GSource *input_stream_source;
+    GSource *output_stream_source;
+    GSource *deadline_source;
+    guint8 input_buffer[PCAT_CONTROLLER_HTTP_REQUEST_SIZE_MAX];
+    gsize input_size;
+    gint64 input_timestamp;
+    GQueue *output_queue;
+    gsize output_head_offset;
+    gboolean output_close;
+}PCatControllerHttpConnectionData;
+
+struct _PCatControllerHttpServer
+{
+    GMainContext *context;
+    GSocketService *service;
+    GHashTable *connection_table;
+    guint connection_max;
+    gint64 idle_timeout;
+    PCatControllerHttpHandler handler;
+    gpointer user_data;
+};
+
+static gboolean pcat_controller_http_input_watch_func(GObject *stream,
+    gpointer user_data);
+static gboolean pcat_controller_http_output_watch_func(GObject *stream,
+    gpointer user_data);
+
+static void pcat_controller_http_source_clear(GSource **source)
+{
+    if(*source!=NULL)
+    {
+        g_source_destroy(*source);
+        g_source_unref(*source);
+        *source = NULL;
+    }
+}
+
+static void pcat_controller_http_connection_data_free(
+    PCatControllerHttpConnectionData *data)
+{
+    if(data==NULL)
+    {
+        return;
+    }
+
+    pcat_controller_http_source_clear(&(data->deadline_source));
+    pcat_controller_http_source_clear(&(data->output_stream_source));
+    pcat_controller_http_source_clear(&(data->input_stream_source));
+
+    g_queue_free_full(data->output_queue, (GDestroyNotify)g_bytes_unref);
+
+    g_io_stream_close(G_IO_STREAM(data->connection), NULL, NULL);
+    g_object_unref(data->connection);
+
+    g_free(data);
+}
+
+static void pcat_controller_http_connection_close(
+    PCatControllerHttpConnectionData *data)
+{
+    g_hash_table_remove(data->server->connection_table, data->connection);
+}
+
+static void pcat_controller_http_input_source_ensure(
+    PCatControllerHttpConnectionData *data)
+{
+    /* Reading pauses while the client has not taken its responses. */
+    if(data->input_stream_source!=NULL || data->output_close ||
+       g_queue_get_length(data->output_queue) >=
+       PCAT_CONTROLLER_HTTP_OUTPUT_QUEUE_MAX)
+    {
+        return;
+    }
+
+    data->input_stream_source = g_pollable_input_stream_create_source(
+        G_POLLABLE_INPUT_STREAM(data->input_stream), NULL);
+    g_source_set_callback(data->input_stream_source,
+        (GSourceFunc)pcat_controller_http_input_watch_func, data, NULL);
+    g_source_attach(data->input_stream_source, data->server->context);
+}
+
+static void pcat_controller_http_output_source_ensure(
+    PCatControllerHttpConnectionData *data)
+{
+    if(data->output_stream_source!=NULL ||
+       g_queue_is_empty(data->output_queue))
+    {
+        return;
+    }
+
+    data->output_stream_source = g_pollable_output_stream_create_source(
+        G_POLLABLE_OUTPUT_STREAM(data->output_stream), NULL);
+    g_source_set_callback(data->output_stream_source,
+        (GSourceFunc)pcat_controller_http_output_watch_func, data, NULL);
+    g_source_attach(data->output_stream_source, data->server->context);
+}
+
+static void pcat_controller_http_response_push(
+    PCatControllerHttpConnectionData *data, guint status,
+    const gchar *reason, const gchar *content_type, GBytes *body,
+    gboolean head_only, gboolean keep_alive)
+{
+    gchar *header;
+
+    header = g_strdup_printf("HTTP/1.1 %u %s\r\n"
+        "Content-Type: %s\r\n"
+        "Content-Length: %" G_GSIZE_FORMAT "\r\n"
+        "Connection: %s\r\n"
+        "\r\n", status, reason, content_type,
+        body!=NULL ? g_bytes_get_size(body) : 0,
+        keep_alive ? "keep-alive" : "close");
+    g_queue_push_tail(data->output_queue,
+        g_bytes_new_take(header, strlen(header)));
+
+    /* Bodies are shared with the controller caches, never copied. */
+    if(body!=NULL && g_bytes_get_size(body) > 0 && !head_only)
+    {
+        g_queue_push_tail(data->output_queue, g_bytes_ref(body));
+    }
+
+    if(!keep_alive)
+    {
+        data->output_close = TRUE;
+    }
+}
+
+static void pcat_controller_http_error_push(
+    PCatControllerHttpConnectionData *data, guint status,
+    const gchar *reason, gboolean head_only, gboolean keep_alive)
+{
+    GBytes *body;
+    gchar *text;
+
+    text = g_strdup_printf("%s\n", reason);
+    body = g_bytes_new_take(text, strlen(text));
+    pcat_controller_http_response_push(data, status, reason,
+        "text/plain; charset=utf-8", body, head_only, keep_alive);
+    g_bytes_unref(body);
+}
+
+static void pcat_controller_http_request_handle(
+    PCatControllerHttpConnectionData *data, gchar *request)
+{
+    PCatControllerHttpServer *server = data->server;
+    gchar *line, *next, *method, *target, *version, *value;
+    const gchar *content_type = "application/octet-stream";
+    gboolean keep_alive, head_only, has_body = FALSE;
+    GBytes *body;
+
+    next = strstr(request, "\r\n");
+    if(next!=NULL)
+    {
+        *next = '\0';
+        next += 2;
+    }
+
+    method = request;
+    target = strchr(method, ' ');
+    version = (target!=NULL) ? strchr(target + 1, ' ') : NULL;
+    if(version==NULL)
+    {
+        pcat_controller_http_error_push(data, 400, "Bad Request", FALSE,
+            FALSE);
+
+        return;
+    }
+    *target = '\0';
+    target++;
+    *version = '\0';
+    version++;
+
+    if(strcmp(version, "HTTP/1.1")==0)
+    {
+        keep_alive = TRUE;
+    }
+    else if(strcmp(version, "HTTP/1.0")==0)
+    {
+        keep_alive = FALSE;
+    }
+    else
+    {
+        pcat_controller_http_error_push(data, 505,
+            "HTTP Version Not Supported", FALSE, FALSE);
+
+        return;
+    }
+
+    for(line=next;line!=NULL && *line!='\0';line=next)
+    {
+        next = strstr(line, "\r\n");
+        if(next!=NULL)
+        {
+            *next = '\0';
+            next += 2;
+        }
+
+        value = strchr(line, ':');
+        if(value==NULL)
+        {
+            continue;
+        }
+        *value = '\0';
+        value = g_strstrip(value + 1);
+
+        if(g_ascii_strcasecmp(line, "Connection")==0)
+        {
+            if(g_ascii_strcasecmp(value, "close")==0)
+            {
+                keep_alive = FALSE;
+            }
+            else if(g_ascii_strcasecmp(value, "keep-alive")==0)
+            {
+                keep_alive = TRUE;
+            }
+        }
+        else if(g_ascii_strcasecmp(line, "Transfer-Encoding")==0 ||
+            (g_ascii_strcasecmp(line, "Content-Length")==0 &&
+            strcmp(value, "0")!=0))
+        {
+            has_body = TRUE;
+        }
+    }
+
+    /* Request bodies are never read, so the stream can not be trusted
+     * beyond such a request. */
+    if(has_body)
+    {
+        pcat_controller_http_error_push(data, 400, "Bad Request", FALSE,
+            FALSE);
+
+        return;
+    }
+
+    head_only = (strcmp(method, "HEAD")==0);
+    if(!head_only && strcmp(method, "GET")!=0)
+    {
+        pcat_controller_http_error_push(data, 405, "Method Not Allowed",
+            FALSE, keep_alive);
+
+        return;
+    }
+
+    value = strchr(target, '?');
+    if(value!=NULL)
+    {
+        *value = '\0';
+    }
+
+    body = server->handler(target, &content_type, server->user_data);
+    if(body==NULL)
+    {
+        pcat_controller_http_error_push(data, 404, "Not Found", head_only,
+            keep_alive);
+
+        return;
+    }
+
+    pcat_controller_http_response_push(data, 200, "OK", content_type, body,
+        head_only, keep_alive);
+    g_bytes_unref(body);
+}
+
+static void pcat_controller_http_input_parse(
+    PCatControllerHttpConnectionData *data)
+{
+    gsize i, used_size;
+    gboolean found;
+
+    while(!data->output_close && g_queue_get_length(data->output_queue) <
+        PCAT_CONTROLLER_HTTP_OUTPUT_QUEUE_MAX)
+    {
+        found = FALSE;
+        for(i=0;i+3<data->input_size;i++)
+        {
+            if(memcmp(data->input_buffer + i, "\r\n\r\n", 4)==0)
+            {
+                found = TRUE;
+                break;
+            }
+        }
+
+        if(!found)
+        {
+            if(data->input_size==PCAT_CONTROLLER_HTTP_REQUEST_SIZE_MAX)
+            {
+                pcat_controller_http_error_push(data, 431,
+                    "Request Header Fields Too Large", FALSE, FALSE);
+            }
+
+            break;
+        }
+
+        data->input_buffer[i] = '\0';
+        pcat_controller_http_request_handle(data,
+            (gchar *)data->input_buffer);
+
+        used_size = i + 4;
+        memmove(data->input_buffer, data->input_buffer + used_size,
+            data->input_size - used_size);
+        data->input_size -= used_size;
+    }
+}
+
+static gboolean pcat_controller_http_input_watch_func(GObject *stream,
+    gpointer user_data)
+{
+    PCatControllerHttpConnectionData *data =
+        (PCatControllerHttpConnectionData *)user_data;
+    gssize rsize;
+    GError *error = NULL;
+
+    rsize = g_pollable_input_stream_read_nonblocking(
+        G_POLLABLE_INPUT_STREAM(stream), data->input_buffer +
+        data->input_size, PCAT_CONTROLLER_HTTP_REQUEST_SIZE_MAX -
+        data->input_size, NULL, &error);
+    if(rsize > 0)
+    {
+        data->input_timestamp = g_get_monotonic_time();
+        data->input_size += rsize;
+
+        pcat_controller_http_input_parse(data);
+        pcat_controller_http_output_source_ensure(data);
+
+        if(data->output_close || g_queue_get_length(data->output_queue) >=
+           PCAT_CONTROLLER_HTTP_OUTPUT_QUEUE_MAX)
+        {
+            pcat_controller_http_source_clear(&(data->input_stream_source));
+
+            return FALSE;
+        }
+
+        return TRUE;
+    }
+
+    if(error!=NULL && g_error_matches(error, G_IO_ERROR,
+        G_IO_ERROR_WOULD_BLOCK))
+    {
+        g_clear_error(&error);
+
+        return TRUE;
+    }
+
+    if(error!=NULL)
+    {
+        g_debug("HTTP connection broke with error %s.", error->message);
+        g_clear_error(&error);
+    }
+
+    pcat_controller_http_connection_close(data);
+
+    return FALSE;
+}
+
+static gboolean pcat_controller_http_output_watch_func(GObject *stream,
+    gpointer user_data)
+{
+    PCatControllerHttpConnectionData *data =
+        (PCatControllerHttpConnectionData *)user_data;
+    GOutputVector vectors[PCAT_CONTROLLER_HTTP_OUTPUT_VECTOR_MAX];
+    gsize vector_count;
+    gsize written_size;
+    gsize message_size;
+    GList *node;
+    GBytes *message;
+    GPollableReturn pret;
+    GError *error = NULL;
+
+    while(!g_queue_is_empty(data->output_queue))
+    {
+        vector_count = 0;
+        for(node=g_queue_peek_head_link(data->output_queue);
+            node!=NULL &&
+            vector_count < PCAT_CONTROLLER_HTTP_OUTPUT_VECTOR_MAX;
+            node=g_list_next(node))
+        {
+            vectors[vector_count].buffer = g_bytes_get_data(node->data,
+                &message_size);
+            vectors[vector_count].size = message_size;
+            if(vector_count==0)
+            {
+                vectors[0].buffer = (const guint8 *)vectors[0].buffer +
+                    data->output_head_offset;
+                vectors[0].size -= data->output_head_offset;
+            }
+            vector_count++;
+        }
+
+        written_size = 0;
+        pret = g_pollable_output_stream_writev_nonblocking(
+            G_POLLABLE_OUTPUT_STREAM(stream), vectors, vector_count,
+            &written_size, NULL, &error);
+        if(pret==G_POLLABLE_RETURN_WOULD_BLOCK)
+        {
+            return TRUE;
+        }
+        if(pret!=G_POLLABLE_RETURN_OK)
+        {
+            g_debug("HTTP connection broke with error %s.",
+                error!=NULL ? error->message : "Unknown");
+            g_clear_error(&error);
+
+            pcat_controller_http_connection_close(data);
+
+            return FALSE;
+        }
+
+        written_size += data->output_head_offset;
+        while((message=g_queue_peek_head(data->output_queue))!=NULL)
+        {
+            message_size = g_bytes_get_size(message);
+            if(written_size < message_size)
+            {
+                break;
+            }
+
+            written_size -= message_size;
+            g_queue_pop_head(data->output_queue);
+            g_bytes_unref(message);
+        }
+        data->output_head_offset = written_size;
+    }
+
+    if(data->output_close)
+    {
+        pcat_controller_http_connection_close(data);
+
+        return FALSE;
+    }
+
+    pcat_controller_http_source_clear(&(data->output_stream_source));
+
+    /* Pipelined requests may still wait in the input buffer. */
+    pcat_controller_http_input_parse(data);
+    pcat_controller_http_output_source_ensure(data);
+    pcat_controller_http_input_source_ensure(data);
+
+    return FALSE;
+}
+
+static gboolean pcat_controller_http_deadline_func(gpointer user_data)
+{
+    PCatControllerHttpConnectionData *data =
+        (PCatControllerHttpConnectionData *)user_data;
+    gint64 deadline;
+
+    deadline = data->input_timestamp + data->server->idle_timeout;
+    if(g_get_monotonic_time() < deadline)
+    {
+        g_source_set_ready_time(data->deadline_source, deadline);
+
+        return TRUE;
+    }
+
+    g_debug("HTTP client is idle, close connection.");
+    pcat_controller_http_connection_close(data);
+
+    return FALSE;
+}
+
+static gboolean pcat_controller_http_deadline_source_dispatch(
+    GSource *source, GSourceFunc callback, gpointer user_data)
+{
+    return callback(user_data);
+}
+
+static GSourceFuncs g_pcat_controller_http_deadline_source_funcs =
+{
+    NULL,
+    NULL,
+    pcat_controller_http_deadline_source_dispatch,
+    NULL
+};
+
+static gboolean pcat_controller_http_incoming_func(GSocketService *service,
+    GSocketConnection *connection, GObject *source_object,
+    gpointer user_data)
+{
+    PCatControllerHttpServer *server = (PCatControllerHttpServer *)user_data;
+    PCatControllerHttpConnectionData *data;
+
+    if(g_hash_table_size(server->connection_table) >= server->connection_max)
+    {
+        g_warning("HTTP endpoint already has %u clients, reject new "
+            "connection!", server->connection_max);
+
+        return TRUE;
+    }
+
+    data = g_new0(PCatControllerHttpConnectionData, 1);
+    data->server = server;
+    data->connection = g_object_ref(connection);
+    data->input_stream = g_io_stream_get_input_stream(
+        G_IO_STREAM(connection));
+    data->output_stream = g_io_stream_get_output_stream(
+        G_IO_STREAM(connection));
+    data->output_queue = g_queue_new();
+    data->input_timestamp = g_get_monotonic_time();
+
+    g_socket_set_option(g_socket_connection_get_socket(connection),
+        IPPROTO_TCP, TCP_NODELAY, 1, NULL);
+
+    pcat_controller_http_input_source_ensure(data);
+
+    /* Idle clients are checked lazily, requests only move a timestamp. */
+    data->deadline_source = g_source_new(
+        &g_pcat_controller_http_deadline_source_funcs, sizeof(GSource));
+    g_source_set_callback(data->deadline_source,
+        pcat_controller_http_deadline_func, data, NULL);
+    g_source_set_ready_time(data->deadline_source,
+        data->input_timestamp + server->idle_timeout);
+    g_source_attach(data->deadline_source, server->context);
+
+    g_hash_table_replace(server->connection_table, connection, data);
+
+    return TRUE;
+}
+
+PCatControllerHttpServer *pcat_controller_http_server_new(
+    GMainContext *context, const gchar *address, guint port,
+    guint connection_max, gint64 idle_timeout,
+    PCatControllerHttpHandler handler, gpointer user_data)
+{
+    PCatControllerHttpServer *server;
+    GInetAddress *inet_address;
+    GSocketAddress *socket_address;
+    GError *error = NULL;
+
+    inet_address = g_inet_address_new_from_string(address);
+    if(inet_address==NULL)
+    {
+        g_warning("Invalid HTTP endpoint address %s!", address);
+
+        return NULL;
+    }
+
+    socket_address = g_inet_socket_address_new(inet_address, port);
+    g_object_unref(inet_address);
+
+    server = g_new0(PCatControllerHttpServer, 1);
+    server->context = g_main_context_ref(context);
+    server->connection_max = connection_max;
+    server->idle_timeout = idle_timeout;
+    server->handler = handler;
+    server->user_data = user_data;
+    server->service = g_socket_service_new();
+
+    if(!g_socket_listener_add_address(G_SOCKET_LISTENER(server->service),
+        socket_address, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP,
+        NULL, NULL, &error))
+    {
+        g_warning("Failed to listen to HTTP endpoint %s:%u: %s",
+            address, port, error!=NULL ? error->message : "Unknown");
+
+        g_clear_error(&error);
+        g_object_unref(socket_address);
+        g_object_unref(server->service);
+        g_main_context_unref(server->context);
+        g_free(server);
+
+        return NULL;
+    }
+
+    g_object_unref(socket_address);
+
+    server->connection_table = g_hash_table_new_full(g_direct_hash,
+        g_direct_equal, NULL, (GDestroyNotify)
+        pcat_controller_http_connection_data_free);
+    g_signal_connect(server->service, "incoming",
+        G_CALLBACK(pcat_controller_http_incoming_func), server);
+    g_socket_service_start(server->service);
+
+    g_message("HTTP endpoint listens on %s:%u.", address, port);
+
+    return server;
+}
+
+void pcat_controller_http_server_free(PCatControllerHttpServer *server)
+{
+    if(server==NULL)
+    {
+        return;
+    }
+
+    g_socket_service_stop(server->service);
+    g_socket_listener_close(G_SOCKET_LISTENER(server->service));
+    g_object_unref(server->service);
+
+    g_hash_table_unref(server->connection_table);
+    g_main_context_unref(server->context);
+
+    g_free(server);
+}
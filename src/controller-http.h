@@ -0,0 +1,23 @@
+#ifndef HAVE_PCAT_CONTROLLER_HTTP_H
+#define HAVE_PCAT_CONTROLLER_HTTP_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PCatControllerHttpServer PCatControllerHttpServer;
+
+/* Returns a new reference to the body for path, or NULL if not found. */
+typedef GBytes *(*PCatControllerHttpHandler)(const gchar *path,
+    const gchar **content_type, gpointer user_data);
+
+PCatControllerHttpServer *pcat_controller_http_server_new(
+    GMainContext *context, const gchar *address, guint port,
+    guint connection_max, gint64 idle_timeout,
+    PCatControllerHttpHandler handler, gpointer user_data);
+void pcat_controller_http_server_free(PCatControllerHttpServer *server);
+
+G_END_DECLS
+
+#endif
+
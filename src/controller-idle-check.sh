@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+# Idle connection cost of the controller: start pcat-manager with
+# --stub-hardware, run pcat-controller-bench once with no idle clients
+# and once with IDLE clients that never send anything, and print the
+# daemon CPU time, RSS and context switches of both runs.
+#
+# On a single core x86-64 VM (2026-10-19, two runs each), 1000 idle
+# clients added about 3.6 MB RSS (5.5 -> 9.1 MB), 0.13-0.14 s CPU which
+# is mostly accepting them, and 2.8-3.0 instead of 2.3 context
+# switches/s over 60 s.
+#
+# Usage: controller-idle-check.sh PCAT_MANAGER PCAT_CONTROLLER_BENCH
+#            [IDLE] [DURATION]
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 PCAT_MANAGER PCAT_CONTROLLER_BENCH [IDLE] [DURATION]" >&2
+    exit 1
+fi
+
+MANAGER="$1"
+BENCH="$2"
+IDLE="${3:-1000}"
+DURATION="${4:-60}"
+SOCKET="/tmp/pcat-manager.sock"
+
+"$MANAGER" --stub-hardware &
+PID=$!
+trap 'kill $PID 2>/dev/null; wait $PID 2>/dev/null' EXIT INT TERM
+
+i=0
+while [ ! -S "$SOCKET" ]; do
+    i=$((i+1))
+    if [ $i -gt 50 ] || ! kill -0 $PID 2>/dev/null; then
+        echo "pcat-manager did not open $SOCKET!" >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+
+for n in 0 "$IDLE"; do
+    echo "== $n idle connections, $DURATION s =="
+    "$BENCH" --pid $PID --connections 1 --rate 1 --duration "$DURATION" \
+        --idle "$n" | grep -E '^(Running|Total|Daemon)' || exit 1
+done
@@ -0,0 +1,924 @@
+#include <string.h>
+#include "controller-request.h"
+
+typedef struct _PCatControllerRequestParser
+{
+    PCatControllerRequest *request;
+    gchar *data;
+    gsize len;
+    gsize offset;
+}PCatControllerRequestParser;
+
+static inline void pcat_controller_request_space_skip(
+    PCatControllerRequestParser *parser)
+{
+    gchar c;
+
+    while(parser->offset < parser->len)
+    {
+        c = parser->data[parser->offset];
+        if(c!=' ' && c!='\t' && c!='\n' && c!='\r')
+        {
+            break;
+        }
+        parser->offset++;
+    }
+}
+
+static gboolean pcat_controller_request_hex_read(const gchar *src,
+    gsize len, gunichar *value)
+{
+    gint digit;
+    guint i;
+
+    if(len < 4)
+    {
+        return FALSE;
+    }
+
+    *value = 0;
+    for(i=0;i<4;i++)
+    {
+        digit = g_ascii_xdigit_value(src[i]);
+        if(digit < 0)
+        {
+            return FALSE;
+        }
+        *value = (*value << 4) | digit;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Scan a string body up to its closing quote. With dst set, the
+ * unescaped string is written there and terminated, dst may be src as
+ * the output never overtakes the input. Escaped NUL characters and
+ * broken surrogates are left to json-c.
+ */
+static gboolean pcat_controller_request_string_scan(const gchar *src,
+    gsize len, gsize *raw_len, gchar *dst, gsize *dst_len)
+{
+    gsize i = 0, j = 0;
+    guchar c;
+    gunichar ch, low;
+
+    while(i < len)
+    {
+        c = src[i];
+        if(c=='"')
+        {
+            if(dst!=NULL)
+            {
+                dst[j] = '\0';
+            }
+            *raw_len = i;
+            *dst_len = j;
+
+            return TRUE;
+        }
+        if(c < 0x20)
+        {
+            return FALSE;
+        }
+        if(c!='\\')
+        {
+            if(dst!=NULL)
+            {
+                dst[j] = c;
+            }
+            i++;
+            j++;
+
+            continue;
+        }
+
+        if(i + 1 >= len)
+        {
+            return FALSE;
+        }
+        c = src[i+1];
+        i += 2;
+
+        switch(c)
+        {
+            case '"':
+            case '\\':
+            case '/':
+            {
+                ch = c;
+                break;
+            }
+            case 'b':
+            {
+                ch = '\b';
+                break;
+            }
+            case 'f':
+            {
+                ch = '\f';
+                break;
+            }
+            case 'n':
+            {
+                ch = '\n';
+                break;
+            }
+            case 'r':
+            {
+                ch = '\r';
+                break;
+            }
+            case 't':
+            {
+                ch = '\t';
+                break;
+            }
+            case 'u':
+            {
+                if(!pcat_controller_request_hex_read(src + i, len - i, &ch))
+                {
+                    return FALSE;
+                }
+                i += 4;
+
+                if(ch >= 0xD800 && ch <= 0xDBFF)
+                {
+                    if(i + 6 > len || src[i]!='\\' || src[i+1]!='u' ||
+                       !pcat_controller_request_hex_read(src + i + 2,
+                       len - i - 2, &low) || low < 0xDC00 || low > 0xDFFF)
+                    {
+                        return FALSE;
+                    }
+                    i += 6;
+                    ch = 0x10000 + ((ch - 0xD800) << 10) + (low - 0xDC00);
+                }
+                else if((ch >= 0xDC00 && ch <= 0xDFFF) || ch==0)
+                {
+                    return FALSE;
+                }
+                break;
+            }
+            default:
+            {
+                return FALSE;
+            }
+        }
+
+        if(ch < 0x80)
+        {
+            if(dst!=NULL)
+            {
+                dst[j] = ch;
+            }
+            j++;
+        }
+        else
+        {
+            j += g_unichar_to_utf8(ch, dst!=NULL ? dst + j : NULL);
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean pcat_controller_request_number_parse(
+    PCatControllerRequestParser *parser, PCatControllerRequestToken *token)
+{
+    const gchar *data = parser->data;
+    gsize offset = parser->offset;
+    gboolean negative = FALSE;
+    guint64 limit = G_MAXINT64;
+    guint64 value = 0;
+    guint digit;
+
+    if(data[offset]=='-')
+    {
+        negative = TRUE;
+        limit = (guint64)G_MAXINT64 + 1;
+        offset++;
+    }
+    if(offset >= parser->len || !g_ascii_isdigit(data[offset]))
+    {
+        return FALSE;
+    }
+    if(data[offset]=='0' && offset + 1 < parser->len &&
+       g_ascii_isdigit(data[offset+1]))
+    {
+        return FALSE;
+    }
+
+    while(offset < parser->len && g_ascii_isdigit(data[offset]))
+    {
+        digit = data[offset] - '0';
+        if(value > (limit - digit) / 10)
+        {
+            return FALSE;
+        }
+        value = value * 10 + digit;
+        offset++;
+    }
+
+    /* Fractions and exponents are not used by any command. */
+    if(offset < parser->len && (data[offset]=='.' || data[offset]=='e' ||
+       data[offset]=='E'))
+    {
+        return FALSE;
+    }
+
+    token->type = PCAT_CONTROLLER_REQUEST_TYPE_INT;
+    if(!negative)
+    {
+        token->int_value = value;
+    }
+    else if(value==(guint64)G_MAXINT64 + 1)
+    {
+        token->int_value = G_MININT64;
+    }
+    else
+    {
+        token->int_value = -(gint64)value;
+    }
+    parser->offset = offset;
+
+    return TRUE;
+}
+
+static gboolean pcat_controller_request_literal_parse(
+    PCatControllerRequestParser *parser, PCatControllerRequestToken *token)
+{
+    static const gchar * const literals[] = {"null", "false", "true"};
+    gsize len;
+    guint i;
+
+    for(i=0;i<G_N_ELEMENTS(literals);i++)
+    {
+        len = strlen(literals[i]);
+        if(parser->len - parser->offset >= len &&
+           memcmp(parser->data + parser->offset, literals[i], len)==0)
+        {
+            token->type = (i==0) ? PCAT_CONTROLLER_REQUEST_TYPE_NULL :
+                PCAT_CONTROLLER_REQUEST_TYPE_BOOLEAN;
+            token->int_value = (i==2) ? 1 : 0;
+            parser->offset += len;
+
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean pcat_controller_request_tokens_grow(
+    PCatControllerRequest *request)
+{
+    guint token_max;
+
+    if(request->token_max >= PCAT_CONTROLLER_REQUEST_TOKEN_LIMIT)
+    {
+        return FALSE;
+    }
+
+    token_max = request->token_max * 2;
+    if(request->tokens==request->token_buffer)
+    {
+        request->tokens = g_new(PCatControllerRequestToken, token_max);
+        memcpy(request->tokens, request->token_buffer,
+            request->token_count * sizeof(PCatControllerRequestToken));
+    }
+    else
+    {
+        request->tokens = g_renew(PCatControllerRequestToken,
+            request->tokens, token_max);
+    }
+    request->token_max = token_max;
+
+    return TRUE;
+}
+
+static gboolean pcat_controller_request_value_parse(
+    PCatControllerRequestParser *parser, const gchar *key, guint depth)
+{
+    PCatControllerRequest *request = parser->request;
+    PCatControllerRequestToken *token;
+    const gchar *member_key;
+    gsize raw_len, str_len;
+    gchar open, close;
+    guint index;
+
+    if(depth >= PCAT_CONTROLLER_REQUEST_DEPTH_MAX)
+    {
+        return FALSE;
+    }
+    if(request->token_count >= request->token_max &&
+       !pcat_controller_request_tokens_grow(request))
+    {
+        return FALSE;
+    }
+
+    pcat_controller_request_space_skip(parser);
+    if(parser->offset >= parser->len)
+    {
+        return FALSE;
+    }
+
+    index = request->token_count;
+    request->token_count++;
+    token = &(request->tokens[index]);
+    memset(token, 0, sizeof(PCatControllerRequestToken));
+    token->key = key;
+
+    open = parser->data[parser->offset];
+    switch(open)
+    {
+        case '{':
+        case '[':
+        {
+            token->type = (open=='{') ? PCAT_CONTROLLER_REQUEST_TYPE_OBJECT :
+                PCAT_CONTROLLER_REQUEST_TYPE_ARRAY;
+            close = (open=='{') ? '}' : ']';
+            parser->offset++;
+
+            pcat_controller_request_space_skip(parser);
+            if(parser->offset < parser->len &&
+               parser->data[parser->offset]==close)
+            {
+                parser->offset++;
+
+                break;
+            }
+
+            while(TRUE)
+            {
+                member_key = NULL;
+                if(open=='{')
+                {
+                    pcat_controller_request_space_skip(parser);
+                    if(parser->offset >= parser->len ||
+                       parser->data[parser->offset]!='"')
+                    {
+                        return FALSE;
+                    }
+
+                    member_key = parser->data + parser->offset + 1;
+                    if(!pcat_controller_request_string_scan(member_key,
+                        parser->len - parser->offset - 1, &raw_len, NULL,
+                        &str_len))
+                    {
+                        return FALSE;
+                    }
+                    parser->offset += raw_len + 2;
+
+                    pcat_controller_request_space_skip(parser);
+                    if(parser->offset >= parser->len ||
+                       parser->data[parser->offset]!=':')
+                    {
+                        return FALSE;
+                    }
+                    parser->offset++;
+                }
+
+                if(!pcat_controller_request_value_parse(parser, member_key,
+                    depth + 1))
+                {
+                    return FALSE;
+                }
+                request->tokens[index].length++;
+
+                pcat_controller_request_space_skip(parser);
+                if(parser->offset >= parser->len)
+                {
+                    return FALSE;
+                }
+                if(parser->data[parser->offset]==',')
+                {
+                    parser->offset++;
+
+                    continue;
+                }
+                if(parser->data[parser->offset]==close)
+                {
+                    parser->offset++;
+
+                    break;
+                }
+
+                return FALSE;
+            }
+
+            break;
+        }
+        case '"':
+        {
+            token->type = PCAT_CONTROLLER_REQUEST_TYPE_STRING;
+            token->string = parser->data + parser->offset + 1;
+            if(!pcat_controller_request_string_scan(token->string,
+                parser->len - parser->offset - 1, &raw_len, NULL, &str_len))
+            {
+                return FALSE;
+            }
+            token->length = str_len;
+            parser->offset += raw_len + 2;
+
+            break;
+        }
+        case 'n':
+        case 'f':
+        case 't':
+        {
+            if(!pcat_controller_request_literal_parse(parser, token))
+            {
+                return FALSE;
+            }
+
+            break;
+        }
+        default:
+        {
+            if(open!='-' && !g_ascii_isdigit(open))
+            {
+                return FALSE;
+            }
+            if(!pcat_controller_request_number_parse(parser, token))
+            {
+                return FALSE;
+            }
+
+            break;
+        }
+    }
+
+    request->tokens[index].next = request->token_count;
+
+    return TRUE;
+}
+
+static void pcat_controller_request_reset(PCatControllerRequest *request)
+{
+    request->root = NULL;
+    request->tokens = request->token_buffer;
+    request->token_count = 0;
+    request->token_max = PCAT_CONTROLLER_REQUEST_TOKEN_MAX;
+    request->string_chunk = NULL;
+}
+
+gboolean pcat_controller_request_parse(PCatControllerRequest *request,
+    gchar *data, gsize len)
+{
+    PCatControllerRequestParser parser;
+    PCatControllerRequestToken *token;
+    gsize raw_len, str_len;
+    guint i;
+
+    pcat_controller_request_reset(request);
+
+    parser.request = request;
+    parser.data = data;
+    parser.len = len;
+    parser.offset = 0;
+
+    if(!pcat_controller_request_value_parse(&parser, NULL, 0))
+    {
+        pcat_controller_request_clear(request);
+
+        return FALSE;
+    }
+
+    pcat_controller_request_space_skip(&parser);
+    if(parser.offset!=len)
+    {
+        pcat_controller_request_clear(request);
+
+        return FALSE;
+    }
+
+    /* Everything is validated, now unescape the strings in place. */
+    for(i=0;i<request->token_count;i++)
+    {
+        token = &(request->tokens[i]);
+        if(token->key!=NULL)
+        {
+            pcat_controller_request_string_scan(token->key,
+                data + len - token->key, &raw_len, (gchar *)token->key,
+                &str_len);
+        }
+        if(token->type==PCAT_CONTROLLER_REQUEST_TYPE_STRING)
+        {
+            pcat_controller_request_string_scan(token->string,
+                data + len - token->string, &raw_len, (gchar *)token->string,
+                &str_len);
+        }
+    }
+
+    return TRUE;
+}
+
+static guint pcat_controller_request_json_count(struct json_object *value)
+{
+    guint count = 1;
+    guint i, len;
+
+    switch(json_object_get_type(value))
+    {
+        case json_type_array:
+        {
+            len = json_object_array_length(value);
+            for(i=0;i<len;i++)
+            {
+                count += pcat_controller_request_json_count(
+                    json_object_array_get_idx(value, i));
+            }
+            break;
+        }
+        case json_type_object:
+        {
+            json_object_object_foreach(value, key, child)
+            {
+                (void)key;
+                count += pcat_controller_request_json_count(child);
+            }
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    return count;
+}
+
+static void pcat_controller_request_json_fill(
+    PCatControllerRequest *request, struct json_object *value,
+    const gchar *key)
+{
+    PCatControllerRequestToken *token;
+    guint index;
+    guint i, len;
+
+    index = request->token_count;
+    request->token_count++;
+    token = &(request->tokens[index]);
+    memset(token, 0, sizeof(PCatControllerRequestToken));
+    token->key = key;
+
+    switch(json_object_get_type(value))
+    {
+        case json_type_boolean:
+        {
+            token->type = PCAT_CONTROLLER_REQUEST_TYPE_BOOLEAN;
+            token->int_value = json_object_get_boolean(value) ? 1 : 0;
+            break;
+        }
+        case json_type_int:
+        {
+            token->type = PCAT_CONTROLLER_REQUEST_TYPE_INT;
+            token->int_value = json_object_get_int64(value);
+            break;
+        }
+        case json_type_double:
+        {
+            token->type = PCAT_CONTROLLER_REQUEST_TYPE_DOUBLE;
+            token->double_value = json_object_get_double(value);
+            break;
+        }
+        case json_type_string:
+        {
+            token->type = PCAT_CONTROLLER_REQUEST_TYPE_STRING;
+            token->string = json_object_get_string(value);
+            token->length = json_object_get_string_len(value);
+            break;
+        }
+        case json_type_array:
+        {
+            token->type = PCAT_CONTROLLER_REQUEST_TYPE_ARRAY;
+            len = json_object_array_length(value);
+            for(i=0;i<len;i++)
+            {
+                pcat_controller_request_json_fill(request,
+                    json_object_array_get_idx(value, i), NULL);
+            }
+            request->tokens[index].length = len;
+            break;
+        }
+        case json_type_object:
+        {
+            token->type = PCAT_CONTROLLER_REQUEST_TYPE_OBJECT;
+            json_object_object_foreach(value, member_key, child)
+            {
+                pcat_controller_request_json_fill(request, child,
+                    member_key);
+                request->tokens[index].length++;
+            }
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    request->tokens[index].next = request->token_count;
+}
+
+gboolean pcat_controller_request_json_init(PCatControllerRequest *request,
+    struct json_object *root)
+{
+    guint count;
+
+    pcat_controller_request_reset(request);
+
+    if(root==NULL)
+    {
+        return FALSE;
+    }
+
+    count = pcat_controller_request_json_count(root);
+    if(count > request->token_max)
+    {
+        request->tokens = g_new(PCatControllerRequestToken, count);
+        request->token_max = count;
+    }
+
+    request->root = json_object_get(root);
+    pcat_controller_request_json_fill(request, root, NULL);
+
+    return TRUE;
+}
+
+void pcat_controller_request_clear(PCatControllerRequest *request)
+{
+    if(request->root!=NULL)
+    {
+        json_object_put(request->root);
+    }
+    if(request->tokens!=request->token_buffer)
+    {
+        g_free(request->tokens);
+    }
+    if(request->string_chunk!=NULL)
+    {
+        g_string_chunk_free(request->string_chunk);
+    }
+
+    pcat_controller_request_reset(request);
+}
+
+struct json_object *pcat_controller_request_json_new(
+    const PCatControllerRequest *request, gint token)
+{
+    const PCatControllerRequestToken *data;
+    struct json_object *value;
+    gint child;
+
+    if(token < 0 || (guint)token >= request->token_count)
+    {
+        return NULL;
+    }
+    if(token==0 && request->root!=NULL)
+    {
+        return json_object_get(request->root);
+    }
+
+    data = &(request->tokens[token]);
+    switch(data->type)
+    {
+        case PCAT_CONTROLLER_REQUEST_TYPE_BOOLEAN:
+        {
+            return json_object_new_boolean(data->int_value!=0);
+        }
+        case PCAT_CONTROLLER_REQUEST_TYPE_INT:
+        {
+            return json_object_new_int64(data->int_value);
+        }
+        case PCAT_CONTROLLER_REQUEST_TYPE_DOUBLE:
+        {
+            return json_object_new_double(data->double_value);
+        }
+        case PCAT_CONTROLLER_REQUEST_TYPE_STRING:
+        {
+            return json_object_new_string_len(data->string, data->length);
+        }
+        case PCAT_CONTROLLER_REQUEST_TYPE_ARRAY:
+        {
+            value = json_object_new_array();
+            for(child=pcat_controller_request_child_next(request, token, -1);
+                child >= 0;child=pcat_controller_request_child_next(request,
+                token, child))
+            {
+                json_object_array_add(value,
+                    pcat_controller_request_json_new(request, child));
+            }
+
+            return value;
+        }
+        case PCAT_CONTROLLER_REQUEST_TYPE_OBJECT:
+        {
+            value = json_object_new_object();
+            for(child=pcat_controller_request_child_next(request, token, -1);
+                child >= 0;child=pcat_controller_request_child_next(request,
+                token, child))
+            {
+                json_object_object_add(value, request->tokens[child].key,
+                    pcat_controller_request_json_new(request, child));
+            }
+
+            return value;
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+PCatControllerRequestType pcat_controller_request_type_get(
+    const PCatControllerRequest *request, gint token)
+{
+    if(token < 0 || (guint)token >= request->token_count)
+    {
+        return PCAT_CONTROLLER_REQUEST_TYPE_NULL;
+    }
+
+    return request->tokens[token].type;
+}
+
+gint pcat_controller_request_member_get(const PCatControllerRequest *request,
+    gint object, const gchar *key)
+{
+    gint child;
+    gint member = -1;
+
+    if(pcat_controller_request_type_get(request, object)!=
+       PCAT_CONTROLLER_REQUEST_TYPE_OBJECT)
+    {
+        return -1;
+    }
+
+    /* Like json-c, the last one of duplicated keys wins. */
+    for(child=pcat_controller_request_child_next(request, object, -1);
+        child >= 0;child=pcat_controller_request_child_next(request, object,
+        child))
+    {
+        if(strcmp(request->tokens[child].key, key)==0)
+        {
+            member = child;
+        }
+    }
+
+    return member;
+}
+
+gint pcat_controller_request_child_next(const PCatControllerRequest *request,
+    gint parent, gint child)
+{
+    guint next;
+
+    if(parent < 0 || (guint)parent >= request->token_count)
+    {
+        return -1;
+    }
+
+    next = (child < 0) ? (guint)parent + 1 : request->tokens[child].next;
+    if(next >= request->tokens[parent].next)
+    {
+        return -1;
+    }
+
+    return next;
+}
+
+guint pcat_controller_request_length_get(
+    const PCatControllerRequest *request, gint token)
+{
+    switch(pcat_controller_request_type_get(request, token))
+    {
+        case PCAT_CONTROLLER_REQUEST_TYPE_STRING:
+        case PCAT_CONTROLLER_REQUEST_TYPE_ARRAY:
+        case PCAT_CONTROLLER_REQUEST_TYPE_OBJECT:
+        {
+            return request->tokens[token].length;
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+gint64 pcat_controller_request_int64(const PCatControllerRequest *request,
+    gint token)
+{
+    gdouble double_value;
+
+    switch(pcat_controller_request_type_get(request, token))
+    {
+        case PCAT_CONTROLLER_REQUEST_TYPE_BOOLEAN:
+        case PCAT_CONTROLLER_REQUEST_TYPE_INT:
+        {
+            return request->tokens[token].int_value;
+        }
+        case PCAT_CONTROLLER_REQUEST_TYPE_DOUBLE:
+        {
+            double_value = request->tokens[token].double_value;
+            if(double_value >= (gdouble)G_MAXINT64)
+            {
+                return G_MAXINT64;
+            }
+            if(double_value <= (gdouble)G_MININT64)
+            {
+                return G_MININT64;
+            }
+
+            return (gint64)double_value;
+        }
+        case PCAT_CONTROLLER_REQUEST_TYPE_STRING:
+        {
+            return g_ascii_strtoll(request->tokens[token].string, NULL, 10);
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+gint pcat_controller_request_int(const PCatControllerRequest *request,
+    gint token)
+{
+    gint64 value;
+
+    value = pcat_controller_request_int64(request, token);
+
+    return CLAMP(value, G_MININT, G_MAXINT);
+}
+
+const gchar *pcat_controller_request_string(
+    const PCatControllerRequest *request, gint token)
+{
+    PCatControllerRequest *owner = (PCatControllerRequest *)request;
+    struct json_object *value;
+    const gchar *str;
+
+    switch(pcat_controller_request_type_get(request, token))
+    {
+        case PCAT_CONTROLLER_REQUEST_TYPE_STRING:
+        {
+            return request->tokens[token].string;
+        }
+        case PCAT_CONTROLLER_REQUEST_TYPE_NULL:
+        {
+            return NULL;
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    /* Like json_object_get_string(), other values read as their JSON
+     * text, which lives as long as the request. */
+    value = pcat_controller_request_json_new(request, token);
+    if(owner->string_chunk==NULL)
+    {
+        owner->string_chunk = g_string_chunk_new(64);
+    }
+    str = g_string_chunk_insert(owner->string_chunk,
+        json_object_get_string(value));
+    json_object_put(value);
+
+    return str;
+}
+
+gboolean pcat_controller_request_int_get(
+    const PCatControllerRequest *request, gint object, const gchar *key,
+    gint *value)
+{
+    gint member;
+
+    member = pcat_controller_request_member_get(request, object, key);
+    if(member < 0)
+    {
+        return FALSE;
+    }
+
+    if(value!=NULL)
+    {
+        *value = pcat_controller_request_int(request, member);
+    }
+
+    return TRUE;
+}
+
+const gchar *pcat_controller_request_string_get(
+    const PCatControllerRequest *request, gint object, const gchar *key)
+{
+    return pcat_controller_request_string(request,
+        pcat_controller_request_member_get(request, object, key));
+}
@@ -0,0 +1,81 @@
+#ifndef HAVE_PCAT_CONTROLLER_REQUEST_H
+#define HAVE_PCAT_CONTROLLER_REQUEST_H
+
+#include <glib.h>
+#include <json.h>
+
+G_BEGIN_DECLS
+
+#define PCAT_CONTROLLER_REQUEST_TOKEN_MAX 64
+#define PCAT_CONTROLLER_REQUEST_TOKEN_LIMIT 65536
+#define PCAT_CONTROLLER_REQUEST_DEPTH_MAX 16
+
+typedef enum
+{
+    PCAT_CONTROLLER_REQUEST_TYPE_NULL = 0,
+    PCAT_CONTROLLER_REQUEST_TYPE_BOOLEAN,
+    PCAT_CONTROLLER_REQUEST_TYPE_INT,
+    PCAT_CONTROLLER_REQUEST_TYPE_DOUBLE,
+    PCAT_CONTROLLER_REQUEST_TYPE_STRING,
+    PCAT_CONTROLLER_REQUEST_TYPE_ARRAY,
+    PCAT_CONTROLLER_REQUEST_TYPE_OBJECT
+}PCatControllerRequestType;
+
+typedef struct _PCatControllerRequestToken
+{
+    PCatControllerRequestType type;
+    const gchar *key;
+    const gchar *string;
+    gint64 int_value;
+    gdouble double_value;
+    guint length;
+    guint next;
+}PCatControllerRequestToken;
+
+/*
+ * Tokens are stored in pre-order, the members of a container follow it
+ * and next points behind its last descendant. Token 0 is the root. The
+ * inline buffer covers common requests, larger ones grow on the heap.
+ */
+typedef struct _PCatControllerRequest
+{
+    struct json_object *root;
+    PCatControllerRequestToken *tokens;
+    guint token_count;
+    guint token_max;
+    GStringChunk *string_chunk;
+    PCatControllerRequestToken token_buffer[
+        PCAT_CONTROLLER_REQUEST_TOKEN_MAX];
+}PCatControllerRequest;
+
+gboolean pcat_controller_request_parse(PCatControllerRequest *request,
+    gchar *data, gsize len);
+gboolean pcat_controller_request_json_init(PCatControllerRequest *request,
+    struct json_object *root);
+void pcat_controller_request_clear(PCatControllerRequest *request);
+struct json_object *pcat_controller_request_json_new(
+    const PCatControllerRequest *request, gint token);
+PCatControllerRequestType pcat_controller_request_type_get(
+    const PCatControllerRequest *request, gint token);
+gint pcat_controller_request_member_get(const PCatControllerRequest *request,
+    gint object, const gchar *key);
+gint pcat_controller_request_child_next(const PCatControllerRequest *request,
+    gint parent, gint child);
+guint pcat_controller_request_length_get(
+    const PCatControllerRequest *request, gint token);
+gint64 pcat_controller_request_int64(const PCatControllerRequest *request,
+    gint token);
+gint pcat_controller_request_int(const PCatControllerRequest *request,
+    gint token);
+const gchar *pcat_controller_request_string(
+    const PCatControllerRequest *request, gint token);
+gboolean pcat_controller_request_int_get(
+    const PCatControllerRequest *request, gint object, const gchar *key,
+    gint *value);
+const gchar *pcat_controller_request_string_get(
+    const PCatControllerRequest *request, gint object, const gchar *key);
+
+G_END_DECLS
+
+#endif
+
@@ -1,73 +1,376 @@
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
 #include <glib/gstdio.h>
 #include <gio/gio.h>
 #include <gio/gunixsocketaddress.h>
 #include <json.h>
 #include "controller.h"
+#include "controller-codec.h"
+#include "controller-request.h"
+#include "controller-http.h"
+#include "controller-command-registry.h"
 #include "pmu-manager.h"
 #include "modem-manager.h"
+#include "metrics.h"
 #include "common.h"
 
+#ifndef POLLRDHUP
+#define POLLRDHUP 0x2000
+#endif
+
 #define PCAT_CONTROLLER_SOCKET_FILE "/tmp/pcat-manager.sock"
+#define PCAT_CONTROLLER_SEQPACKET_SOCKET_FILE \
+    "/tmp/pcat-manager-seqpacket.sock"
+#define PCAT_CONTROLLER_INPUT_MESSAGE_SIZE_MAX 2097152
+#define PCAT_CONTROLLER_OUTPUT_TOPIC_RESPONSE -1
+#define PCAT_CONTROLLER_OUTPUT_TOPIC_OVERFLOW PCAT_CONTROLLER_TOPIC_LAST
+#define PCAT_CONTROLLER_OUTPUT_VECTOR_MAX 64
+#define PCAT_CONTROLLER_BATCH_COMMAND_MAX 64
+#define PCAT_CONTROLLER_COMMAND_QUEUE_MAX 256
+#define PCAT_CONTROLLER_RESPONSE_CODE_BUSY 2
+#define PCAT_CONTROLLER_RESPONSE_CODE_TOO_LARGE 3
+#define PCAT_CONTROLLER_SEQPACKET_SNDBUF_RESERVE 32
+#define PCAT_CONTROLLER_HTTP_CONNECTION_MAX 64
+#define PCAT_CONTROLLER_HTTP_METRICS_CACHE_TIME G_USEC_PER_SEC
+#define PCAT_CONTROLLER_COMMAND_STATS_BUCKET_COUNT 17
+#define PCAT_CONTROLLER_SYSTEM_STATUS_SECTION_ALL \
+    (((1U << PCAT_CONTROLLER_TOPIC_LAST) - 1) & \
+    ~(1U << PCAT_CONTROLLER_TOPIC_GPIO))
 
 typedef struct _PCatControllerConnectionData
 {
+    gint ref_count;
+    gboolean closed;
     GSocketConnection *connection;
+    GSocket *socket;
+    gboolean seqpacket;
     GInputStream *input_stream;
     GOutputStream *output_stream;
     GSource *input_stream_source;
     GSource *output_stream_source;
-    GByteArray *input_buffer;
-    GByteArray *output_buffer;
+    struct json_tokener *input_tokener;
+    struct json_object *input_root;
+    gsize input_message_size;
+    gboolean input_message_discard;
+    PCatControllerCodecType codec;
+    PCatControllerCodecType input_codec;
+    GByteArray *input_frame_buffer;
+    gsize input_frame_discard_size;
+    struct json_object *batch_responses;
+    struct json_object *batch_root;
+    guint batch_index;
+    guint batch_length;
+    gint batch_code;
+    gboolean command_busy;
+    GQueue *command_queue;
+    gint64 command_rate_deadline[PCAT_CONTROLLER_COMMAND_RATE_CLASS_LAST];
+    GQueue *output_queue;
+    gsize output_queue_size;
+    gsize output_head_offset;
+    gsize output_packet_size_max;
+    GList *output_topic_link[PCAT_CONTROLLER_TOPIC_LAST];
+    GList *output_overflow_link;
+    gboolean output_overflow_close;
+    guint64 output_dropped_messages;
+    guint64 output_dropped_bytes;
+    guint topic_mask;
+    guint topic_pending_mask;
+    guint topic_min_interval[PCAT_CONTROLLER_TOPIC_LAST];
+    gint64 topic_last_push_time[PCAT_CONTROLLER_TOPIC_LAST];
+    GSource *topic_timeout_source;
+    gint64 topic_timeout_deadline;
+    GSource *deadline_source;
+    gint64 input_timestamp;
+    gint64 output_timestamp;
 }PCatControllerConnectionData;
 
+typedef struct _PCatControllerOutputMessageData
+{
+    GBytes *data;
+    gint topic;
+    PCatControllerCodecType codec;
+    gint command_id;
+    gint64 timestamp;
+}PCatControllerOutputMessageData;
+
+typedef enum
+{
+    PCAT_CONTROLLER_COMMAND_STAGE_PARSE = 0,
+    PCAT_CONTROLLER_COMMAND_STAGE_HANDLER,
+    PCAT_CONTROLLER_COMMAND_STAGE_SERIALIZE,
+    PCAT_CONTROLLER_COMMAND_STAGE_WRITE,
+    PCAT_CONTROLLER_COMMAND_STAGE_LAST
+}PCatControllerCommandStage;
+
+typedef struct _PCatControllerCommandStageStatsData
+{
+    guint64 count;
+    guint64 sum;
+    guint64 max;
+    guint64 buckets[PCAT_CONTROLLER_COMMAND_STATS_BUCKET_COUNT];
+}PCatControllerCommandStageStatsData;
+
+typedef struct _PCatControllerCommandStatsData
+{
+    guint64 count;
+    guint64 output_bytes;
+    PCatControllerCommandStageStatsData stage[
+        PCAT_CONTROLLER_COMMAND_STAGE_LAST];
+}PCatControllerCommandStatsData;
+
+typedef enum
+{
+    PCAT_CONTROLLER_RESPONSE_CACHE_PMU_STATUS = 0,
+    PCAT_CONTROLLER_RESPONSE_CACHE_PMU_FW_VERSION,
+    PCAT_CONTROLLER_RESPONSE_CACHE_CHARGER_ON_AUTO_START,
+    PCAT_CONTROLLER_RESPONSE_CACHE_SCHEDULE_POWER_EVENT,
+    PCAT_CONTROLLER_RESPONSE_CACHE_LAST
+}PCatControllerResponseCacheType;
+
+typedef struct _PCatControllerEncodedData
+{
+    struct json_object *root;
+    GBytes *data[PCAT_CONTROLLER_CODEC_LAST];
+}PCatControllerEncodedData;
+
+typedef struct _PCatControllerResponseCacheData
+{
+    PCatControllerEncodedData message;
+    guint generation;
+    gint64 tag;
+}PCatControllerResponseCacheData;
+
 typedef struct _PCatControllerData
 {
     gboolean initialized;
+    GMutex context_mutex;
+    GMainContext *context;
+    GMainLoop *loop;
+    GThread *thread;
+    guint topic_changed_mask;
     GSocketService *control_socket_service;
     GHashTable *control_connection_table;
-    guint connection_check_timeout_id;
-    GHashTable *command_table;
+    guint connection_max;
+    gint64 connection_idle_timeout;
+    gint64 connection_write_timeout;
+    gint64 command_rate_interval[PCAT_CONTROLLER_COMMAND_RATE_CLASS_LAST];
+    gint64 command_rate_tolerance[PCAT_CONTROLLER_COMMAND_RATE_CLASS_LAST];
+    PCatControllerEncodedData topic_message[PCAT_CONTROLLER_TOPIC_LAST];
+    guint topic_generation[PCAT_CONTROLLER_TOPIC_LAST];
+    PCatControllerResponseCacheData response_cache[
+        PCAT_CONTROLLER_RESPONSE_CACHE_LAST];
+    PCatControllerResponseCacheData system_status_cache[
+        1U << PCAT_CONTROLLER_TOPIC_LAST];
+    gsize output_queue_size_max;
+    guint output_queue_message_max;
+    PCatMetricsItem *output_slow_consumer_metric;
+    PCatMetricsItem *output_dropped_messages_metric;
+    PCatMetricsItem *output_dropped_bytes_metric;
+    PCatMetricsItem *output_coalesced_messages_metric;
+    PCatMetricsItem *connection_metric;
+    PCatMetricsItem *connection_total_metric;
+    PCatMetricsItem *connection_rejected_metric;
+    PCatMetricsItem *connection_reaped_metric;
+    PCatMetricsItem *command_metric[PCAT_CONTROLLER_COMMAND_LAST];
+    PCatMetricsItem *command_throttled_metric[PCAT_CONTROLLER_COMMAND_LAST];
+    PCatControllerHttpServer *http_server;
+    GBytes *http_metrics_text;
+    gint64 http_metrics_timestamp;
+    PCatControllerCommandStatsData command_stats[
+        PCAT_CONTROLLER_COMMAND_LAST];
+    gint command_current;
+    gint64 command_parse_timestamp;
+    gint64 command_serialize_time;
 }PCatControllerData;
 
 typedef void (*PCatControllerCommandCallback)(PCatControllerData *ctrl_data,
     PCatControllerConnectionData *connection_data, const gchar *command,
-    struct json_object *root);
+    const PCatControllerRequest *request);
 
-typedef struct _PCatControllerCommandData
+typedef struct _PCatControllerCommandJobData
 {
-    const gchar *command;
-    PCatControllerCommandCallback callback;
-}PCatControllerCommandData;
+    PCatControllerConnectionData *connection_data;
+    gint command_id;
+    struct json_object *root;
+    struct json_object *responses;
+    gint64 handler_time;
+}PCatControllerCommandJobData;
 
 static PCatControllerData g_pcat_controller_data = {0};
 
-static void pcat_controller_connection_data_free(
-    PCatControllerConnectionData *data)
+static const PCatControllerCommandCallback
+    g_pcat_controller_command_callback_list[PCAT_CONTROLLER_COMMAND_LAST];
+
+static const gchar * const g_pcat_controller_topic_name_list[
+    PCAT_CONTROLLER_TOPIC_LAST] =
+{
+    [PCAT_CONTROLLER_TOPIC_BATTERY] = "battery",
+    [PCAT_CONTROLLER_TOPIC_CHARGER] = "charger",
+    [PCAT_CONTROLLER_TOPIC_MODEM] = "modem",
+    [PCAT_CONTROLLER_TOPIC_ROUTE] = "route",
+    [PCAT_CONTROLLER_TOPIC_SCHEDULE] = "schedule",
+    [PCAT_CONTROLLER_TOPIC_GPIO] = "gpio"
+};
+
+static const guint g_pcat_controller_topic_min_interval_list[
+    PCAT_CONTROLLER_TOPIC_LAST] =
+{
+    [PCAT_CONTROLLER_TOPIC_BATTERY] = 5000,
+    [PCAT_CONTROLLER_TOPIC_CHARGER] = 1000,
+    [PCAT_CONTROLLER_TOPIC_MODEM] = 2000,
+    [PCAT_CONTROLLER_TOPIC_ROUTE] = 0,
+    [PCAT_CONTROLLER_TOPIC_SCHEDULE] = 0,
+    [PCAT_CONTROLLER_TOPIC_GPIO] = 0
+};
+
+/* Upper bounds in microseconds, the last bucket takes the rest. */
+static const gint64 g_pcat_controller_command_stats_bound_list[
+    PCAT_CONTROLLER_COMMAND_STATS_BUCKET_COUNT - 1] =
+{
+    10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+    100000, 250000, 500000, 1000000
+};
+
+static const gchar * const g_pcat_controller_command_stage_name_list[
+    PCAT_CONTROLLER_COMMAND_STAGE_LAST] =
+{
+    [PCAT_CONTROLLER_COMMAND_STAGE_PARSE] = "parse",
+    [PCAT_CONTROLLER_COMMAND_STAGE_HANDLER] = "handler",
+    [PCAT_CONTROLLER_COMMAND_STAGE_SERIALIZE] = "serialize",
+    [PCAT_CONTROLLER_COMMAND_STAGE_WRITE] = "write"
+};
+
+static void pcat_controller_command_stats_observe(
+    PCatControllerData *ctrl_data, gint command_id,
+    PCatControllerCommandStage stage, gint64 elapsed)
+{
+    PCatControllerCommandStageStatsData *stats;
+    guint i;
+
+    if(command_id < 0 || command_id >= PCAT_CONTROLLER_COMMAND_LAST)
+    {
+        return;
+    }
+
+    stats = &(ctrl_data->command_stats[command_id].stage[stage]);
+    elapsed = MAX(elapsed, 0);
+
+    for(i=0;i<PCAT_CONTROLLER_COMMAND_STATS_BUCKET_COUNT-1;i++)
+    {
+        if(elapsed <= g_pcat_controller_command_stats_bound_list[i])
+        {
+            break;
+        }
+    }
+    stats->buckets[i]++;
+    stats->count++;
+    stats->sum += elapsed;
+    if((guint64)elapsed > stats->max)
+    {
+        stats->max = elapsed;
+    }
+}
+
+static void pcat_controller_command_stats_begin(
+    PCatControllerData *ctrl_data, gint command_id)
+{
+    ctrl_data->command_current = command_id;
+    ctrl_data->command_serialize_time = 0;
+}
+
+static void pcat_controller_command_stats_end(
+    PCatControllerData *ctrl_data, gint64 handler_time)
+{
+    pcat_controller_command_stats_observe(ctrl_data,
+        ctrl_data->command_current, PCAT_CONTROLLER_COMMAND_STAGE_HANDLER,
+        handler_time);
+    pcat_controller_command_stats_observe(ctrl_data,
+        ctrl_data->command_current,
+        PCAT_CONTROLLER_COMMAND_STAGE_SERIALIZE,
+        ctrl_data->command_serialize_time);
+
+    ctrl_data->command_current = -1;
+}
+
+static void pcat_controller_output_message_written(
+    PCatControllerData *ctrl_data, PCatControllerOutputMessageData *message)
+{
+    if(message->command_id < 0)
+    {
+        return;
+    }
+
+    ctrl_data->command_stats[message->command_id].output_bytes +=
+        g_bytes_get_size(message->data);
+    pcat_controller_command_stats_observe(ctrl_data, message->command_id,
+        PCAT_CONTROLLER_COMMAND_STAGE_WRITE,
+        g_get_monotonic_time() - message->timestamp);
+}
+
+static void pcat_controller_output_message_data_free(
+    PCatControllerOutputMessageData *data)
 {
     if(data==NULL)
     {
         return;
     }
 
-    if(data->output_stream_source!=NULL)
+    if(data->data!=NULL)
     {
-        g_source_destroy(data->output_stream_source);
-        g_source_unref(data->output_stream_source);
+        g_bytes_unref(data->data);
     }
-    if(data->input_stream_source!=NULL)
+
+    g_free(data);
+}
+
+static PCatControllerConnectionData *pcat_controller_connection_data_ref(
+    PCatControllerConnectionData *data)
+{
+    g_atomic_int_inc(&(data->ref_count));
+
+    return data;
+}
+
+static void pcat_controller_connection_data_unref(
+    PCatControllerConnectionData *data)
+{
+    if(data==NULL || !g_atomic_int_dec_and_test(&(data->ref_count)))
     {
-        g_source_destroy(data->input_stream_source);
-        g_source_unref(data->input_stream_source);
+        return;
     }
 
-    if(data->output_buffer!=NULL)
+    if(data->command_queue!=NULL)
+    {
+        g_queue_free_full(data->command_queue,
+            (GDestroyNotify)json_object_put);
+    }
+    if(data->batch_root!=NULL)
+    {
+        json_object_put(data->batch_root);
+    }
+    if(data->batch_responses!=NULL)
+    {
+        json_object_put(data->batch_responses);
+    }
+    if(data->output_queue!=NULL)
+    {
+        g_queue_free_full(data->output_queue,
+            (GDestroyNotify)pcat_controller_output_message_data_free);
+    }
+    if(data->input_root!=NULL)
+    {
+        json_object_put(data->input_root);
+    }
+    if(data->input_tokener!=NULL)
     {
-        g_byte_array_unref(data->output_buffer);
+        json_tokener_free(data->input_tokener);
     }
-    if(data->input_buffer!=NULL)
+    if(data->input_frame_buffer!=NULL)
     {
-        g_byte_array_unref(data->input_buffer);
+        g_byte_array_unref(data->input_frame_buffer);
     }
 
     if(data->connection!=NULL)
@@ -78,256 +381,266 @@ static void pcat_controller_connection_data_free(
     g_free(data);
 }
 
-static gboolean pcat_controller_unix_socket_output_watch_func(
-    GObject *stream, gpointer user_data)
+static void pcat_controller_connection_data_close(
+    PCatControllerConnectionData *data)
 {
-    PCatControllerData *ctrl_data = &g_pcat_controller_data;
-    PCatControllerConnectionData *connection_data =
-        (PCatControllerConnectionData *)user_data;
-    gssize wsize;
-    gsize total_write_size = 0, remaining_size;
-    GError *error = NULL;
-    gboolean ret = FALSE;
-    gboolean need_close = FALSE;
-
-    do
+    if(data==NULL)
     {
-        if(total_write_size >= connection_data->output_buffer->len)
-        {
-            break;
-        }
+        return;
+    }
 
-        remaining_size = connection_data->output_buffer->len -
-            total_write_size;
+    data->closed = TRUE;
 
-        wsize = g_pollable_output_stream_write_nonblocking(
-            G_POLLABLE_OUTPUT_STREAM(stream),
-            connection_data->output_buffer->data + total_write_size,
-            remaining_size > 4096 ? 4096 : remaining_size, NULL, &error);
-        if(wsize > 0)
-        {
-            total_write_size += wsize;
-        }
+    pcat_metrics_gauge_add(g_pcat_controller_data.connection_metric, -1);
+
+    if(data->topic_timeout_source!=NULL)
+    {
+        g_source_destroy(data->topic_timeout_source);
+        g_source_unref(data->topic_timeout_source);
+        data->topic_timeout_source = NULL;
     }
-    while(wsize > 0);
 
-    if(total_write_size > 0)
+    if(data->deadline_source!=NULL)
     {
-        g_byte_array_remove_range(connection_data->output_buffer, 0,
-            total_write_size);
+        g_source_destroy(data->deadline_source);
+        g_source_unref(data->deadline_source);
+        data->deadline_source = NULL;
     }
 
-    if(error!=NULL)
+    if(data->output_stream_source!=NULL)
     {
-        if(g_error_matches(error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
-        {
-            ret = TRUE;
-        }
-        else if(g_error_matches(error, G_IO_ERROR,
-            G_IO_ERROR_CONNECTION_CLOSED))
-        {
-            ret = FALSE;
-            need_close = TRUE;
+        g_source_destroy(data->output_stream_source);
+        g_source_unref(data->output_stream_source);
+        data->output_stream_source = NULL;
+    }
+    if(data->input_stream_source!=NULL)
+    {
+        g_source_destroy(data->input_stream_source);
+        g_source_unref(data->input_stream_source);
+        data->input_stream_source = NULL;
+    }
 
-            g_message("A Unix socket connection closed.");
-        }
-        else
-        {
-            ret = FALSE;
-            need_close = TRUE;
+    pcat_controller_connection_data_unref(data);
+}
 
-            g_warning("A Unix socket connection broke with error %s!",
-                error->message);
-        }
+static gint64 pcat_controller_connection_deadline_get(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data)
+{
+    gint64 deadline = G_MAXINT64;
 
-        g_clear_error(&error);
-    }
-    else if(wsize==0)
+    if(connection_data->output_overflow_close)
     {
-        ret = FALSE;
-        need_close = TRUE;
-
-        g_message("A Unix socket connection closed.");
+        return 0;
     }
 
-    if(need_close)
+    if(!g_queue_is_empty(connection_data->output_queue))
     {
-        g_hash_table_remove(ctrl_data->control_connection_table,
-            connection_data->connection);
+        deadline = connection_data->output_timestamp +
+            ctrl_data->connection_write_timeout;
     }
-    else if(!ret)
+
+    /* Subscribers and clients waiting for a write command are expected to
+     * stay silent, only plain request clients are reaped when idle. */
+    if(connection_data->topic_mask==0 && !connection_data->command_busy)
     {
-        g_source_destroy(connection_data->output_stream_source);
-        g_source_unref(connection_data->output_stream_source);
-        connection_data->output_stream_source = NULL;
+        deadline = MIN(deadline, connection_data->input_timestamp +
+            ctrl_data->connection_idle_timeout);
     }
 
-    return ret;
+    return deadline;
 }
 
-static void pcat_controller_unix_socket_output_json_push(
-    PCatControllerData *ctrl_data,
-    PCatControllerConnectionData *connection_data, struct json_object *root)
+static void pcat_controller_connection_deadline_update(
+    PCatControllerConnectionData *connection_data)
 {
-    GHashTableIter iter;
-    const gchar *json_data;
+    gint64 deadline, ready_time;
 
-    if(ctrl_data==NULL || root==NULL)
+    if(connection_data->deadline_source==NULL)
     {
         return;
     }
 
-    json_data = json_object_to_json_string(root);
-    if(json_data==NULL)
+    /* The deadline is only moved earlier here. Later deadlines are picked
+     * up lazily when the source fires, so activity costs no wakeups. */
+    deadline = pcat_controller_connection_deadline_get(
+        &g_pcat_controller_data, connection_data);
+    ready_time = g_source_get_ready_time(connection_data->deadline_source);
+    if(deadline!=G_MAXINT64 && (ready_time < 0 || deadline < ready_time))
     {
-        return;
+        g_source_set_ready_time(connection_data->deadline_source, deadline);
     }
+}
 
-    if(connection_data!=NULL)
+static gboolean pcat_controller_connection_deadline_func(gpointer user_data)
+{
+    PCatControllerData *ctrl_data = &g_pcat_controller_data;
+    PCatControllerConnectionData *connection_data =
+        (PCatControllerConnectionData *)user_data;
+    gint64 deadline;
+
+    deadline = pcat_controller_connection_deadline_get(ctrl_data,
+        connection_data);
+    if(deadline==G_MAXINT64)
     {
-        if(connection_data->output_buffer->len > 2097152)
-        {
-            connection_data->output_buffer->len = 0;
-        }
+        g_source_set_ready_time(connection_data->deadline_source, -1);
 
-        g_byte_array_append(connection_data->output_buffer,
-            (const guint8 *)json_data, strlen(json_data)+1);
+        return TRUE;
+    }
+    if(g_get_monotonic_time() < deadline)
+    {
+        g_source_set_ready_time(connection_data->deadline_source, deadline);
 
-        if(connection_data->output_stream_source==NULL)
-        {
-            connection_data->output_stream_source =
-                g_pollable_output_stream_create_source(
-                G_POLLABLE_OUTPUT_STREAM(connection_data->output_stream),
-                NULL);
-            g_source_set_callback(connection_data->output_stream_source,
-                (GSourceFunc)pcat_controller_unix_socket_output_watch_func,
-                connection_data, NULL);
-            g_source_attach(connection_data->output_stream_source, NULL);
-        }
+        return TRUE;
+    }
+
+    if(g_queue_is_empty(connection_data->output_queue))
+    {
+        g_message("Controller client is idle, close connection.");
     }
     else
     {
-        g_hash_table_iter_init(&iter, ctrl_data->control_connection_table);
-        while(g_hash_table_iter_next(&iter, NULL,
-            (gpointer *)&connection_data))
-        {
-            g_byte_array_append(connection_data->output_buffer,
-                (const guint8 *)json_data, strlen(json_data)+1);
-
-            if(connection_data->output_stream_source==NULL)
-            {
-                connection_data->output_stream_source =
-                    g_pollable_output_stream_create_source(
-                    G_POLLABLE_OUTPUT_STREAM(connection_data->output_stream),
-                    NULL);
-                g_source_set_callback(connection_data->output_stream_source,
-                    (GSourceFunc)
-                    pcat_controller_unix_socket_output_watch_func,
-                    connection_data, NULL);
-                g_source_attach(connection_data->output_stream_source, NULL);
-            }
-        }
+        g_warning("Controller client stopped reading, close connection.");
     }
+    pcat_metrics_counter_add(ctrl_data->connection_reaped_metric, 1);
+
+    g_hash_table_remove(ctrl_data->control_connection_table,
+        connection_data->connection);
+
+    return FALSE;
 }
 
-static void pcat_controller_unix_socket_input_parse(
-    PCatControllerData *ctrl_data,
-    PCatControllerConnectionData *connection_data)
+static gboolean pcat_controller_deadline_source_dispatch(GSource *source,
+    GSourceFunc callback, gpointer user_data)
 {
-    gsize i;
-    gsize used_size = 0;
-    const gchar *start = (const gchar *)connection_data->input_buffer->data;
-    struct json_tokener *tokener;
-    struct json_object *root, *child;
-    const gchar *command;
-    PCatControllerCommandCallback callback;
+    return callback(user_data);
+}
 
-    for(i=0;i<connection_data->input_buffer->len;i++)
-    {
-        if(connection_data->input_buffer->data[i]==0)
-        {
-            if(i > used_size)
-            {
-                tokener = json_tokener_new();
-                root = json_tokener_parse_ex(tokener, start, i - used_size);
-                json_tokener_free(tokener);
+static GSourceFuncs g_pcat_controller_deadline_source_funcs =
+{
+    NULL,
+    NULL,
+    pcat_controller_deadline_source_dispatch,
+    NULL
+};
 
-                if(root!=NULL)
-                {
-                    command = NULL;
-                    if(json_object_object_get_ex(root, "command", &child))
-                    {
-                        command = json_object_get_string(child);
-                    }
-                    if(command!=NULL)
-                    {
-                        callback = g_hash_table_lookup(
-                            ctrl_data->command_table, command);
-                        if(callback!=NULL)
-                        {
-                            callback(ctrl_data, connection_data, command,
-                                root);
-                        }
-
-                        g_debug("Controller got command %s.", command);
-                    }
-
-                    json_object_put(root);
-                }
-            }
+static void pcat_controller_unix_socket_output_message_unlink(
+    PCatControllerConnectionData *connection_data, GList *node)
+{
+    PCatControllerOutputMessageData *message = node->data;
 
-            used_size = i + 1;
-            start = (const gchar *)connection_data->input_buffer->data +
-                i + 1;
+    if(message->topic==PCAT_CONTROLLER_OUTPUT_TOPIC_OVERFLOW)
+    {
+        if(connection_data->output_overflow_link==node)
+        {
+            connection_data->output_overflow_link = NULL;
         }
     }
-
-    if(used_size > 0)
+    else if(message->topic >= 0 &&
+        connection_data->output_topic_link[message->topic]==node)
     {
-        g_byte_array_remove_range(connection_data->input_buffer, 0, used_size);
+        connection_data->output_topic_link[message->topic] = NULL;
     }
 }
 
-static gboolean pcat_controller_unix_socket_input_watch_func(
+static gboolean pcat_controller_unix_socket_output_watch_func(
     GObject *stream, gpointer user_data)
 {
     PCatControllerData *ctrl_data = &g_pcat_controller_data;
     PCatControllerConnectionData *connection_data =
         (PCatControllerConnectionData *)user_data;
-    guint8 buffer[4096];
-    gssize rsize;
+    GOutputVector vectors[PCAT_CONTROLLER_OUTPUT_VECTOR_MAX];
+    gsize vector_count;
+    gsize request_size;
+    gsize written_size;
+    gsize message_size;
+    GList *node;
+    PCatControllerOutputMessageData *message;
+    GPollableReturn pret = G_POLLABLE_RETURN_OK;
     GError *error = NULL;
-    gboolean ret = TRUE;
+    gboolean ret = FALSE;
+    gboolean need_close = FALSE;
 
-    while((rsize=g_pollable_input_stream_read_nonblocking(
-        G_POLLABLE_INPUT_STREAM(stream), buffer, 4096, NULL, &error))>0)
+    while(!g_queue_is_empty(connection_data->output_queue))
     {
-        if(connection_data->input_buffer->len > 2097152)
+        vector_count = 0;
+        request_size = 0;
+        for(node=g_queue_peek_head_link(connection_data->output_queue);
+            node!=NULL && vector_count < PCAT_CONTROLLER_OUTPUT_VECTOR_MAX;
+            node=g_list_next(node))
         {
-            g_byte_array_remove_range(connection_data->input_buffer, 0,
-                1048576);
+            message = node->data;
+            vectors[vector_count].buffer = g_bytes_get_data(message->data,
+                &message_size);
+            vectors[vector_count].size = message_size;
+            if(vector_count==0)
+            {
+                vectors[vector_count].buffer = (const guint8 *)
+                    vectors[vector_count].buffer +
+                    connection_data->output_head_offset;
+                vectors[vector_count].size -=
+                    connection_data->output_head_offset;
+            }
+            request_size += vectors[vector_count].size;
+            vector_count++;
         }
-        g_byte_array_append(connection_data->input_buffer, buffer, rsize);
 
-        pcat_controller_unix_socket_input_parse(ctrl_data, connection_data);
-    }
+        written_size = 0;
+        pret = g_pollable_output_stream_writev_nonblocking(
+            G_POLLABLE_OUTPUT_STREAM(stream), vectors, vector_count,
+            &written_size, NULL, &error);
+        if(pret!=G_POLLABLE_RETURN_OK || written_size==0)
+        {
+            break;
+        }
 
-    if(error!=NULL)
-    {
-        if(g_error_matches(error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+        connection_data->output_queue_size -= written_size;
+        connection_data->output_timestamp = g_get_monotonic_time();
+        if(written_size < request_size)
+        {
+            pret = G_POLLABLE_RETURN_WOULD_BLOCK;
+        }
+
+        written_size += connection_data->output_head_offset;
+        while((message=g_queue_peek_head(
+            connection_data->output_queue))!=NULL)
         {
+            message_size = g_bytes_get_size(message->data);
+            if(written_size < message_size)
+            {
+                break;
+            }
 
+            written_size -= message_size;
+            pcat_controller_output_message_written(ctrl_data, message);
+            pcat_controller_unix_socket_output_message_unlink(
+                connection_data, g_queue_peek_head_link(
+                connection_data->output_queue));
+            g_queue_pop_head(connection_data->output_queue);
+            pcat_controller_output_message_data_free(message);
         }
-        else if(g_error_matches(error, G_IO_ERROR,
+        connection_data->output_head_offset = written_size;
+
+        if(pret==G_POLLABLE_RETURN_WOULD_BLOCK)
+        {
+            break;
+        }
+    }
+
+    if(error!=NULL)
+    {
+        if(g_error_matches(error, G_IO_ERROR,
             G_IO_ERROR_CONNECTION_CLOSED))
         {
             ret = FALSE;
+            need_close = TRUE;
 
             g_message("A Unix socket connection closed.");
         }
         else
         {
             ret = FALSE;
+            need_close = TRUE;
 
             g_warning("A Unix socket connection broke with error %s!",
                 error->message);
@@ -335,863 +648,3255 @@ static gboolean pcat_controller_unix_socket_input_watch_func(
 
         g_clear_error(&error);
     }
-    else if(rsize==0)
+    else if(pret==G_POLLABLE_RETURN_WOULD_BLOCK)
+    {
+        ret = TRUE;
+    }
+    else if(!g_queue_is_empty(connection_data->output_queue))
     {
         ret = FALSE;
+        need_close = TRUE;
 
         g_message("A Unix socket connection closed.");
     }
 
-    if(!ret)
+    if(need_close)
     {
         g_hash_table_remove(ctrl_data->control_connection_table,
             connection_data->connection);
     }
+    else if(!ret)
+    {
+        g_source_destroy(connection_data->output_stream_source);
+        g_source_unref(connection_data->output_stream_source);
+        connection_data->output_stream_source = NULL;
+    }
 
     return ret;
 }
 
-static gboolean pcat_controller_unix_socket_incoming_func(
-    GSocketService *service, GSocketConnection *connection,
-    GObject *source_object, gpointer user_data)
+static gboolean pcat_controller_unix_socket_seqpacket_output_watch_func(
+    GSocket *socket, GIOCondition condition, gpointer user_data)
 {
-    PCatControllerData *ctrl_data = (PCatControllerData *)user_data;
-    PCatControllerConnectionData *connection_data;
+    PCatControllerData *ctrl_data = &g_pcat_controller_data;
+    PCatControllerConnectionData *connection_data =
+        (PCatControllerConnectionData *)user_data;
+    PCatControllerOutputMessageData *message;
+    const guint8 *payload;
+    gsize payload_size;
+    gssize sret;
+    GError *error = NULL;
+    gboolean ret = FALSE;
+    gboolean need_close = FALSE;
 
-    connection_data = g_new0(PCatControllerConnectionData, 1);
-    connection_data->connection = g_object_ref(connection);
-    connection_data->input_stream = g_io_stream_get_input_stream(
-        G_IO_STREAM(connection_data->connection));
-    connection_data->output_stream = g_io_stream_get_output_stream(
-        G_IO_STREAM(connection_data->connection));
-    connection_data->input_buffer = g_byte_array_new();
-    connection_data->output_buffer = g_byte_array_new();
+    /* Each message goes out as one packet without delimiter or length
+     * header, so messages are never merged into one write. */
+    while((message=g_queue_peek_head(connection_data->output_queue))!=NULL)
+    {
+        payload = pcat_controller_codec_payload_get(message->codec,
+            message->data, &payload_size);
+        sret = g_socket_send_with_blocking(socket, (const gchar *)payload,
+            payload_size, FALSE, NULL, &error);
+        if(sret < 0)
+        {
+            break;
+        }
 
-    connection_data->input_stream_source =
-        g_pollable_input_stream_create_source(
-        G_POLLABLE_INPUT_STREAM(connection_data->input_stream), NULL);
-    g_source_set_callback(connection_data->input_stream_source,
-        (GSourceFunc)pcat_controller_unix_socket_input_watch_func,
-        connection_data, NULL);
-    g_source_attach(connection_data->input_stream_source, NULL);
+        connection_data->output_queue_size -= g_bytes_get_size(
+            message->data);
+        connection_data->output_timestamp = g_get_monotonic_time();
+        pcat_controller_output_message_written(ctrl_data, message);
+        pcat_controller_unix_socket_output_message_unlink(connection_data,
+            g_queue_peek_head_link(connection_data->output_queue));
+        g_queue_pop_head(connection_data->output_queue);
+        pcat_controller_output_message_data_free(message);
+    }
 
-    g_hash_table_replace(ctrl_data->control_connection_table,
-        connection_data->connection, connection_data);
+    if(error!=NULL)
+    {
+        if(g_error_matches(error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+        {
+            ret = TRUE;
+        }
+        else
+        {
+            need_close = TRUE;
 
-    g_message("Controller client connected.");
+            g_warning("A Unix seqpacket connection broke with error %s!",
+                error->message);
+        }
 
-    return TRUE;
+        g_clear_error(&error);
+    }
+
+    if(need_close)
+    {
+        g_hash_table_remove(ctrl_data->control_connection_table,
+            connection_data->connection);
+    }
+    else if(!ret)
+    {
+        g_source_destroy(connection_data->output_stream_source);
+        g_source_unref(connection_data->output_stream_source);
+        connection_data->output_stream_source = NULL;
+    }
+
+    return ret;
 }
 
-static gboolean pcat_controller_unix_socket_connection_check_timeout_func(
-    gpointer user_data)
+static void pcat_controller_unix_socket_output_source_ensure(
+    PCatControllerConnectionData *connection_data)
 {
-    PCatControllerData *ctrl_data = (PCatControllerData *)user_data;
-    PCatControllerConnectionData *connection_data;
-    GHashTableIter iter;
-
-    g_hash_table_iter_init(&iter, ctrl_data->control_connection_table);
-    while(g_hash_table_iter_next(&iter, NULL, (gpointer *)&connection_data))
+    if(connection_data->output_stream_source!=NULL ||
+       g_queue_is_empty(connection_data->output_queue))
     {
-        if(connection_data==NULL || connection_data->output_stream==NULL)
-        {
-            continue;
-        }
-
-        if(connection_data->output_stream_source==NULL &&
-           connection_data->output_buffer->len > 0)
-        {
-            connection_data->output_stream_source =
-                g_pollable_output_stream_create_source(
-                G_POLLABLE_OUTPUT_STREAM(connection_data->output_stream),
-                NULL);
-            g_source_set_callback(connection_data->output_stream_source,
-                (GSourceFunc)pcat_controller_unix_socket_output_watch_func,
-                connection_data, NULL);
-            g_source_attach(connection_data->output_stream_source, NULL);
-        }
+        return;
     }
 
-    return TRUE;
+    if(connection_data->seqpacket)
+    {
+        connection_data->output_stream_source = g_socket_create_source(
+            connection_data->socket, G_IO_OUT, NULL);
+        g_source_set_callback(connection_data->output_stream_source,
+            (GSourceFunc)
+            pcat_controller_unix_socket_seqpacket_output_watch_func,
+            connection_data, NULL);
+    }
+    else
+    {
+        connection_data->output_stream_source =
+            g_pollable_output_stream_create_source(
+            G_POLLABLE_OUTPUT_STREAM(connection_data->output_stream), NULL);
+        g_source_set_callback(connection_data->output_stream_source,
+            (GSourceFunc)pcat_controller_unix_socket_output_watch_func,
+            connection_data, NULL);
+    }
+    g_source_attach(connection_data->output_stream_source,
+        g_pcat_controller_data.context);
 }
 
-static void pcat_controller_command_pmu_status_func(
-    PCatControllerData *ctrl_data,
-    PCatControllerConnectionData *connection_data,
-    const gchar *command, struct json_object *root)
+static GBytes *pcat_controller_unix_socket_output_overflow_notice_new(
+    PCatControllerConnectionData *connection_data)
 {
     struct json_object *rroot, *child;
-    guint battery_voltage = 0, charger_voltage = 0, battery_percentage = 0;
-    gint board_temp;
-    gboolean on_battery = FALSE;
+    GBytes *message;
 
     rroot = json_object_new_object();
 
-    pcat_pmu_manager_pmu_status_get(&battery_voltage, &charger_voltage,
-        &on_battery, &battery_percentage);
-    board_temp = pcat_pmu_manager_board_temp_get();
-
-    child = json_object_new_string(command);
+    child = json_object_new_string("event");
     json_object_object_add(rroot, "command", child);
 
+    child = json_object_new_string("overflow");
+    json_object_object_add(rroot, "topic", child);
+
     child = json_object_new_int(0);
     json_object_object_add(rroot, "code", child);
 
-    child = json_object_new_int(battery_voltage);
-    json_object_object_add(rroot, "battery-voltage", child);
-
-    child = json_object_new_int(charger_voltage);
-    json_object_object_add(rroot, "charger-voltage", child);
+    child = json_object_new_int64(connection_data->output_dropped_messages);
+    json_object_object_add(rroot, "dropped-messages", child);
 
-    child = json_object_new_int(on_battery ? 1 : 0);
-    json_object_object_add(rroot, "on-battery", child);
+    child = json_object_new_int64(connection_data->output_dropped_bytes);
+    json_object_object_add(rroot, "dropped-bytes", child);
 
-    child = json_object_new_int(battery_percentage);
-    json_object_object_add(rroot, "charge-percentage", child);
+    message = pcat_controller_codec_encode(connection_data->codec, rroot);
+    json_object_put(rroot);
 
-    child = json_object_new_int(board_temp);
-    json_object_object_add(rroot, "board-temperature", child);
+    return message;
+}
 
-    pcat_controller_unix_socket_output_json_push(ctrl_data, connection_data,
-        rroot);
-    json_object_put(rroot);
+static gboolean pcat_controller_unix_socket_output_message_started(
+    PCatControllerConnectionData *connection_data, GList *node)
+{
+    return (node==g_queue_peek_head_link(connection_data->output_queue) &&
+        connection_data->output_head_offset > 0);
 }
 
-static void pcat_controller_command_schedule_power_event_set_func(
+static gboolean pcat_controller_unix_socket_output_queue_full(
     PCatControllerData *ctrl_data,
-    PCatControllerConnectionData *connection_data,
-    const gchar *command, struct json_object *root)
+    PCatControllerConnectionData *connection_data, gsize size)
 {
-    struct json_object *rroot, *child, *array, *node;
-    guint array_len;
-    guint i;
-    gint iv;
-    PCatManagerPowerScheduleData *sdata;
-    PCatManagerUserConfigData *uconfig_data;
-    guint count_on = 0, count_off = 0;
-    gboolean action;
-    gint y, m, d, h, min;
-    GDateTime *dt1, *dt2;
-
-    uconfig_data = pcat_main_user_config_data_get();
+    return (connection_data->output_queue_size + size >
+        ctrl_data->output_queue_size_max ||
+        g_queue_get_length(connection_data->output_queue) >=
+        ctrl_data->output_queue_message_max);
+}
 
-    if(uconfig_data->power_schedule_data!=NULL)
+static void pcat_controller_unix_socket_output_queue_trim(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data, gsize size)
+{
+    GList *node, *next;
+    PCatControllerOutputMessageData *queued_message;
+    gsize message_size;
+    guint dropped_messages = 0;
+    gsize dropped_size = 0;
+    GBytes *notice;
+
+    /* Only whole events are dropped. The message being written, the
+     * overflow notice and responses are never dropped. */
+    node = g_queue_peek_head_link(connection_data->output_queue);
+    if(node!=NULL && pcat_controller_unix_socket_output_message_started(
+        connection_data, node))
     {
-        g_ptr_array_unref(uconfig_data->power_schedule_data);
-        uconfig_data->power_schedule_data = NULL;
+        node = g_list_next(node);
     }
 
-    uconfig_data->power_schedule_data = g_ptr_array_new();
-    uconfig_data->dirty = TRUE;
-
-    if(json_object_object_get_ex(root, "event-list", &array))
+    while(node!=NULL && pcat_controller_unix_socket_output_queue_full(
+        ctrl_data, connection_data, size))
     {
-        array_len = json_object_array_length(array);
+        next = g_list_next(node);
+        queued_message = node->data;
 
-        if(array_len > 0)
+        if(queued_message->topic==PCAT_CONTROLLER_OUTPUT_TOPIC_OVERFLOW ||
+           queued_message->topic==PCAT_CONTROLLER_OUTPUT_TOPIC_RESPONSE)
         {
-            for(i=0;i<array_len;i++)
-            {
-                node = json_object_array_get_idx(array, i);
-                if(node==NULL)
-                {
-                    continue;
-                }
-
-                if(json_object_object_get_ex(node, "action", &child))
-                {
-                    action = (json_object_get_int(child)!=0);
-                }
-                if(action)
-                {
-                    count_on++;
+            node = next;
 
-                    if(count_on > 6)
-                    {
-                        continue;
-                    }
-                }
-                else
-                {
-                    count_off++;
+            continue;
+        }
 
-                    if(count_off > 6)
-                    {
-                        continue;
-                    }
-                }
+        message_size = g_bytes_get_size(queued_message->data);
+        connection_data->output_queue_size -= message_size;
+        dropped_size += message_size;
+        dropped_messages++;
 
-                sdata = g_new0(PCatManagerPowerScheduleData, 1);
-                sdata->action = action;
+        pcat_controller_unix_socket_output_message_unlink(connection_data,
+            node);
+        g_queue_delete_link(connection_data->output_queue, node);
+        pcat_controller_output_message_data_free(queued_message);
 
-                if(json_object_object_get_ex(node, "enabled", &child))
-                {
-                    iv = json_object_get_int(child);
-                    sdata->enabled = (iv!=0);
-                    sdata->enable_bits = (iv!=0 ?
-                        PCAT_MANAGER_POWER_SCHEDULE_ENABLE_MINUTE : 0);
-                }
-                if(json_object_object_get_ex(node, "enable-bits", &child))
-                {
-                    iv = json_object_get_int(child);
-                    sdata->enable_bits |= (iv & 0xFF);
-                }
-                y = 2000;
-                m = 1;
-                d = 1;
-                h = 0;
-                min = 0;
-                if(json_object_object_get_ex(node, "year", &child))
-                {
-                    y = json_object_get_int(child);
-                }
-                if(json_object_object_get_ex(node, "month", &child))
-                {
-                    m = json_object_get_int(child);
-                }
-                if(json_object_object_get_ex(node, "day", &child))
-                {
-                    d = json_object_get_int(child);
-                }
+        node = next;
+    }
 
-                if(json_object_object_get_ex(node, "hour", &child))
-                {
-                    h = json_object_get_int(child);
-                }
-                if(json_object_object_get_ex(node, "minute", &child))
-                {
-                    min = json_object_get_int(child);
-                }
+    /* Responses alone fill the queue. Dropping one would put the later
+     * ones out of step with the requests, so close the connection on
+     * the next deadline check instead. */
+    if(pcat_controller_unix_socket_output_queue_full(ctrl_data,
+        connection_data, size))
+    {
+        g_warning("Controller client is not reading its responses, close "
+            "connection!");
 
-                dt1 = g_date_time_new_local(y, m, d, h, min, 0);
-                dt2 = NULL;
-                if(dt1!=NULL)
-                {
-                    dt2 = g_date_time_to_utc(dt1);
-                    g_date_time_unref(dt1);
-                }
-                if(dt2!=NULL)
-                {
-                    sdata->year = g_date_time_get_year(dt2);
-                    sdata->month = g_date_time_get_month(dt2);
-                    sdata->day = g_date_time_get_day_of_month(dt2);
-                    sdata->hour = g_date_time_get_hour(dt2);
-                    sdata->minute = g_date_time_get_minute(dt2);
+        pcat_metrics_counter_add(ctrl_data->output_slow_consumer_metric, 1);
 
-                    g_date_time_unref(dt2);
-                }
-                else
-                {
-                    sdata->year = 2000;
-                    sdata->month = 1;
-                    sdata->day = 1;
-                    sdata->hour = 0;
-                    sdata->minute = 0;
-                }
+        connection_data->output_overflow_close = TRUE;
+        pcat_controller_connection_deadline_update(connection_data);
 
-                if(json_object_object_get_ex(node, "dow-bits", &child))
-                {
-                    sdata->dow_bits = json_object_get_int(child) & 0xFF;
-                }
+        return;
+    }
 
-                g_ptr_array_add(uconfig_data->power_schedule_data, sdata);
-            }
-        }
+    if(dropped_messages==0)
+    {
+        return;
     }
-    pcat_main_user_config_data_sync();
 
-    rroot = json_object_new_object();
+    connection_data->output_dropped_messages += dropped_messages;
+    connection_data->output_dropped_bytes += dropped_size;
+    pcat_metrics_counter_add(ctrl_data->output_dropped_messages_metric,
+        dropped_messages);
+    pcat_metrics_counter_add(ctrl_data->output_dropped_bytes_metric,
+        dropped_size);
 
-    child = json_object_new_string(command);
-    json_object_object_add(rroot, "command", child);
+    notice = pcat_controller_unix_socket_output_overflow_notice_new(
+        connection_data);
+    if(notice==NULL)
+    {
+        return;
+    }
 
-    child = json_object_new_int(0);
-    json_object_object_add(rroot, "code", child);
+    node = connection_data->output_overflow_link;
+    if(node!=NULL && !pcat_controller_unix_socket_output_message_started(
+        connection_data, node))
+    {
+        queued_message = node->data;
+        connection_data->output_queue_size -= g_bytes_get_size(
+            queued_message->data);
+        g_bytes_unref(queued_message->data);
+        queued_message->data = notice;
+        connection_data->output_queue_size += g_bytes_get_size(notice);
 
-    pcat_controller_unix_socket_output_json_push(ctrl_data, connection_data,
-        rroot);
-    json_object_put(rroot);
+        return;
+    }
 
-    pcat_pmu_manager_schedule_time_update();
+    g_warning("Controller client is consuming too slowly, dropped %u "
+        "messages (%"G_GSIZE_FORMAT" bytes)!", dropped_messages,
+        dropped_size);
+
+    pcat_metrics_counter_add(ctrl_data->output_slow_consumer_metric, 1);
+
+    queued_message = g_new0(PCatControllerOutputMessageData, 1);
+    queued_message->data = notice;
+    queued_message->topic = PCAT_CONTROLLER_OUTPUT_TOPIC_OVERFLOW;
+    queued_message->codec = connection_data->codec;
+    queued_message->command_id = -1;
+    g_queue_push_tail(connection_data->output_queue, queued_message);
+    connection_data->output_queue_size += g_bytes_get_size(notice);
+    connection_data->output_overflow_link = g_queue_peek_tail_link(
+        connection_data->output_queue);
 }
 
-static void pcat_controller_command_schedule_power_event_get_func(
-    PCatControllerData *ctrl_data,
-    PCatControllerConnectionData *connection_data,
-    const gchar *command, struct json_object *root)
+static GBytes *pcat_controller_unix_socket_output_too_large_response_new(
+    PCatControllerConnectionData *connection_data, GBytes *message)
 {
-    struct json_object *rroot, *child, *array, *node;
-    guint i;
-    PCatManagerPowerScheduleData *sdata;
-    const PCatManagerUserConfigData *uconfig_data;
-    GDateTime *dt1, *dt2;
+    struct json_object *root, *rroot, *child;
+    const guint8 *payload;
+    gsize payload_size;
+    GBytes *response;
 
-    uconfig_data = pcat_main_user_config_data_get();
+    payload = pcat_controller_codec_payload_get(connection_data->codec,
+        message, &payload_size);
+    root = pcat_controller_codec_decode(connection_data->codec, payload,
+        payload_size);
 
     rroot = json_object_new_object();
 
-    child = json_object_new_string(command);
-    json_object_object_add(rroot, "command", child);
+    if(root!=NULL && json_object_object_get_ex(root, "id", &child))
+    {
+        json_object_object_add(rroot, "id", json_object_get(child));
+    }
+    if(root!=NULL && json_object_object_get_ex(root, "command", &child))
+    {
+        json_object_object_add(rroot, "command", json_object_get(child));
+    }
 
-    child = json_object_new_int(0);
+    child = json_object_new_int(PCAT_CONTROLLER_RESPONSE_CODE_TOO_LARGE);
     json_object_object_add(rroot, "code", child);
 
-    array = json_object_new_array();
+    child = json_object_new_int64(payload_size);
+    json_object_object_add(rroot, "size", child);
 
-    if(uconfig_data->power_schedule_data!=NULL)
+    response = pcat_controller_codec_encode(connection_data->codec, rroot);
+    json_object_put(rroot);
+
+    if(root!=NULL)
     {
-        for(i=0;i<uconfig_data->power_schedule_data->len;i++)
-        {
-            sdata = g_ptr_array_index(uconfig_data->power_schedule_data, i);
-            node = json_object_new_object();
+        json_object_put(root);
+    }
 
-            child = json_object_new_int(sdata->enabled ? 1 : 0);
-            json_object_object_add(node, "enabled", child);
+    return response;
+}
 
-            child = json_object_new_int(sdata->enable_bits);
-            json_object_object_add(node, "enable-bits", child);
+static void pcat_controller_unix_socket_output_bytes_push(
+    PCatControllerConnectionData *connection_data, GBytes *message,
+    gint topic)
+{
+    PCatControllerData *ctrl_data = &g_pcat_controller_data;
+    PCatControllerOutputMessageData *queued_message;
+    GList *node;
+    gsize message_size;
+    GBytes *response;
 
-            child = json_object_new_int(sdata->action ? 1 : 0);
-            json_object_object_add(node, "action", child);
+    if(connection_data->output_overflow_close)
+    {
+        return;
+    }
 
-            dt1 = g_date_time_new_utc(sdata->year, sdata->month,
-                sdata->day, sdata->hour, sdata->minute, 0);
-            dt2 = NULL;
-            if(dt1!=NULL)
+    message_size = g_bytes_get_size(message);
+
+    /* A packet larger than the send buffer fails with EMSGSIZE on every
+     * retry, answer the request with an error code instead. */
+    if(connection_data->output_packet_size_max > 0)
+    {
+        pcat_controller_codec_payload_get(connection_data->codec, message,
+            &message_size);
+        if(message_size > connection_data->output_packet_size_max)
+        {
+            if(topic!=PCAT_CONTROLLER_OUTPUT_TOPIC_RESPONSE)
             {
-                dt2 = g_date_time_to_local(dt1);
-                g_date_time_unref(dt1);
+                g_warning("Controller event is larger than the socket send "
+                    "buffer (%"G_GSIZE_FORMAT" bytes), discard it!",
+                    message_size);
+
+                return;
             }
 
-            if(dt2!=NULL)
+            response =
+                pcat_controller_unix_socket_output_too_large_response_new(
+                connection_data, message);
+            if(response==NULL)
             {
-                child = json_object_new_int(g_date_time_get_year(dt2));
-                json_object_object_add(node, "year", child);
+                return;
+            }
 
-                child = json_object_new_int(g_date_time_get_month(dt2));
-                json_object_object_add(node, "month", child);
+            g_warning("Controller response is larger than the socket send "
+                "buffer (%"G_GSIZE_FORMAT" bytes)!", message_size);
 
-                child = json_object_new_int(g_date_time_get_day_of_month(dt2));
-                json_object_object_add(node, "day", child);
+            pcat_controller_unix_socket_output_bytes_push(connection_data,
+                response, topic);
+            g_bytes_unref(response);
 
-                child = json_object_new_int(g_date_time_get_hour(dt2));
-                json_object_object_add(node, "hour", child);
+            return;
+        }
 
-                child = json_object_new_int(g_date_time_get_minute(dt2));
-                json_object_object_add(node, "minute", child);
+        message_size = g_bytes_get_size(message);
+    }
 
-                g_date_time_unref(dt2);
-            }
-            else
-            {
-                child = json_object_new_int(2000);
-                json_object_object_add(node, "year", child);
+    if(topic >= 0 && topic!=PCAT_CONTROLLER_TOPIC_GPIO)
+    {
+        node = connection_data->output_topic_link[topic];
+        if(node!=NULL && !pcat_controller_unix_socket_output_message_started(
+            connection_data, node))
+        {
+            queued_message = node->data;
+            connection_data->output_queue_size -= g_bytes_get_size(
+                queued_message->data);
+            g_bytes_unref(queued_message->data);
+            queued_message->data = g_bytes_ref(message);
+            connection_data->output_queue_size += message_size;
+            pcat_metrics_counter_add(
+                ctrl_data->output_coalesced_messages_metric, 1);
+
+            return;
+        }
+    }
 
-                child = json_object_new_int(1);
-                json_object_object_add(node, "month", child);
+    if(pcat_controller_unix_socket_output_queue_full(ctrl_data,
+        connection_data, message_size))
+    {
+        pcat_controller_unix_socket_output_queue_trim(ctrl_data,
+            connection_data, message_size);
+        if(connection_data->output_overflow_close)
+        {
+            return;
+        }
+    }
 
-                child = json_object_new_int(1);
-                json_object_object_add(node, "day", child);
+    if(g_queue_is_empty(connection_data->output_queue))
+    {
+        connection_data->output_timestamp = g_get_monotonic_time();
+    }
+
+    queued_message = g_new0(PCatControllerOutputMessageData, 1);
+    queued_message->data = g_bytes_ref(message);
+    queued_message->topic = topic;
+    queued_message->codec = connection_data->codec;
+    queued_message->command_id = -1;
+    if(topic==PCAT_CONTROLLER_OUTPUT_TOPIC_RESPONSE)
+    {
+        queued_message->command_id = ctrl_data->command_current;
+        queued_message->timestamp = g_get_monotonic_time();
+    }
+    g_queue_push_tail(connection_data->output_queue, queued_message);
+    connection_data->output_queue_size += message_size;
+
+    if(topic >= 0 && topic!=PCAT_CONTROLLER_TOPIC_GPIO)
+    {
+        connection_data->output_topic_link[topic] = g_queue_peek_tail_link(
+            connection_data->output_queue);
+    }
+
+    pcat_controller_unix_socket_output_source_ensure(connection_data);
+    pcat_controller_connection_deadline_update(connection_data);
+}
+
+static void pcat_controller_encoded_data_clear(
+    PCatControllerEncodedData *encoded_data)
+{
+    guint i;
+
+    for(i=0;i<PCAT_CONTROLLER_CODEC_LAST;i++)
+    {
+        if(encoded_data->data[i]!=NULL)
+        {
+            g_bytes_unref(encoded_data->data[i]);
+            encoded_data->data[i] = NULL;
+        }
+    }
+
+    if(encoded_data->root!=NULL)
+    {
+        json_object_put(encoded_data->root);
+        encoded_data->root = NULL;
+    }
+}
+
+static void pcat_controller_encoded_data_set(
+    PCatControllerEncodedData *encoded_data, struct json_object *root)
+{
+    pcat_controller_encoded_data_clear(encoded_data);
+
+    encoded_data->root = json_object_get(root);
+}
+
+static GBytes *pcat_controller_encoded_data_get(
+    PCatControllerEncodedData *encoded_data, PCatControllerCodecType codec)
+{
+    PCatControllerData *ctrl_data = &g_pcat_controller_data;
+    gint64 start;
+
+    if(encoded_data->data[codec]==NULL && encoded_data->root!=NULL)
+    {
+        start = g_get_monotonic_time();
+        encoded_data->data[codec] = pcat_controller_codec_encode(codec,
+            encoded_data->root);
+        ctrl_data->command_serialize_time += g_get_monotonic_time() -
+            start;
+    }
+
+    return encoded_data->data[codec];
+}
+
+static void pcat_controller_unix_socket_output_encoded_push(
+    PCatControllerConnectionData *connection_data,
+    PCatControllerEncodedData *encoded_data, gint topic)
+{
+    GBytes *message;
+
+    message = pcat_controller_encoded_data_get(encoded_data,
+        connection_data->codec);
+    if(message!=NULL)
+    {
+        pcat_controller_unix_socket_output_bytes_push(connection_data,
+            message, topic);
+    }
+}
+
+static gint pcat_controller_response_id_get(
+    const PCatControllerRequest *request)
+{
+    gint id;
+
+    if(request==NULL)
+    {
+        return -1;
+    }
+
+    id = pcat_controller_request_member_get(request, 0, "id");
+    switch(pcat_controller_request_type_get(request, id))
+    {
+        case PCAT_CONTROLLER_REQUEST_TYPE_BOOLEAN:
+        case PCAT_CONTROLLER_REQUEST_TYPE_INT:
+        case PCAT_CONTROLLER_REQUEST_TYPE_DOUBLE:
+        case PCAT_CONTROLLER_REQUEST_TYPE_STRING:
+        {
+            return id;
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    return -1;
+}
+
+static void pcat_controller_response_id_write(
+    PCatControllerCodecWriter *writer, const PCatControllerRequest *request,
+    gint id)
+{
+    switch(pcat_controller_request_type_get(request, id))
+    {
+        case PCAT_CONTROLLER_REQUEST_TYPE_BOOLEAN:
+        {
+            pcat_controller_codec_writer_boolean(writer, "id",
+                request->tokens[id].int_value!=0);
+            break;
+        }
+        case PCAT_CONTROLLER_REQUEST_TYPE_INT:
+        {
+            pcat_controller_codec_writer_int(writer, "id",
+                pcat_controller_request_int64(request, id));
+            break;
+        }
+        case PCAT_CONTROLLER_REQUEST_TYPE_DOUBLE:
+        {
+            pcat_controller_codec_writer_double(writer, "id",
+                request->tokens[id].double_value);
+            break;
+        }
+        case PCAT_CONTROLLER_REQUEST_TYPE_STRING:
+        {
+            pcat_controller_codec_writer_string(writer, "id",
+                pcat_controller_request_string(request, id));
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+}
+
+static void pcat_controller_unix_socket_output_response_push(
+    PCatControllerConnectionData *connection_data,
+    PCatControllerEncodedData *encoded_data,
+    const PCatControllerRequest *request)
+{
+    PCatControllerCodecWriter writer;
+    struct json_object *rroot;
+    GBytes *message;
+    gint64 start;
+    gint id;
+
+    id = pcat_controller_response_id_get(request);
+
+    if(connection_data->batch_responses!=NULL)
+    {
+        if(encoded_data->root==NULL)
+        {
+            return;
+        }
+
+        if(id < 0)
+        {
+            json_object_array_add(connection_data->batch_responses,
+                json_object_get(encoded_data->root));
+            return;
+        }
+
+        rroot = json_object_new_object();
+        json_object_object_add(rroot, "id",
+            pcat_controller_request_json_new(request, id));
+        json_object_object_foreach(encoded_data->root, key, value)
+        {
+            json_object_object_add(rroot, key, json_object_get(value));
+        }
+        json_object_array_add(connection_data->batch_responses, rroot);
+
+        return;
+    }
+
+    if(id < 0)
+    {
+        pcat_controller_unix_socket_output_encoded_push(connection_data,
+            encoded_data, PCAT_CONTROLLER_OUTPUT_TOPIC_RESPONSE);
+        return;
+    }
+
+    /* Splice the cached serialization behind the id, no re-encoding. */
+    message = pcat_controller_encoded_data_get(encoded_data,
+        connection_data->codec);
+    if(message==NULL)
+    {
+        return;
+    }
+
+    start = g_get_monotonic_time();
+
+    pcat_controller_codec_writer_init(&writer, connection_data->codec);
+    pcat_controller_codec_writer_object_begin(&writer, NULL);
+    pcat_controller_response_id_write(&writer, request, id);
+    pcat_controller_codec_writer_object_merge(&writer, message);
+    pcat_controller_codec_writer_object_end(&writer);
+
+    message = pcat_controller_codec_writer_finish(&writer);
+    g_pcat_controller_data.command_serialize_time +=
+        g_get_monotonic_time() - start;
+    if(message!=NULL)
+    {
+        pcat_controller_unix_socket_output_bytes_push(connection_data,
+            message, PCAT_CONTROLLER_OUTPUT_TOPIC_RESPONSE);
+        g_bytes_unref(message);
+    }
+}
+
+static void pcat_controller_unix_socket_output_json_push(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data, struct json_object *root)
+{
+    GHashTableIter iter;
+    PCatControllerEncodedData encoded_data = {0};
+
+    if(ctrl_data==NULL || root==NULL)
+    {
+        return;
+    }
+
+    pcat_controller_encoded_data_set(&encoded_data, root);
+
+    if(connection_data!=NULL)
+    {
+        pcat_controller_unix_socket_output_response_push(connection_data,
+            &encoded_data, NULL);
+    }
+    else
+    {
+        g_hash_table_iter_init(&iter, ctrl_data->control_connection_table);
+        while(g_hash_table_iter_next(&iter, NULL,
+            (gpointer *)&connection_data))
+        {
+            pcat_controller_unix_socket_output_encoded_push(connection_data,
+                &encoded_data, PCAT_CONTROLLER_OUTPUT_TOPIC_RESPONSE);
+        }
+    }
+
+    pcat_controller_encoded_data_clear(&encoded_data);
+}
+
+static void pcat_controller_response_writer_begin(
+    PCatControllerConnectionData *connection_data,
+    PCatControllerCodecWriter *writer, const PCatControllerRequest *request,
+    const gchar *command)
+{
+    if(connection_data->batch_responses!=NULL)
+    {
+        pcat_controller_codec_writer_tree_init(writer, NULL);
+    }
+    else
+    {
+        pcat_controller_codec_writer_init(writer, connection_data->codec);
+    }
+
+    pcat_controller_codec_writer_object_begin(writer, NULL);
+    pcat_controller_response_id_write(writer, request,
+        pcat_controller_response_id_get(request));
+    pcat_controller_codec_writer_string(writer, "command", command);
+}
+
+static void pcat_controller_response_writer_push(
+    PCatControllerConnectionData *connection_data,
+    PCatControllerCodecWriter *writer)
+{
+    struct json_object *rroot;
+    GBytes *message;
+    gint64 start;
+
+    pcat_controller_codec_writer_object_end(writer);
+
+    if(writer->tree)
+    {
+        rroot = pcat_controller_codec_writer_tree_finish(writer);
+        if(rroot!=NULL && connection_data->batch_responses!=NULL)
+        {
+            json_object_array_add(connection_data->batch_responses, rroot);
+        }
+        else if(rroot!=NULL)
+        {
+            json_object_put(rroot);
+        }
+
+        return;
+    }
+
+    start = g_get_monotonic_time();
+    message = pcat_controller_codec_writer_finish(writer);
+    g_pcat_controller_data.command_serialize_time +=
+        g_get_monotonic_time() - start;
+
+    if(message!=NULL)
+    {
+        pcat_controller_unix_socket_output_bytes_push(connection_data,
+            message, PCAT_CONTROLLER_OUTPUT_TOPIC_RESPONSE);
+        g_bytes_unref(message);
+    }
+}
+
+static void pcat_controller_response_code_push(
+    PCatControllerConnectionData *connection_data,
+    const PCatControllerRequest *request, const gchar *command, gint code)
+{
+    PCatControllerCodecWriter writer;
+
+    pcat_controller_response_writer_begin(connection_data, &writer, request,
+        command);
+    pcat_controller_codec_writer_int(&writer, "code", code);
+    pcat_controller_response_writer_push(connection_data, &writer);
+}
+
+static gboolean pcat_controller_command_admit(PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    const PCatControllerRequest *request, gint command_id,
+    const gchar *command)
+{
+    PCatControllerCommandRateClass rate_class =
+        g_pcat_controller_command_info_list[command_id].rate_class;
+    PCatControllerCodecWriter writer;
+    gint64 interval, deadline, now, wait;
+
+    interval = ctrl_data->command_rate_interval[rate_class];
+    if(interval==0)
+    {
+        return TRUE;
+    }
+
+    /* A token bucket kept as the time it becomes full again, so it is
+     * refilled lazily and costs nothing while the client is quiet. */
+    now = g_get_monotonic_time();
+    deadline = MAX(connection_data->command_rate_deadline[rate_class], now);
+    wait = deadline - now - ctrl_data->command_rate_tolerance[rate_class];
+    if(wait <= 0)
+    {
+        connection_data->command_rate_deadline[rate_class] = deadline +
+            interval;
+
+        return TRUE;
+    }
+
+    pcat_metrics_counter_add(ctrl_data->command_throttled_metric[command_id],
+        1);
+
+    pcat_controller_response_writer_begin(connection_data, &writer, request,
+        command);
+    pcat_controller_codec_writer_int(&writer, "code",
+        PCAT_CONTROLLER_RESPONSE_CODE_BUSY);
+    pcat_controller_codec_writer_int(&writer, "retry-after",
+        (wait + 999) / 1000);
+    pcat_controller_response_writer_push(connection_data, &writer);
+
+    return FALSE;
+}
+
+static gboolean pcat_controller_response_cache_push(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    const PCatControllerRequest *request,
+    PCatControllerResponseCacheType type, guint generation, gint64 tag)
+{
+    PCatControllerResponseCacheData *cache_data =
+        &(ctrl_data->response_cache[type]);
+
+    if(cache_data->message.root==NULL ||
+       cache_data->generation!=generation || cache_data->tag!=tag)
+    {
+        return FALSE;
+    }
+
+    pcat_controller_unix_socket_output_response_push(connection_data,
+        &(cache_data->message), request);
+
+    return TRUE;
+}
+
+static void pcat_controller_response_cache_json_push(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    const PCatControllerRequest *request,
+    PCatControllerResponseCacheType type, guint generation, gint64 tag,
+    struct json_object *root)
+{
+    PCatControllerResponseCacheData *cache_data =
+        &(ctrl_data->response_cache[type]);
+
+    pcat_controller_encoded_data_set(&(cache_data->message), root);
+    cache_data->generation = generation;
+    cache_data->tag = tag;
+
+    pcat_controller_unix_socket_output_response_push(connection_data,
+        &(cache_data->message), request);
+}
+
+static gint pcat_controller_command_parse(
+    const PCatControllerRequest *request, const gchar **command)
+{
+    gint child;
+
+    child = pcat_controller_request_member_get(request, 0, "command");
+    *command = pcat_controller_request_string(request, child);
+    if(*command==NULL)
+    {
+        return -1;
+    }
+
+    return pcat_controller_command_lookup(*command,
+        pcat_controller_request_length_get(request, child));
+}
+
+static void pcat_controller_command_batch_continue(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data);
+static void pcat_controller_unix_socket_command_json_run(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data, struct json_object *root);
+
+static void pcat_controller_command_job_data_free(
+    PCatControllerCommandJobData *data)
+{
+    if(data==NULL)
+    {
+        return;
+    }
+
+    pcat_controller_connection_data_unref(data->connection_data);
+    json_object_put(data->root);
+    if(data->responses!=NULL)
+    {
+        json_object_put(data->responses);
+    }
+
+    g_free(data);
+}
+
+static gboolean pcat_controller_command_job_complete_func(
+    gpointer user_data)
+{
+    PCatControllerData *ctrl_data = &g_pcat_controller_data;
+    PCatControllerCommandJobData *job_data =
+        (PCatControllerCommandJobData *)user_data;
+    PCatControllerConnectionData *connection_data =
+        job_data->connection_data;
+    PCatControllerEncodedData encoded_data = {0};
+    struct json_object *root;
+    guint i, len;
+
+    if(connection_data->closed)
+    {
+        return FALSE;
+    }
+
+    /* The handler ran on the main context, its responses are encoded
+     * and written here. */
+    pcat_controller_command_stats_begin(ctrl_data, job_data->command_id);
+    len = json_object_array_length(job_data->responses);
+    for(i=0;i<len;i++)
+    {
+        pcat_controller_encoded_data_set(&encoded_data,
+            json_object_array_get_idx(job_data->responses, i));
+        pcat_controller_unix_socket_output_response_push(connection_data,
+            &encoded_data, NULL);
+    }
+    pcat_controller_encoded_data_clear(&encoded_data);
+    pcat_controller_command_stats_end(ctrl_data, job_data->handler_time);
+
+    connection_data->command_busy = FALSE;
+    pcat_controller_connection_deadline_update(connection_data);
+
+    if(connection_data->batch_root!=NULL)
+    {
+        /* The rest of the batch and its final response are accounted to
+         * the batch command, its handler time was taken when it began. */
+        pcat_controller_command_stats_begin(ctrl_data,
+            PCAT_CONTROLLER_COMMAND_BATCH);
+        connection_data->batch_index++;
+        pcat_controller_command_batch_continue(ctrl_data, connection_data);
+        pcat_controller_command_stats_observe(ctrl_data,
+            PCAT_CONTROLLER_COMMAND_BATCH,
+            PCAT_CONTROLLER_COMMAND_STAGE_SERIALIZE,
+            ctrl_data->command_serialize_time);
+        ctrl_data->command_current = -1;
+    }
+
+    while(!connection_data->command_busy &&
+        (root=g_queue_pop_head(connection_data->command_queue))!=NULL)
+    {
+        pcat_controller_unix_socket_command_json_run(ctrl_data,
+            connection_data, root);
+        json_object_put(root);
+    }
+
+    return FALSE;
+}
+
+static gboolean pcat_controller_command_job_run_func(gpointer user_data)
+{
+    PCatControllerCommandJobData *job_data =
+        (PCatControllerCommandJobData *)user_data;
+    PCatControllerConnectionData proxy_data = {0};
+    PCatControllerRequest request;
+    gint64 start;
+
+    /* Runs on the default context with the PMU and modem managers. The
+     * responses are captured and handed back to the controller thread. */
+    proxy_data.ref_count = 1;
+    proxy_data.batch_responses = json_object_new_array();
+
+    pcat_controller_request_json_init(&request, job_data->root);
+    start = g_get_monotonic_time();
+    g_pcat_controller_command_callback_list[job_data->command_id](
+        &g_pcat_controller_data, &proxy_data,
+        g_pcat_controller_command_info_list[job_data->command_id].command,
+        &request);
+    job_data->handler_time = g_get_monotonic_time() - start;
+    pcat_controller_request_clear(&request);
+
+    job_data->responses = proxy_data.batch_responses;
+
+    g_main_context_invoke_full(g_pcat_controller_data.context,
+        G_PRIORITY_DEFAULT, pcat_controller_command_job_complete_func,
+        job_data, (GDestroyNotify)pcat_controller_command_job_data_free);
+
+    return FALSE;
+}
+
+static void pcat_controller_command_job_submit(
+    PCatControllerConnectionData *connection_data, gint command_id,
+    struct json_object *root)
+{
+    PCatControllerCommandJobData *job_data;
+
+    job_data = g_new0(PCatControllerCommandJobData, 1);
+    job_data->connection_data = pcat_controller_connection_data_ref(
+        connection_data);
+    job_data->command_id = command_id;
+    job_data->root = root;
+
+    /* Later requests of this connection wait, so responses keep the
+     * request order. */
+    connection_data->command_busy = TRUE;
+
+    g_main_context_invoke(NULL, pcat_controller_command_job_run_func,
+        job_data);
+}
+
+static void pcat_controller_unix_socket_command_run(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    const PCatControllerRequest *request)
+{
+    const gchar *command;
+    gint command_id;
+    gint64 start;
+    PCatControllerCommandCallback callback;
+
+    command_id = pcat_controller_command_parse(request, &command);
+    if(command_id >= 0)
+    {
+        pcat_metrics_counter_add(ctrl_data->command_metric[command_id], 1);
+
+        callback = g_pcat_controller_command_callback_list[command_id];
+        if(callback!=NULL && !pcat_controller_command_admit(ctrl_data,
+           connection_data, request, command_id, command))
+        {
+            callback = NULL;
+        }
+
+        if(callback!=NULL && (g_pcat_controller_command_info_list[
+            command_id].flags & PCAT_CONTROLLER_COMMAND_FLAG_WRITE))
+        {
+            pcat_controller_command_job_submit(connection_data, command_id,
+                pcat_controller_request_json_new(request, 0));
+        }
+        else if(callback!=NULL)
+        {
+            start = g_get_monotonic_time();
+            pcat_controller_command_stats_begin(ctrl_data, command_id);
+            callback(ctrl_data, connection_data, command, request);
+            pcat_controller_command_stats_end(ctrl_data,
+                g_get_monotonic_time() - start -
+                ctrl_data->command_serialize_time);
+        }
+    }
+    if(command!=NULL)
+    {
+        g_debug("Controller got command %s.", command);
+    }
+}
+
+static void pcat_controller_unix_socket_command_json_run(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data, struct json_object *root)
+{
+    PCatControllerRequest request;
+
+    if(pcat_controller_request_json_init(&request, root))
+    {
+        pcat_controller_unix_socket_command_run(ctrl_data, connection_data,
+            &request);
+    }
+    pcat_controller_request_clear(&request);
+}
+
+static gboolean pcat_controller_command_hello_codec_get(
+    PCatControllerConnectionData *connection_data,
+    const PCatControllerRequest *request, PCatControllerCodecType *codec)
+{
+    *codec = connection_data->codec;
+
+    if(pcat_controller_request_member_get(request, 0, "encoding") < 0)
+    {
+        return TRUE;
+    }
+
+    if(!pcat_controller_codec_name_parse(
+        pcat_controller_request_string_get(request, 0, "encoding"), codec))
+    {
+        *codec = connection_data->codec;
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void pcat_controller_unix_socket_command_dispatch(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    const PCatControllerRequest *request)
+{
+    const gchar *command;
+    gint command_id;
+    PCatControllerCodecType codec;
+
+    command_id = pcat_controller_command_parse(request, &command);
+
+    if(connection_data->command_busy &&
+       g_queue_get_length(connection_data->command_queue) >=
+       PCAT_CONTROLLER_COMMAND_QUEUE_MAX)
+    {
+        /* Answered ahead of the queued requests, the client matches it
+         * by its request id. */
+        g_warning("Controller command queue is full, reject request!");
+        pcat_controller_response_code_push(connection_data, request,
+            command, PCAT_CONTROLLER_RESPONSE_CODE_BUSY);
+
+        return;
+    }
+
+    /* A hello may wait behind a write job while the input keeps being
+     * read, so frames following it are decoded in the new encoding from
+     * here on. Its response and later ones switch when it runs. */
+    if(command_id==PCAT_CONTROLLER_COMMAND_HELLO &&
+       pcat_controller_command_hello_codec_get(connection_data, request,
+       &codec) && codec!=connection_data->input_codec)
+    {
+        connection_data->input_codec = codec;
+        g_byte_array_set_size(connection_data->input_frame_buffer, 0);
+        connection_data->input_frame_discard_size = 0;
+    }
+
+    /* Parsing started when the last segment of the message was read. */
+    if(command_id >= 0)
+    {
+        ctrl_data->command_stats[command_id].count++;
+        pcat_controller_command_stats_observe(ctrl_data, command_id,
+            PCAT_CONTROLLER_COMMAND_STAGE_PARSE, g_get_monotonic_time() -
+            ctrl_data->command_parse_timestamp);
+    }
+
+    if(connection_data->command_busy)
+    {
+
+        /* Queued requests outlive the input buffer. */
+        g_queue_push_tail(connection_data->command_queue,
+            pcat_controller_request_json_new(request, 0));
+
+        return;
+    }
+
+    pcat_controller_unix_socket_command_run(ctrl_data, connection_data,
+        request);
+}
+
+static void pcat_controller_unix_socket_command_json_dispatch(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data, struct json_object *root)
+{
+    PCatControllerRequest request;
+
+    if(pcat_controller_request_json_init(&request, root))
+    {
+        pcat_controller_unix_socket_command_dispatch(ctrl_data,
+            connection_data, &request);
+    }
+    pcat_controller_request_clear(&request);
+}
+
+static gsize pcat_controller_unix_socket_input_json_parse(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data, guint8 *data,
+    gsize len)
+{
+    const guint8 *end;
+    gsize segment_size;
+    struct json_object *root;
+    PCatControllerRequest request;
+
+    end = memchr(data, 0, len);
+    segment_size = (end!=NULL) ? (gsize)(end - data) : len;
+
+    /* A whole message in this read is parsed in place, without going
+     * through json-c unless it is something the pull parser rejects. */
+    if(end!=NULL && connection_data->input_message_size==0 &&
+       segment_size > 0 && segment_size <=
+       PCAT_CONTROLLER_INPUT_MESSAGE_SIZE_MAX &&
+       pcat_controller_request_parse(&request, (gchar *)data, segment_size))
+    {
+        pcat_controller_unix_socket_command_dispatch(ctrl_data,
+            connection_data, &request);
+        pcat_controller_request_clear(&request);
+
+        return segment_size + 1;
+    }
+
+    connection_data->input_message_size += segment_size;
+    if(connection_data->input_message_size >
+       PCAT_CONTROLLER_INPUT_MESSAGE_SIZE_MAX &&
+       !connection_data->input_message_discard)
+    {
+        g_warning("Controller input message is larger than %u bytes, "
+            "discard it!", PCAT_CONTROLLER_INPUT_MESSAGE_SIZE_MAX);
+
+        connection_data->input_message_discard = TRUE;
+    }
+
+    if(!connection_data->input_message_discard &&
+       connection_data->input_root==NULL && segment_size > 0)
+    {
+        root = json_tokener_parse_ex(connection_data->input_tokener,
+            (const gchar *)data, segment_size);
+        if(root!=NULL)
+        {
+            connection_data->input_root = root;
+        }
+        else if(json_tokener_get_error(connection_data->input_tokener)!=
+            json_tokener_continue)
+        {
+            connection_data->input_message_discard = TRUE;
+        }
+    }
+
+    if(end==NULL)
+    {
+        return len;
+    }
+
+    root = connection_data->input_root;
+    connection_data->input_root = NULL;
+
+    json_tokener_reset(connection_data->input_tokener);
+    connection_data->input_message_size = 0;
+
+    if(root!=NULL)
+    {
+        if(!connection_data->input_message_discard)
+        {
+            pcat_controller_unix_socket_command_json_dispatch(ctrl_data,
+                connection_data, root);
+        }
+
+        json_object_put(root);
+    }
+
+    connection_data->input_message_discard = FALSE;
+
+    return segment_size + 1;
+}
+
+static gsize pcat_controller_unix_socket_input_frame_parse(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data, guint8 *data,
+    gsize len)
+{
+    GByteArray *buffer = connection_data->input_frame_buffer;
+    gsize frame_size;
+    gsize used_size;
+    struct json_object *root;
+
+    if(connection_data->input_frame_discard_size > 0)
+    {
+        used_size = MIN(connection_data->input_frame_discard_size, len);
+        connection_data->input_frame_discard_size -= used_size;
+
+        return used_size;
+    }
+
+    if(buffer->len < PCAT_CONTROLLER_CODEC_FRAME_HEADER_SIZE)
+    {
+        used_size = MIN(PCAT_CONTROLLER_CODEC_FRAME_HEADER_SIZE -
+            buffer->len, len);
+        g_byte_array_append(buffer, data, used_size);
+
+        if(buffer->len==PCAT_CONTROLLER_CODEC_FRAME_HEADER_SIZE)
+        {
+            frame_size = ((gsize)buffer->data[0] << 24) |
+                ((gsize)buffer->data[1] << 16) |
+                ((gsize)buffer->data[2] << 8) | buffer->data[3];
+            if(frame_size > PCAT_CONTROLLER_INPUT_MESSAGE_SIZE_MAX)
+            {
+                g_warning("Controller input message is larger than %u "
+                    "bytes, discard it!",
+                    PCAT_CONTROLLER_INPUT_MESSAGE_SIZE_MAX);
+
+                connection_data->input_frame_discard_size = frame_size;
+                g_byte_array_set_size(buffer, 0);
+            }
+            else if(frame_size==0)
+            {
+                g_byte_array_set_size(buffer, 0);
+            }
+        }
+
+        return used_size;
+    }
+
+    frame_size = ((gsize)buffer->data[0] << 24) |
+        ((gsize)buffer->data[1] << 16) |
+        ((gsize)buffer->data[2] << 8) | buffer->data[3];
+    used_size = MIN(PCAT_CONTROLLER_CODEC_FRAME_HEADER_SIZE + frame_size -
+        buffer->len, len);
+    g_byte_array_append(buffer, data, used_size);
+
+    if(buffer->len==PCAT_CONTROLLER_CODEC_FRAME_HEADER_SIZE + frame_size)
+    {
+        root = pcat_controller_codec_decode(connection_data->input_codec,
+            buffer->data + PCAT_CONTROLLER_CODEC_FRAME_HEADER_SIZE,
+            frame_size);
+        g_byte_array_set_size(buffer, 0);
+
+        if(root!=NULL)
+        {
+            pcat_controller_unix_socket_command_json_dispatch(ctrl_data,
+                connection_data, root);
+            json_object_put(root);
+        }
+    }
+
+    return used_size;
+}
+
+static void pcat_controller_unix_socket_input_parse(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data, guint8 *data,
+    gsize len)
+{
+    gsize used_size;
+
+    while(len > 0)
+    {
+        ctrl_data->command_parse_timestamp = g_get_monotonic_time();
+
+        if(connection_data->input_codec==PCAT_CONTROLLER_CODEC_JSON)
+        {
+            used_size = pcat_controller_unix_socket_input_json_parse(
+                ctrl_data, connection_data, data, len);
+        }
+        else
+        {
+            used_size = pcat_controller_unix_socket_input_frame_parse(
+                ctrl_data, connection_data, data, len);
+        }
+
+        data += used_size;
+        len -= used_size;
+    }
+}
+
+static gboolean pcat_controller_unix_socket_input_watch_func(
+    GObject *stream, gpointer user_data)
+{
+    PCatControllerData *ctrl_data = &g_pcat_controller_data;
+    PCatControllerConnectionData *connection_data =
+        (PCatControllerConnectionData *)user_data;
+    guint8 buffer[4096];
+    gssize rsize;
+    GError *error = NULL;
+    gboolean ret = TRUE;
+
+    while((rsize=g_pollable_input_stream_read_nonblocking(
+        G_POLLABLE_INPUT_STREAM(stream), buffer, 4096, NULL, &error))>0)
+    {
+        connection_data->input_timestamp = g_get_monotonic_time();
+        pcat_controller_unix_socket_input_parse(ctrl_data, connection_data,
+            buffer, rsize);
+    }
+
+    if(error!=NULL)
+    {
+        if(g_error_matches(error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+        {
+
+        }
+        else if(g_error_matches(error, G_IO_ERROR,
+            G_IO_ERROR_CONNECTION_CLOSED))
+        {
+            ret = FALSE;
+
+            g_message("A Unix socket connection closed.");
+        }
+        else
+        {
+            ret = FALSE;
+
+            g_warning("A Unix socket connection broke with error %s!",
+                error->message);
+        }
+
+        g_clear_error(&error);
+    }
+    else if(rsize==0)
+    {
+        ret = FALSE;
+
+        g_message("A Unix socket connection closed.");
+    }
+
+    if(!ret)
+    {
+        g_hash_table_remove(ctrl_data->control_connection_table,
+            connection_data->connection);
+    }
+
+    return ret;
+}
+
+static void pcat_controller_unix_socket_seqpacket_input_parse(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data, guint8 *data,
+    gsize len)
+{
+    struct json_object *root;
+    PCatControllerRequest request;
+
+    ctrl_data->command_parse_timestamp = g_get_monotonic_time();
+
+    if(connection_data->input_codec==PCAT_CONTROLLER_CODEC_JSON)
+    {
+        if(len > 0 && data[len-1]=='\0')
+        {
+            len--;
+        }
+        if(len==0)
+        {
+            return;
+        }
+
+        if(pcat_controller_request_parse(&request, (gchar *)data, len))
+        {
+            pcat_controller_unix_socket_command_dispatch(ctrl_data,
+                connection_data, &request);
+            pcat_controller_request_clear(&request);
+
+            return;
+        }
+
+        json_tokener_reset(connection_data->input_tokener);
+        root = json_tokener_parse_ex(connection_data->input_tokener,
+            (const gchar *)data, len);
+    }
+    else
+    {
+        root = pcat_controller_codec_decode(connection_data->input_codec, data,
+            len);
+    }
+
+    if(root!=NULL)
+    {
+        pcat_controller_unix_socket_command_json_dispatch(ctrl_data,
+            connection_data, root);
+        json_object_put(root);
+    }
+}
+
+static gboolean pcat_controller_unix_socket_seqpacket_input_watch_func(
+    GSocket *socket, GIOCondition condition, gpointer user_data)
+{
+    PCatControllerData *ctrl_data = &g_pcat_controller_data;
+    PCatControllerConnectionData *connection_data =
+        (PCatControllerConnectionData *)user_data;
+    GByteArray *buffer = connection_data->input_frame_buffer;
+    struct pollfd pfd;
+    gint fd;
+    gssize rsize;
+    gboolean ret = TRUE;
+
+    fd = g_socket_get_fd(socket);
+
+    while(TRUE)
+    {
+        /* The kernel keeps packet boundaries, peek the size of the next
+         * request so it can be read in one go. */
+        rsize = recv(fd, NULL, 0, MSG_PEEK | MSG_TRUNC | MSG_DONTWAIT);
+        if(rsize < 0)
+        {
+            if(errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=EINTR)
+            {
+                ret = FALSE;
+
+                g_warning("A Unix seqpacket connection broke with "
+                    "error %s!", g_strerror(errno));
+            }
+
+            break;
+        }
+        else if(rsize==0)
+        {
+            /* An empty packet also reads as zero bytes, only a shutdown
+             * peer means the connection is closed. */
+            pfd.fd = fd;
+            pfd.events = POLLRDHUP;
+            pfd.revents = 0;
+            if(poll(&pfd, 1, 0) > 0 &&
+               (pfd.revents & (POLLRDHUP | POLLHUP))!=0)
+            {
+                ret = FALSE;
+
+                g_message("A Unix seqpacket connection closed.");
+
+                break;
+            }
+
+            recv(fd, NULL, 0, MSG_DONTWAIT);
+
+            continue;
+        }
+
+        if(rsize > PCAT_CONTROLLER_INPUT_MESSAGE_SIZE_MAX)
+        {
+            g_warning("Controller input message is larger than %u bytes, "
+                "discard it!", PCAT_CONTROLLER_INPUT_MESSAGE_SIZE_MAX);
+
+            recv(fd, NULL, 0, MSG_DONTWAIT);
+
+            continue;
+        }
+
+        g_byte_array_set_size(buffer, rsize);
+        rsize = recv(fd, buffer->data, buffer->len, MSG_DONTWAIT);
+        if(rsize <= 0)
+        {
+            continue;
+        }
+
+        connection_data->input_timestamp = g_get_monotonic_time();
+        pcat_controller_unix_socket_seqpacket_input_parse(ctrl_data,
+            connection_data, buffer->data, rsize);
+    }
+
+    g_byte_array_set_size(buffer, 0);
+
+    if(!ret)
+    {
+        g_hash_table_remove(ctrl_data->control_connection_table,
+            connection_data->connection);
+    }
+
+    return ret;
+}
+
+static gboolean pcat_controller_unix_socket_incoming_func(
+    GSocketService *service, GSocketConnection *connection,
+    GObject *source_object, gpointer user_data)
+{
+    PCatControllerData *ctrl_data = (PCatControllerData *)user_data;
+    PCatControllerConnectionData *connection_data;
+    gint sndbuf;
+
+    if(g_hash_table_size(ctrl_data->control_connection_table) >=
+       ctrl_data->connection_max)
+    {
+        g_warning("Controller already has %u clients, reject new "
+            "connection!", ctrl_data->connection_max);
+        pcat_metrics_counter_add(ctrl_data->connection_rejected_metric, 1);
+
+        return TRUE;
+    }
+
+    connection_data = g_new0(PCatControllerConnectionData, 1);
+    connection_data->ref_count = 1;
+    connection_data->connection = g_object_ref(connection);
+    connection_data->socket = g_socket_connection_get_socket(connection);
+    connection_data->seqpacket = (g_socket_get_socket_type(
+        connection_data->socket)==G_SOCKET_TYPE_SEQPACKET);
+    if(connection_data->seqpacket && g_socket_get_option(
+        connection_data->socket, SOL_SOCKET, SO_SNDBUF, &sndbuf, NULL) &&
+        sndbuf > PCAT_CONTROLLER_SEQPACKET_SNDBUF_RESERVE)
+    {
+        connection_data->output_packet_size_max = sndbuf -
+            PCAT_CONTROLLER_SEQPACKET_SNDBUF_RESERVE;
+    }
+    connection_data->input_stream = g_io_stream_get_input_stream(
+        G_IO_STREAM(connection_data->connection));
+    connection_data->output_stream = g_io_stream_get_output_stream(
+        G_IO_STREAM(connection_data->connection));
+    connection_data->input_tokener = json_tokener_new();
+    connection_data->input_frame_buffer = g_byte_array_new();
+    connection_data->codec = PCAT_CONTROLLER_CODEC_JSON;
+    connection_data->input_codec = PCAT_CONTROLLER_CODEC_JSON;
+    connection_data->output_queue = g_queue_new();
+    connection_data->command_queue = g_queue_new();
+
+    if(connection_data->seqpacket)
+    {
+        connection_data->input_stream_source = g_socket_create_source(
+            connection_data->socket, G_IO_IN, NULL);
+        g_source_set_callback(connection_data->input_stream_source,
+            (GSourceFunc)
+            pcat_controller_unix_socket_seqpacket_input_watch_func,
+            connection_data, NULL);
+    }
+    else
+    {
+        connection_data->input_stream_source =
+            g_pollable_input_stream_create_source(
+            G_POLLABLE_INPUT_STREAM(connection_data->input_stream), NULL);
+        g_source_set_callback(connection_data->input_stream_source,
+            (GSourceFunc)pcat_controller_unix_socket_input_watch_func,
+            connection_data, NULL);
+    }
+    g_source_attach(connection_data->input_stream_source,
+        ctrl_data->context);
+
+    connection_data->input_timestamp = g_get_monotonic_time();
+    connection_data->deadline_source = g_source_new(
+        &g_pcat_controller_deadline_source_funcs, sizeof(GSource));
+    g_source_set_callback(connection_data->deadline_source,
+        pcat_controller_connection_deadline_func, connection_data, NULL);
+    g_source_set_ready_time(connection_data->deadline_source,
+        connection_data->input_timestamp +
+        ctrl_data->connection_idle_timeout);
+    g_source_attach(connection_data->deadline_source, ctrl_data->context);
+
+    g_hash_table_replace(ctrl_data->control_connection_table,
+        connection_data->connection, connection_data);
+
+    pcat_metrics_gauge_add(ctrl_data->connection_metric, 1);
+    pcat_metrics_counter_add(ctrl_data->connection_total_metric, 1);
+
+    g_message("Controller client connected.");
+
+    return TRUE;
+}
+
+static void pcat_controller_pmu_status_fill(struct json_object *rroot)
+{
+    struct json_object *child;
+    guint battery_voltage = 0, charger_voltage = 0, battery_percentage = 0;
+    gint board_temp;
+    gboolean on_battery = FALSE;
+
+    pcat_pmu_manager_pmu_status_get(&battery_voltage, &charger_voltage,
+        &on_battery, &battery_percentage);
+    board_temp = pcat_pmu_manager_board_temp_get();
+
+    child = json_object_new_int(battery_voltage);
+    json_object_object_add(rroot, "battery-voltage", child);
+
+    child = json_object_new_int(charger_voltage);
+    json_object_object_add(rroot, "charger-voltage", child);
+
+    child = json_object_new_int(on_battery ? 1 : 0);
+    json_object_object_add(rroot, "on-battery", child);
+
+    child = json_object_new_int(battery_percentage);
+    json_object_object_add(rroot, "charge-percentage", child);
+
+    child = json_object_new_int(board_temp);
+    json_object_object_add(rroot, "board-temperature", child);
+}
+
+static PCatControllerEncodedData *pcat_controller_pmu_status_cache_get(
+    PCatControllerData *ctrl_data)
+{
+    PCatControllerResponseCacheData *cache_data =
+        &(ctrl_data->response_cache[PCAT_CONTROLLER_RESPONSE_CACHE_PMU_STATUS]);
+    struct json_object *rroot, *child;
+    guint generation;
+
+    generation = ctrl_data->topic_generation[PCAT_CONTROLLER_TOPIC_BATTERY];
+    if(cache_data->message.root!=NULL && cache_data->generation==generation)
+    {
+        return &(cache_data->message);
+    }
+
+    rroot = json_object_new_object();
+
+    child = json_object_new_string(g_pcat_controller_command_info_list[
+        PCAT_CONTROLLER_COMMAND_PMU_STATUS].command);
+    json_object_object_add(rroot, "command", child);
+
+    child = json_object_new_int(0);
+    json_object_object_add(rroot, "code", child);
+
+    pcat_controller_pmu_status_fill(rroot);
+
+    pcat_controller_encoded_data_set(&(cache_data->message), rroot);
+    cache_data->generation = generation;
+    cache_data->tag = 0;
+    json_object_put(rroot);
+
+    return &(cache_data->message);
+}
+
+static void pcat_controller_command_pmu_status_func(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    const gchar *command, const PCatControllerRequest *request)
+{
+    pcat_controller_unix_socket_output_response_push(connection_data,
+        pcat_controller_pmu_status_cache_get(ctrl_data), request);
+}
+
+static void pcat_controller_command_schedule_power_event_set_func(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    const gchar *command, const PCatControllerRequest *request)
+{
+    gint array, node;
+    gint iv, ret;
+    PCatManagerPowerScheduleData *sdata;
+    PCatManagerUserConfigData *uconfig_data;
+    GPtrArray *schedule_data;
+    guint count_on = 0, count_off = 0;
+    gboolean action;
+    gint y, m, d, h, min;
+    GDateTime *dt1, *dt2;
+
+    schedule_data = g_ptr_array_new_with_free_func(g_free);
+
+    array = pcat_controller_request_member_get(request, 0, "event-list");
+    if(pcat_controller_request_type_get(request, array)==
+       PCAT_CONTROLLER_REQUEST_TYPE_ARRAY)
+    {
+        for(node=pcat_controller_request_child_next(request, array, -1);
+            node >= 0;
+            node=pcat_controller_request_child_next(request, array, node))
+        {
+            if(pcat_controller_request_type_get(request, node)!=
+               PCAT_CONTROLLER_REQUEST_TYPE_OBJECT)
+            {
+                g_ptr_array_unref(schedule_data);
+                pcat_controller_response_code_push(connection_data, request,
+                    command, 1);
+
+                return;
+            }
+
+            action = FALSE;
+            if(pcat_controller_request_int_get(request, node, "action", &iv))
+            {
+                action = (iv!=0);
+            }
+            if(action)
+            {
+                count_on++;
+
+                if(count_on > 6)
+                {
+                    continue;
+                }
+            }
+            else
+            {
+                count_off++;
+
+                if(count_off > 6)
+                {
+                    continue;
+                }
+            }
+
+            sdata = g_new0(PCatManagerPowerScheduleData, 1);
+            sdata->action = action;
+
+            if(pcat_controller_request_int_get(request, node, "enabled", &iv))
+            {
+                sdata->enabled = (iv!=0);
+                sdata->enable_bits = (iv!=0 ?
+                    PCAT_MANAGER_POWER_SCHEDULE_ENABLE_MINUTE : 0);
+            }
+            if(pcat_controller_request_int_get(request, node, "enable-bits",
+                &iv))
+            {
+                sdata->enable_bits |= (iv & 0xFF);
+            }
+            y = 2000;
+            m = 1;
+            d = 1;
+            h = 0;
+            min = 0;
+            pcat_controller_request_int_get(request, node, "year", &y);
+            pcat_controller_request_int_get(request, node, "month", &m);
+            pcat_controller_request_int_get(request, node, "day", &d);
+            pcat_controller_request_int_get(request, node, "hour", &h);
+            pcat_controller_request_int_get(request, node, "minute", &min);
+
+            dt1 = g_date_time_new_local(y, m, d, h, min, 0);
+            dt2 = NULL;
+            if(dt1!=NULL)
+            {
+                dt2 = g_date_time_to_utc(dt1);
+                g_date_time_unref(dt1);
+            }
+            if(dt2!=NULL)
+            {
+                sdata->year = g_date_time_get_year(dt2);
+                sdata->month = g_date_time_get_month(dt2);
+                sdata->day = g_date_time_get_day_of_month(dt2);
+                sdata->hour = g_date_time_get_hour(dt2);
+                sdata->minute = g_date_time_get_minute(dt2);
+
+                g_date_time_unref(dt2);
+            }
+            else
+            {
+                sdata->year = 2000;
+                sdata->month = 1;
+                sdata->day = 1;
+                sdata->hour = 0;
+                sdata->minute = 0;
+            }
+
+            if(pcat_controller_request_int_get(request, node, "dow-bits", &iv))
+            {
+                sdata->dow_bits = iv & 0xFF;
+            }
+
+            g_ptr_array_add(schedule_data, sdata);
+        }
+    }
+
+    uconfig_data = pcat_main_user_config_data_edit();
+    g_ptr_array_unref(uconfig_data->power_schedule_data);
+    uconfig_data->power_schedule_data = schedule_data;
+    ret = pcat_main_user_config_data_commit(uconfig_data) ? 0 : 1;
+
+    pcat_controller_response_code_push(connection_data, request, command,
+        ret);
+
+    pcat_pmu_manager_schedule_time_update();
+
+    pcat_controller_topic_state_changed(PCAT_CONTROLLER_TOPIC_SCHEDULE);
+}
+
+static void pcat_controller_schedule_power_event_fill(
+    struct json_object *rroot)
+{
+    struct json_object *child, *array, *node;
+    guint i;
+    PCatManagerPowerScheduleData *sdata;
+    const PCatManagerUserConfigData *uconfig_data;
+    GDateTime *dt1, *dt2;
+
+    uconfig_data = pcat_main_user_config_data_get();
+
+    array = json_object_new_array();
+
+    if(uconfig_data->power_schedule_data!=NULL)
+    {
+        for(i=0;i<uconfig_data->power_schedule_data->len;i++)
+        {
+            sdata = g_ptr_array_index(uconfig_data->power_schedule_data, i);
+            node = json_object_new_object();
+
+            child = json_object_new_int(sdata->enabled ? 1 : 0);
+            json_object_object_add(node, "enabled", child);
+
+            child = json_object_new_int(sdata->enable_bits);
+            json_object_object_add(node, "enable-bits", child);
+
+            child = json_object_new_int(sdata->action ? 1 : 0);
+            json_object_object_add(node, "action", child);
+
+            dt1 = g_date_time_new_utc(sdata->year, sdata->month,
+                sdata->day, sdata->hour, sdata->minute, 0);
+            dt2 = NULL;
+            if(dt1!=NULL)
+            {
+                dt2 = g_date_time_to_local(dt1);
+                g_date_time_unref(dt1);
+            }
+
+            if(dt2!=NULL)
+            {
+                child = json_object_new_int(g_date_time_get_year(dt2));
+                json_object_object_add(node, "year", child);
+
+                child = json_object_new_int(g_date_time_get_month(dt2));
+                json_object_object_add(node, "month", child);
+
+                child = json_object_new_int(g_date_time_get_day_of_month(dt2));
+                json_object_object_add(node, "day", child);
+
+                child = json_object_new_int(g_date_time_get_hour(dt2));
+                json_object_object_add(node, "hour", child);
+
+                child = json_object_new_int(g_date_time_get_minute(dt2));
+                json_object_object_add(node, "minute", child);
+
+                g_date_time_unref(dt2);
+            }
+            else
+            {
+                child = json_object_new_int(2000);
+                json_object_object_add(node, "year", child);
+
+                child = json_object_new_int(1);
+                json_object_object_add(node, "month", child);
+
+                child = json_object_new_int(1);
+                json_object_object_add(node, "day", child);
+
+                child = json_object_new_int(0);
+                json_object_object_add(node, "hour", child);
+
+                child = json_object_new_int(0);
+                json_object_object_add(node, "minute", child);
+            }
+
+            child = json_object_new_int(sdata->dow_bits);
+            json_object_object_add(node, "dow-bits", child);
+
+            json_object_array_add(array, node);
+        }
+    }
+
+    pcat_main_user_config_data_unref(uconfig_data);
+
+    json_object_object_add(rroot, "event-list", array);
+}
+
+static void pcat_controller_command_schedule_power_event_get_func(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    const gchar *command, const PCatControllerRequest *request)
+{
+    struct json_object *rroot, *child;
+    guint generation;
+
+    generation = ctrl_data->topic_generation[PCAT_CONTROLLER_TOPIC_SCHEDULE];
+    if(pcat_controller_response_cache_push(ctrl_data, connection_data,
+        request, PCAT_CONTROLLER_RESPONSE_CACHE_SCHEDULE_POWER_EVENT,
+        generation, 0))
+    {
+        return;
+    }
+
+    rroot = json_object_new_object();
+
+    child = json_object_new_string(command);
+    json_object_object_add(rroot, "command", child);
+
+    child = json_object_new_int(0);
+    json_object_object_add(rroot, "code", child);
+
+    pcat_controller_schedule_power_event_fill(rroot);
+
+    pcat_controller_response_cache_json_push(ctrl_data, connection_data,
+        request, PCAT_CONTROLLER_RESPONSE_CACHE_SCHEDULE_POWER_EVENT,
+        generation, 0, rroot);
+    json_object_put(rroot);
+}
+
+static void pcat_controller_modem_status_fill(
+    PCatControllerCodecWriter *writer)
+{
+    PCatModemManagerMode mode = PCAT_MODEM_MANAGER_MODE_NONE;
+    PCatModemManagerSIMState sim_state = PCAT_MODEM_MANAGER_SIM_STATE_ABSENT;
+    gint signal_strength = 0;
+    gchar *isp_name = NULL;
+    gchar *isp_plmn = NULL;
+    gint code = 0;
+    const gchar *mode_str = "none", *sim_state_str = "absent";
+    gboolean rfkill_state = FALSE;
+
+    if(!pcat_modem_manager_status_get(&mode, &sim_state, &rfkill_state,
+        &signal_strength, &isp_name, &isp_plmn))
+    {
+        code = 1;
+    }
+
+    pcat_controller_codec_writer_int(writer, "code", code);
+
+    switch(mode)
+    {
+        case PCAT_MODEM_MANAGER_MODE_2G:
+        {
+            mode_str = "2g";
+            break;
+        }
+        case PCAT_MODEM_MANAGER_MODE_3G:
+        {
+            mode_str = "3g";
+            break;
+        }
+        case PCAT_MODEM_MANAGER_MODE_LTE:
+        {
+            mode_str = "lte";
+            break;
+        }
+        case PCAT_MODEM_MANAGER_MODE_5G:
+        {
+            mode_str = "5g";
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    switch(sim_state)
+    {
+        case PCAT_MODEM_MANAGER_SIM_STATE_ABSENT:
+        {
+            sim_state_str = "absent";
+            break;
+        }
+        case PCAT_MODEM_MANAGER_SIM_STATE_NOT_READY:
+        {
+            sim_state_str = "not-ready";
+            break;
+        }
+        case PCAT_MODEM_MANAGER_SIM_STATE_READY:
+        {
+            sim_state_str = "ready";
+            break;
+        }
+        case PCAT_MODEM_MANAGER_SIM_STATE_PIN:
+        {
+            sim_state_str = "need-pin";
+            break;
+        }
+        case PCAT_MODEM_MANAGER_SIM_STATE_PUK:
+        {
+            sim_state_str = "need-puk";
+            break;
+        }
+        case PCAT_MODEM_MANAGER_SIM_STATE_NETWORK_PERSONALIZATION:
+        {
+            sim_state_str = "personalized-network";
+            break;
+        }
+        case PCAT_MODEM_MANAGER_SIM_STATE_BAD:
+        {
+            sim_state_str = "bad";
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    pcat_controller_codec_writer_string(writer, "mode", mode_str);
+    pcat_controller_codec_writer_int(writer, "rfkill-state",
+        rfkill_state ? 1 : 0);
+    pcat_controller_codec_writer_string(writer, "sim-state", sim_state_str);
+    pcat_controller_codec_writer_string(writer, "isp-name", isp_name);
+    pcat_controller_codec_writer_string(writer, "isp-lpmn", isp_plmn);
+    pcat_controller_codec_writer_int(writer, "signal-strength",
+        signal_strength);
+
+    g_free(isp_name);
+    g_free(isp_plmn);
+}
+
+static void pcat_controller_command_modem_status_get_func(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    const gchar *command, const PCatControllerRequest *request)
+{
+    PCatControllerCodecWriter writer;
+
+    pcat_controller_response_writer_begin(connection_data, &writer, request,
+        command);
+    pcat_controller_modem_status_fill(&writer);
+    pcat_controller_response_writer_push(connection_data, &writer);
+}
+
+static void pcat_controller_network_route_mode_fill(
+    PCatControllerCodecWriter *writer)
+{
+    PCatManagerRouteMode mode;
+    const gchar *mode_str = "none";
+
+    mode = pcat_main_network_route_mode_get();
+
+    switch(mode)
+    {
+        case PCAT_MANAGER_ROUTE_MODE_WIRED:
+        {
+            mode_str = "wired";
+            break;
+        }
+        case PCAT_MANAGER_ROUTE_MODE_MOBILE:
+        {
+            mode_str = "mobile";
+            break;
+        }
+        case PCAT_MANAGER_ROUTE_MODE_UNKNOWN:
+        {
+            mode_str = "unknown";
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+
+    pcat_controller_codec_writer_string(writer, "mode", mode_str);
+}
+
+static void pcat_controller_command_network_route_mode_get_func(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    const gchar *command, const PCatControllerRequest *request)
+{
+    PCatControllerCodecWriter writer;
+
+    pcat_controller_response_writer_begin(connection_data, &writer, request,
+        command);
+    pcat_controller_codec_writer_int(&writer, "code", 0);
+    pcat_controller_network_route_mode_fill(&writer);
+    pcat_controller_response_writer_push(connection_data, &writer);
+}
+
+static void pcat_controller_command_charger_on_auto_start_set_func(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    const gchar *command, const PCatControllerRequest *request)
+{
+    PCatManagerUserConfigData *uconfig_data;
+    gboolean state;
+    gint iv, ret;
+
+    uconfig_data = pcat_main_user_config_data_edit();
+
+    if(pcat_controller_request_int_get(request, 0, "state", &iv))
+    {
+        uconfig_data->charger_on_auto_start = (iv!=0);
+    }
+
+    if(pcat_controller_request_int_get(request, 0, "timeout", &iv))
+    {
+        uconfig_data->charger_on_auto_start_timeout = iv;
+    }
+
+    state = uconfig_data->charger_on_auto_start;
+
+    ret = pcat_main_user_config_data_commit(uconfig_data) ? 0 : 1;
+
+    pcat_controller_response_code_push(connection_data, request, command,
+        ret);
+
+    pcat_pmu_manager_charger_on_auto_start(state);
+    pcat_controller_topic_state_changed(PCAT_CONTROLLER_TOPIC_CHARGER);
+}
+
+static gint64 pcat_controller_charger_on_auto_start_countdown_get(
+    const PCatManagerUserConfigData *uconfig_data)
+{
+    gint64 countdown;
+
+    countdown = (g_get_monotonic_time() -
+        pcat_pmu_manager_charger_on_auto_start_last_timestamp_get()) /
+        1000000L;
+
+    return (gint64)uconfig_data->charger_on_auto_start_timeout - countdown;
+}
+
+static void pcat_controller_command_charger_on_auto_start_get_func(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    const gchar *command, const PCatControllerRequest *request)
+{
+    struct json_object *rroot, *child;
+    const PCatManagerUserConfigData *uconfig_data;
+    gboolean state;
+    guint timeout;
+    gint64 countdown = 0;
+    guint generation;
+
+    uconfig_data = pcat_main_user_config_data_get();
+    state = uconfig_data->charger_on_auto_start;
+    timeout = uconfig_data->charger_on_auto_start_timeout;
+    if(state)
+    {
+        /* Only a running countdown ticks, otherwise the cached response
+         * is reused until the charger topic changes. */
+        countdown = pcat_controller_charger_on_auto_start_countdown_get(
+            uconfig_data);
+    }
+    pcat_main_user_config_data_unref(uconfig_data);
+
+    generation = ctrl_data->topic_generation[PCAT_CONTROLLER_TOPIC_CHARGER];
+    if(pcat_controller_response_cache_push(ctrl_data, connection_data,
+        request, PCAT_CONTROLLER_RESPONSE_CACHE_CHARGER_ON_AUTO_START,
+        generation, countdown))
+    {
+        return;
+    }
 
-                child = json_object_new_int(0);
-                json_object_object_add(node, "hour", child);
+    rroot = json_object_new_object();
 
-                child = json_object_new_int(0);
-                json_object_object_add(node, "minute", child);
-            }
+    child = json_object_new_string(command);
+    json_object_object_add(rroot, "command", child);
 
-            child = json_object_new_int(sdata->dow_bits);
-            json_object_object_add(node, "dow-bits", child);
+    child = json_object_new_int(0);
+    json_object_object_add(rroot, "code", child);
 
-            json_object_array_add(array, node);
-        }
-    }
+    child = json_object_new_int(state ? 1 : 0);
+    json_object_object_add(rroot, "state", child);
 
-    json_object_object_add(rroot, "event-list", array);
+    child = json_object_new_int(timeout);
+    json_object_object_add(rroot, "timeout", child);
 
-    pcat_controller_unix_socket_output_json_push(ctrl_data, connection_data,
-        rroot);
+    child = json_object_new_int64(countdown);
+    json_object_object_add(rroot, "countdown", child);
+
+    pcat_controller_response_cache_json_push(ctrl_data, connection_data,
+        request, PCAT_CONTROLLER_RESPONSE_CACHE_CHARGER_ON_AUTO_START,
+        generation, countdown, rroot);
     json_object_put(rroot);
 }
 
-static void pcat_controller_command_modem_status_get_func(
+static void pcat_controller_command_pmu_fw_version_get_func(
     PCatControllerData *ctrl_data,
     PCatControllerConnectionData *connection_data,
-    const gchar *command, struct json_object *root)
+    const gchar *command, const PCatControllerRequest *request)
 {
     struct json_object *rroot, *child;
-    PCatModemManagerMode mode = PCAT_MODEM_MANAGER_MODE_NONE;
-    PCatModemManagerSIMState sim_state = PCAT_MODEM_MANAGER_SIM_STATE_ABSENT;
-    gint signal_strength = 0;
-    gchar *isp_name = NULL;
-    gchar *isp_plmn = NULL;
-    gint code = 0;
-    const gchar *mode_str = "none", *sim_state_str = "absent";
-    gboolean rfkill_state = FALSE;
+    gchar *version_str;
+    gint64 tag = 0;
+
+    version_str = pcat_pmu_manager_pmu_fw_version_get();
+    if(version_str!=NULL)
+    {
+        tag = ((gint64)strlen(version_str) << 32) | g_str_hash(version_str);
+    }
+
+    if(pcat_controller_response_cache_push(ctrl_data, connection_data,
+        request, PCAT_CONTROLLER_RESPONSE_CACHE_PMU_FW_VERSION, 0, tag))
+    {
+        g_free(version_str);
+        return;
+    }
 
     rroot = json_object_new_object();
+
     child = json_object_new_string(command);
     json_object_object_add(rroot, "command", child);
 
-    if(!pcat_modem_manager_status_get(&mode, &sim_state, &rfkill_state,
-        &signal_strength, &isp_name, &isp_plmn))
+    child = json_object_new_int(0);
+    json_object_object_add(rroot, "code", child);
+
+    child = json_object_new_string(version_str!=NULL ? version_str : "");
+    json_object_object_add(rroot, "version", child);
+
+    g_free(version_str);
+
+    pcat_controller_response_cache_json_push(ctrl_data, connection_data,
+        request, PCAT_CONTROLLER_RESPONSE_CACHE_PMU_FW_VERSION, 0, tag,
+        rroot);
+    json_object_put(rroot);
+}
+
+static void pcat_controller_command_modem_rfkill_mode_set_func(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    const gchar *command, const PCatControllerRequest *request)
+{
+    gboolean state = FALSE;
+    gint iv;
+
+    if(pcat_controller_request_int_get(request, 0, "state", &iv))
     {
-        code = 1;
+        state = (iv!=0);
     }
 
-    child = json_object_new_int(code);
-    json_object_object_add(rroot, "code", child);
+    pcat_modem_manager_device_rfkill_mode_set(state);
 
-    switch(mode)
+    pcat_controller_response_code_push(connection_data, request, command, 0);
+}
+
+static void pcat_controller_command_modem_network_setup_func(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    const gchar *command, const PCatControllerRequest *request)
+{
+    const gchar *apn_str;
+    const gchar *user_str;
+    const gchar *password_str;
+    const gchar *auth_str;
+    PCatManagerUserConfigData *uconfig_data;
+    gboolean disable_5g_fail_auto_reset = FALSE;
+    gint iv, ret;
+
+    apn_str = pcat_controller_request_string_get(request, 0, "apn");
+    if(apn_str!=NULL && *apn_str=='\0')
     {
-        case PCAT_MODEM_MANAGER_MODE_2G:
+        apn_str = NULL;
+    }
+
+    user_str = pcat_controller_request_string_get(request, 0, "user");
+    if(user_str!=NULL && *user_str=='\0')
+    {
+        user_str = NULL;
+    }
+    password_str = pcat_controller_request_string_get(request, 0,
+        "password");
+    if(password_str!=NULL && *password_str=='\0')
+    {
+        password_str = NULL;
+    }
+    auth_str = pcat_controller_request_string_get(request, 0, "auth");
+    if(auth_str!=NULL && *auth_str=='\0')
+    {
+        auth_str = NULL;
+    }
+    if(pcat_controller_request_int_get(request, 0,
+        "connection-5g-fail-auto-reset", &iv))
+    {
+        disable_5g_fail_auto_reset = (iv!=0);
+    }
+
+    uconfig_data = pcat_main_user_config_data_edit();
+
+    g_free(uconfig_data->modem_dial_apn);
+    uconfig_data->modem_dial_apn = g_strdup(apn_str);
+    g_free(uconfig_data->modem_dial_user);
+    uconfig_data->modem_dial_user = g_strdup(user_str);
+    g_free(uconfig_data->modem_dial_password);
+    uconfig_data->modem_dial_password = g_strdup(password_str);
+    g_free(uconfig_data->modem_dial_auth);
+    uconfig_data->modem_dial_auth = g_strdup(auth_str);
+    uconfig_data->modem_disable_5g_fail_auto_reset =
+        disable_5g_fail_auto_reset;
+
+    ret = pcat_main_user_config_data_commit(uconfig_data) ? 0 : 1;
+
+    pcat_controller_response_code_push(connection_data, request, command,
+        ret);
+}
+
+static void pcat_controller_command_modem_network_get_func(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    const gchar *command, const PCatControllerRequest *request)
+{
+    PCatControllerCodecWriter writer;
+    const PCatManagerUserConfigData *uconfig_data;
+
+    pcat_controller_response_writer_begin(connection_data, &writer, request,
+        command);
+    pcat_controller_codec_writer_int(&writer, "code", 0);
+
+    uconfig_data = pcat_main_user_config_data_get();
+
+    pcat_controller_codec_writer_string(&writer, "apn",
+        uconfig_data->modem_dial_apn);
+    pcat_controller_codec_writer_string(&writer, "user",
+        uconfig_data->modem_dial_user);
+    pcat_controller_codec_writer_string(&writer, "password",
+        uconfig_data->modem_dial_password);
+    pcat_controller_codec_writer_string(&writer, "auth",
+        uconfig_data->modem_dial_auth);
+    pcat_controller_codec_writer_int(&writer,
+        "connection-5g-fail-auto-reset",
+        uconfig_data->modem_disable_5g_fail_auto_reset ? 1 : 0);
+
+    pcat_main_user_config_data_unref(uconfig_data);
+
+    pcat_controller_response_writer_push(connection_data, &writer);
+}
+
+static struct json_object *pcat_controller_topic_event_new(
+    PCatControllerTopic topic)
+{
+    struct json_object *rroot, *child;
+    PCatControllerCodecWriter writer;
+    const PCatManagerUserConfigData *uconfig_data;
+    guint charger_voltage = 0;
+    gboolean on_battery = FALSE;
+
+    rroot = json_object_new_object();
+
+    child = json_object_new_string("event");
+    json_object_object_add(rroot, "command", child);
+
+    child = json_object_new_string(g_pcat_controller_topic_name_list[topic]);
+    json_object_object_add(rroot, "topic", child);
+
+    switch(topic)
+    {
+        case PCAT_CONTROLLER_TOPIC_BATTERY:
         {
-            mode_str = "2g";
+            child = json_object_new_int(0);
+            json_object_object_add(rroot, "code", child);
+
+            pcat_controller_pmu_status_fill(rroot);
+
             break;
         }
-        case PCAT_MODEM_MANAGER_MODE_3G:
+        case PCAT_CONTROLLER_TOPIC_CHARGER:
         {
-            mode_str = "3g";
+            uconfig_data = pcat_main_user_config_data_get();
+            pcat_pmu_manager_pmu_status_get(NULL, &charger_voltage,
+                &on_battery, NULL);
+
+            child = json_object_new_int(0);
+            json_object_object_add(rroot, "code", child);
+
+            child = json_object_new_int(charger_voltage);
+            json_object_object_add(rroot, "charger-voltage", child);
+
+            child = json_object_new_int(on_battery ? 1 : 0);
+            json_object_object_add(rroot, "on-battery", child);
+
+            child = json_object_new_int(
+                uconfig_data->charger_on_auto_start ? 1 : 0);
+            json_object_object_add(rroot, "charger-on-auto-start", child);
+
+            child = json_object_new_int(
+                uconfig_data->charger_on_auto_start_timeout);
+            json_object_object_add(rroot, "charger-on-auto-start-timeout",
+                child);
+
+            pcat_main_user_config_data_unref(uconfig_data);
+
             break;
         }
-        case PCAT_MODEM_MANAGER_MODE_LTE:
+        case PCAT_CONTROLLER_TOPIC_MODEM:
         {
-            mode_str = "lte";
+            pcat_controller_codec_writer_tree_init(&writer, rroot);
+            pcat_controller_modem_status_fill(&writer);
+            pcat_controller_codec_writer_clear(&writer);
+
             break;
         }
-        case PCAT_MODEM_MANAGER_MODE_5G:
+        case PCAT_CONTROLLER_TOPIC_ROUTE:
         {
-            mode_str = "5g";
+            child = json_object_new_int(0);
+            json_object_object_add(rroot, "code", child);
+
+            pcat_controller_codec_writer_tree_init(&writer, rroot);
+            pcat_controller_network_route_mode_fill(&writer);
+            pcat_controller_codec_writer_clear(&writer);
+
+            break;
+        }
+        case PCAT_CONTROLLER_TOPIC_SCHEDULE:
+        {
+            child = json_object_new_int(0);
+            json_object_object_add(rroot, "code", child);
+
+            pcat_controller_schedule_power_event_fill(rroot);
+
             break;
         }
         default:
         {
+            json_object_put(rroot);
+            rroot = NULL;
+
             break;
         }
     }
 
-    switch(sim_state)
+    return rroot;
+}
+
+static gboolean pcat_controller_topic_message_update(
+    PCatControllerData *ctrl_data, PCatControllerTopic topic)
+{
+    struct json_object *rroot;
+    GBytes *message, *old_message;
+    PCatControllerEncodedData *encoded_data =
+        &(ctrl_data->topic_message[topic]);
+
+    rroot = pcat_controller_topic_event_new(topic);
+    if(rroot==NULL)
     {
-        case PCAT_MODEM_MANAGER_SIM_STATE_ABSENT:
-        {
-            sim_state_str = "absent";
-            break;
-        }
-        case PCAT_MODEM_MANAGER_SIM_STATE_NOT_READY:
+        return FALSE;
+    }
+
+    message = pcat_controller_codec_encode(PCAT_CONTROLLER_CODEC_JSON,
+        rroot);
+    if(message==NULL)
+    {
+        json_object_put(rroot);
+
+        return FALSE;
+    }
+
+    old_message = pcat_controller_encoded_data_get(encoded_data,
+        PCAT_CONTROLLER_CODEC_JSON);
+    if(old_message!=NULL && g_bytes_equal(old_message, message))
+    {
+        g_bytes_unref(message);
+        json_object_put(rroot);
+
+        return FALSE;
+    }
+
+    pcat_controller_encoded_data_set(encoded_data, rroot);
+    encoded_data->data[PCAT_CONTROLLER_CODEC_JSON] = message;
+    json_object_put(rroot);
+    ctrl_data->topic_generation[topic]++;
+
+    return TRUE;
+}
+
+static void pcat_controller_topic_deliver(PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    PCatControllerTopic topic, gint64 now);
+
+static gboolean pcat_controller_topic_timeout_func(gpointer user_data)
+{
+    PCatControllerData *ctrl_data = &g_pcat_controller_data;
+    PCatControllerConnectionData *connection_data =
+        (PCatControllerConnectionData *)user_data;
+    guint topic;
+    gint64 now;
+
+    g_source_unref(connection_data->topic_timeout_source);
+    connection_data->topic_timeout_source = NULL;
+    connection_data->topic_timeout_deadline = 0;
+
+    now = g_get_monotonic_time();
+    for(topic=0;topic<PCAT_CONTROLLER_TOPIC_LAST;topic++)
+    {
+        if(connection_data->topic_pending_mask & (1U << topic))
         {
-            sim_state_str = "not-ready";
-            break;
+            pcat_controller_topic_deliver(ctrl_data, connection_data, topic,
+                now);
         }
-        case PCAT_MODEM_MANAGER_SIM_STATE_READY:
+    }
+
+    return FALSE;
+}
+
+static void pcat_controller_topic_deliver(PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    PCatControllerTopic topic, gint64 now)
+{
+    gint64 deadline;
+
+    if(ctrl_data->topic_message[topic].root==NULL)
+    {
+        return;
+    }
+
+    deadline = connection_data->topic_last_push_time[topic] +
+        (gint64)connection_data->topic_min_interval[topic] * 1000;
+    if(connection_data->topic_last_push_time[topic]==0 || now >= deadline)
+    {
+        connection_data->topic_pending_mask &= ~(1U << topic);
+        connection_data->topic_last_push_time[topic] = now;
+
+        pcat_controller_unix_socket_output_encoded_push(connection_data,
+            &(ctrl_data->topic_message[topic]), topic);
+
+        return;
+    }
+
+    connection_data->topic_pending_mask |= (1U << topic);
+
+    if(connection_data->topic_timeout_source!=NULL)
+    {
+        if(connection_data->topic_timeout_deadline <= deadline)
         {
-            sim_state_str = "ready";
-            break;
+            return;
         }
-        case PCAT_MODEM_MANAGER_SIM_STATE_PIN:
+
+        g_source_destroy(connection_data->topic_timeout_source);
+        g_source_unref(connection_data->topic_timeout_source);
+    }
+
+    connection_data->topic_timeout_deadline = deadline;
+    connection_data->topic_timeout_source = g_timeout_source_new(
+        (deadline - now + 999) / 1000);
+    g_source_set_callback(connection_data->topic_timeout_source,
+        pcat_controller_topic_timeout_func, connection_data, NULL);
+    g_source_attach(connection_data->topic_timeout_source,
+        ctrl_data->context);
+}
+
+static void pcat_controller_topic_publish(PCatControllerData *ctrl_data,
+    PCatControllerTopic topic)
+{
+    GHashTableIter iter;
+    PCatControllerConnectionData *connection_data;
+    gint64 now;
+
+    now = g_get_monotonic_time();
+
+    g_hash_table_iter_init(&iter, ctrl_data->control_connection_table);
+    while(g_hash_table_iter_next(&iter, NULL, (gpointer *)&connection_data))
+    {
+        if(connection_data->topic_mask & (1U << topic))
         {
-            sim_state_str = "need-pin";
-            break;
+            pcat_controller_topic_deliver(ctrl_data, connection_data, topic,
+                now);
         }
-        case PCAT_MODEM_MANAGER_SIM_STATE_PUK:
+    }
+}
+
+static gboolean pcat_controller_topic_name_parse(const gchar *name,
+    PCatControllerTopic *topic)
+{
+    guint i;
+
+    if(name==NULL)
+    {
+        return FALSE;
+    }
+
+    for(i=0;i<PCAT_CONTROLLER_TOPIC_LAST;i++)
+    {
+        if(g_strcmp0(name, g_pcat_controller_topic_name_list[i])==0)
         {
-            sim_state_str = "need-puk";
-            break;
+            *topic = i;
+
+            return TRUE;
         }
-        case PCAT_MODEM_MANAGER_SIM_STATE_NETWORK_PERSONALIZATION:
-        {
-            sim_state_str = "personalized-network";
-            break;
+    }
+
+    return FALSE;
+}
+
+static void pcat_controller_topic_list_write(
+    PCatControllerConnectionData *connection_data,
+    PCatControllerCodecWriter *writer)
+{
+    guint i;
+
+    pcat_controller_codec_writer_array_begin(writer, "topics");
+
+    for(i=0;i<PCAT_CONTROLLER_TOPIC_LAST;i++)
+    {
+        if(connection_data->topic_mask & (1U << i))
+        {
+            pcat_controller_codec_writer_string(writer, NULL,
+                g_pcat_controller_topic_name_list[i]);
         }
-        case PCAT_MODEM_MANAGER_SIM_STATE_BAD:
+    }
+
+    pcat_controller_codec_writer_array_end(writer);
+}
+
+static void pcat_controller_command_subscribe_func(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    const gchar *command, const PCatControllerRequest *request)
+{
+    gint child, array, intervals;
+    PCatControllerCodecWriter writer;
+    guint i;
+    gint iv;
+    PCatControllerTopic topic;
+    guint new_topic_mask = 0;
+    gint code = 0;
+    gint64 now;
+
+    intervals = pcat_controller_request_member_get(request, 0,
+        "min-interval");
+
+    array = pcat_controller_request_member_get(request, 0, "topics");
+    if(array >= 0)
+    {
+        for(child=pcat_controller_request_child_next(request, array, -1);
+            child >= 0;
+            child=pcat_controller_request_child_next(request, array, child))
         {
-            sim_state_str = "bad";
-            break;
+            if(!pcat_controller_topic_name_parse(
+                pcat_controller_request_string(request, child), &topic))
+            {
+                code = 1;
+
+                continue;
+            }
+
+            connection_data->topic_min_interval[topic] =
+                g_pcat_controller_topic_min_interval_list[topic];
+            if(pcat_controller_request_int_get(request, intervals,
+                g_pcat_controller_topic_name_list[topic], &iv))
+            {
+                if(iv > 0 && (guint)iv >
+                   connection_data->topic_min_interval[topic])
+                {
+                    connection_data->topic_min_interval[topic] = iv;
+                }
+            }
+
+            if(!(connection_data->topic_mask & (1U << topic)))
+            {
+                new_topic_mask |= (1U << topic);
+            }
         }
-        default:
+    }
+
+    /* Events are not built while a topic has no subscribers. */
+    for(i=0;i<PCAT_CONTROLLER_TOPIC_LAST;i++)
+    {
+        if((new_topic_mask & (1U << i)) &&
+           ctrl_data->topic_message[i].root==NULL)
         {
-            break;
+            pcat_controller_topic_message_update(ctrl_data, i);
         }
     }
+    connection_data->topic_mask |= new_topic_mask;
 
-    child = json_object_new_string(mode_str);
-    json_object_object_add(rroot, "mode", child);
+    pcat_controller_response_writer_begin(connection_data, &writer, request,
+        command);
+    pcat_controller_codec_writer_int(&writer, "code", code);
+    pcat_controller_topic_list_write(connection_data, &writer);
+    pcat_controller_response_writer_push(connection_data, &writer);
 
-    child = json_object_new_int(rfkill_state ? 1 : 0);
-    json_object_object_add(rroot, "rfkill-state", child);
+    now = g_get_monotonic_time();
+    for(i=0;i<PCAT_CONTROLLER_TOPIC_LAST;i++)
+    {
+        if((new_topic_mask & (1U << i)) && i!=PCAT_CONTROLLER_TOPIC_GPIO)
+        {
+            connection_data->topic_last_push_time[i] = 0;
+            pcat_controller_topic_deliver(ctrl_data, connection_data, i, now);
+        }
+    }
+}
 
-    child = json_object_new_string(sim_state_str);
-    json_object_object_add(rroot, "sim-state", child);
+static void pcat_controller_command_unsubscribe_func(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    const gchar *command, const PCatControllerRequest *request)
+{
+    gint child, array;
+    PCatControllerCodecWriter writer;
+    PCatControllerTopic topic;
+    gint code = 0;
 
-    child = json_object_new_string(isp_name!=NULL ? isp_name : "");
-    json_object_object_add(rroot, "isp-name", child);
+    array = pcat_controller_request_member_get(request, 0, "topics");
+    if(array >= 0)
+    {
+        for(child=pcat_controller_request_child_next(request, array, -1);
+            child >= 0;
+            child=pcat_controller_request_child_next(request, array, child))
+        {
+            if(!pcat_controller_topic_name_parse(
+                pcat_controller_request_string(request, child), &topic))
+            {
+                code = 1;
 
-    child = json_object_new_string(isp_plmn!=NULL ? isp_plmn : "");
-    json_object_object_add(rroot, "isp-lpmn", child);
-    
-    child = json_object_new_int(signal_strength);
-    json_object_object_add(rroot, "signal-strength", child);
+                continue;
+            }
 
-    g_free(isp_name);
-    g_free(isp_plmn);
+            connection_data->topic_mask &= ~(1U << topic);
+        }
+    }
+    else
+    {
+        connection_data->topic_mask = 0;
+    }
 
-    pcat_controller_unix_socket_output_json_push(ctrl_data, connection_data,
-        rroot);
-    json_object_put(rroot);
+    connection_data->topic_pending_mask &= connection_data->topic_mask;
+    pcat_controller_connection_deadline_update(connection_data);
+    if(connection_data->topic_pending_mask==0 &&
+       connection_data->topic_timeout_source!=NULL)
+    {
+        g_source_destroy(connection_data->topic_timeout_source);
+        g_source_unref(connection_data->topic_timeout_source);
+        connection_data->topic_timeout_source = NULL;
+        connection_data->topic_timeout_deadline = 0;
+    }
+
+    pcat_controller_response_writer_begin(connection_data, &writer, request,
+        command);
+    pcat_controller_codec_writer_int(&writer, "code", code);
+    pcat_controller_topic_list_write(connection_data, &writer);
+    pcat_controller_response_writer_push(connection_data, &writer);
 }
 
-static void pcat_controller_command_network_route_mode_get_func(
+static void pcat_controller_command_hello_func(
     PCatControllerData *ctrl_data,
     PCatControllerConnectionData *connection_data,
-    const gchar *command, struct json_object *root)
+    const gchar *command, const PCatControllerRequest *request)
 {
-    struct json_object *rroot, *child;
-    PCatManagerRouteMode mode;
-    const gchar *mode_str = "none";
+    PCatControllerCodecWriter writer;
+    PCatControllerCodecType codec;
+    gint code = 0;
+    guint i;
 
-    rroot = json_object_new_object();
+    if(!pcat_controller_command_hello_codec_get(connection_data, request,
+        &codec))
+    {
+        code = 1;
+    }
 
-    mode = pcat_main_network_route_mode_get();
+    pcat_controller_response_writer_begin(connection_data, &writer, request,
+        command);
+    pcat_controller_codec_writer_int(&writer, "code", code);
+    pcat_controller_codec_writer_string(&writer, "encoding",
+        pcat_controller_codec_name_get(codec));
 
-    switch(mode)
+    pcat_controller_codec_writer_array_begin(&writer, "encodings");
+    for(i=0;i<PCAT_CONTROLLER_CODEC_LAST;i++)
     {
-        case PCAT_MANAGER_ROUTE_MODE_WIRED:
+        pcat_controller_codec_writer_string(&writer, NULL,
+            pcat_controller_codec_name_get(i));
+    }
+    pcat_controller_codec_writer_array_end(&writer);
+
+    pcat_controller_response_writer_push(connection_data, &writer);
+
+    /* The input side already switched when the request was read. */
+    if(codec!=connection_data->codec)
+    {
+        connection_data->codec = codec;
+
+        g_message("Controller connection switched to %s encoding.",
+            pcat_controller_codec_name_get(codec));
+    }
+}
+
+static void pcat_controller_system_status_section_fill(
+    struct json_object *section, PCatControllerTopic topic,
+    const PCatManagerUserConfigData *uconfig_data, gint64 countdown)
+{
+    struct json_object *child;
+    PCatControllerCodecWriter writer;
+    const PCatManagerPowerScheduleData *sdata;
+    guint i;
+    guint power_on_count = 0, power_off_count = 0;
+
+    switch(topic)
+    {
+        case PCAT_CONTROLLER_TOPIC_BATTERY:
         {
-            mode_str = "wired";
+            pcat_controller_pmu_status_fill(section);
+
             break;
         }
-        case PCAT_MANAGER_ROUTE_MODE_MOBILE:
+        case PCAT_CONTROLLER_TOPIC_CHARGER:
         {
-            mode_str = "mobile";
+            child = json_object_new_int(
+                uconfig_data->charger_on_auto_start ? 1 : 0);
+            json_object_object_add(section, "state", child);
+
+            child = json_object_new_int(
+                uconfig_data->charger_on_auto_start_timeout);
+            json_object_object_add(section, "timeout", child);
+
+            child = json_object_new_int64(countdown);
+            json_object_object_add(section, "countdown", child);
+
             break;
         }
-        case PCAT_MANAGER_ROUTE_MODE_UNKNOWN:
+        case PCAT_CONTROLLER_TOPIC_MODEM:
         {
-            mode_str = "unknown";
+            pcat_controller_codec_writer_tree_init(&writer, section);
+            pcat_controller_modem_status_fill(&writer);
+            pcat_controller_codec_writer_clear(&writer);
+
             break;
         }
-        default:
+        case PCAT_CONTROLLER_TOPIC_ROUTE:
         {
+            pcat_controller_codec_writer_tree_init(&writer, section);
+            pcat_controller_network_route_mode_fill(&writer);
+            pcat_controller_codec_writer_clear(&writer);
+
             break;
         }
-    }
+        case PCAT_CONTROLLER_TOPIC_SCHEDULE:
+        {
+            for(i=0;i<uconfig_data->power_schedule_data->len;i++)
+            {
+                sdata = g_ptr_array_index(uconfig_data->power_schedule_data,
+                    i);
+                if(!sdata->enabled)
+                {
+                    continue;
+                }
 
-    child = json_object_new_string(command);
-    json_object_object_add(rroot, "command", child);
+                if(sdata->action)
+                {
+                    power_on_count++;
+                }
+                else
+                {
+                    power_off_count++;
+                }
+            }
 
-    child = json_object_new_int(0);
-    json_object_object_add(rroot, "code", child);
+            child = json_object_new_int(
+                uconfig_data->power_schedule_data->len);
+            json_object_object_add(section, "event-count", child);
 
-    child = json_object_new_string(mode_str);
-    json_object_object_add(rroot, "mode", child);
+            child = json_object_new_int(power_on_count);
+            json_object_object_add(section, "power-on-count", child);
 
-    pcat_controller_unix_socket_output_json_push(ctrl_data, connection_data,
-        rroot);
-    json_object_put(rroot);
+            child = json_object_new_int(power_off_count);
+            json_object_object_add(section, "power-off-count", child);
+
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
 }
 
-static void pcat_controller_command_charger_on_auto_start_set_func(
-    PCatControllerData *ctrl_data,
-    PCatControllerConnectionData *connection_data,
-    const gchar *command, struct json_object *root)
+/*
+ * Cached per section mask, keyed by the sum of the section topic
+ * generations, plus the charger countdown which moves every second while
+ * auto-start is enabled.
+ */
+static PCatControllerEncodedData *pcat_controller_system_status_cache_get(
+    PCatControllerData *ctrl_data, guint mask)
 {
-    struct json_object *rroot, *child;
-    PCatManagerUserConfigData *uconfig_data;
+    PCatControllerResponseCacheData *cache_data =
+        &(ctrl_data->system_status_cache[mask]);
+    const PCatManagerUserConfigData *uconfig_data;
+    struct json_object *rroot, *child, *section;
+    guint generation = 0;
+    gint64 countdown = 0;
+    guint topic;
+
+    for(topic=0;topic<PCAT_CONTROLLER_TOPIC_LAST;topic++)
+    {
+        if(mask & (1U << topic))
+        {
+            generation += ctrl_data->topic_generation[topic];
+        }
+    }
 
     uconfig_data = pcat_main_user_config_data_get();
 
-    if(json_object_object_get_ex(root, "state", &child))
+    /* The countdown is reported as 0 while auto-start is disabled. */
+    if((mask & (1U << PCAT_CONTROLLER_TOPIC_CHARGER)) &&
+       uconfig_data->charger_on_auto_start)
     {
-        uconfig_data->charger_on_auto_start = (json_object_get_int(child)!=0);
-        uconfig_data->dirty = TRUE;
+        countdown = pcat_controller_charger_on_auto_start_countdown_get(
+            uconfig_data);
     }
 
-    if(json_object_object_get_ex(root, "timeout", &child))
+    if(cache_data->message.root!=NULL &&
+       cache_data->generation==generation && cache_data->tag==countdown)
     {
-        uconfig_data->charger_on_auto_start_timeout =
-            json_object_get_int(child);
-        uconfig_data->dirty = TRUE;
+        pcat_main_user_config_data_unref(uconfig_data);
+
+        return &(cache_data->message);
     }
 
     rroot = json_object_new_object();
 
-    child = json_object_new_string(command);
+    child = json_object_new_string(g_pcat_controller_command_info_list[
+        PCAT_CONTROLLER_COMMAND_SYSTEM_STATUS].command);
     json_object_object_add(rroot, "command", child);
 
     child = json_object_new_int(0);
     json_object_object_add(rroot, "code", child);
 
-    pcat_controller_unix_socket_output_json_push(ctrl_data, connection_data,
-        rroot);
+    for(topic=0;topic<PCAT_CONTROLLER_TOPIC_LAST;topic++)
+    {
+        if(!(mask & (1U << topic)))
+        {
+            continue;
+        }
+
+        section = json_object_new_object();
+        pcat_controller_system_status_section_fill(section, topic,
+            uconfig_data, countdown);
+        json_object_object_add(rroot, g_pcat_controller_topic_name_list[
+            topic], section);
+    }
+
+    pcat_main_user_config_data_unref(uconfig_data);
+
+    pcat_controller_encoded_data_set(&(cache_data->message), rroot);
+    cache_data->generation = generation;
+    cache_data->tag = countdown;
     json_object_put(rroot);
 
-    pcat_pmu_manager_charger_on_auto_start(
-        uconfig_data->charger_on_auto_start);
-    pcat_main_user_config_data_sync();
+    return &(cache_data->message);
 }
 
-static void pcat_controller_command_charger_on_auto_start_get_func(
+static void pcat_controller_command_system_status_func(
     PCatControllerData *ctrl_data,
     PCatControllerConnectionData *connection_data,
-    const gchar *command, struct json_object *root)
+    const gchar *command, const PCatControllerRequest *request)
 {
-    struct json_object *rroot, *child;
-    const PCatManagerUserConfigData *uconfig_data;
-    gint64 countdown;
-
-    uconfig_data = pcat_main_user_config_data_get();
-
-    rroot = json_object_new_object();
-
-    child = json_object_new_string(command);
-    json_object_object_add(rroot, "command", child);
-
-    child = json_object_new_int(0);
-    json_object_object_add(rroot, "code", child);
+    gint array, child;
+    PCatControllerTopic topic;
+    guint mask = PCAT_CONTROLLER_SYSTEM_STATUS_SECTION_ALL;
 
-    child = json_object_new_int(uconfig_data->charger_on_auto_start ? 1 : 0);
-    json_object_object_add(rroot, "state", child);
+    array = pcat_controller_request_member_get(request, 0, "sections");
+    if(pcat_controller_request_type_get(request, array)==
+       PCAT_CONTROLLER_REQUEST_TYPE_ARRAY)
+    {
+        mask = 0;
 
-    child = json_object_new_int(uconfig_data->charger_on_auto_start_timeout);
-    json_object_object_add(rroot, "timeout", child);
+        for(child=pcat_controller_request_child_next(request, array, -1);
+            child >= 0;
+            child=pcat_controller_request_child_next(request, array, child))
+        {
+            if(!pcat_controller_topic_name_parse(
+                pcat_controller_request_string(request, child), &topic) ||
+                topic==PCAT_CONTROLLER_TOPIC_GPIO)
+            {
+                pcat_controller_response_code_push(connection_data, request,
+                    command, 1);
 
-    countdown = (g_get_monotonic_time() -
-        pcat_pmu_manager_charger_on_auto_start_last_timestamp_get()) /
-        1000000L;
-    countdown = uconfig_data->charger_on_auto_start_timeout - countdown;
+                return;
+            }
 
-    child = json_object_new_int(countdown);
-    json_object_object_add(rroot, "countdown", child);
+            mask |= (1U << topic);
+        }
+    }
 
-    pcat_controller_unix_socket_output_json_push(ctrl_data, connection_data,
-        rroot);
-    json_object_put(rroot);
+    pcat_controller_unix_socket_output_response_push(connection_data,
+        pcat_controller_system_status_cache_get(ctrl_data, mask), request);
 }
 
-static void pcat_controller_command_pmu_fw_version_get_func(
+static void pcat_controller_command_metrics_get_func(
     PCatControllerData *ctrl_data,
     PCatControllerConnectionData *connection_data,
-    const gchar *command, struct json_object *root)
+    const gchar *command, const PCatControllerRequest *request)
 {
-    struct json_object *rroot, *child;
-    const gchar *version_str;
-
-    rroot = json_object_new_object();
-
-    child = json_object_new_string(command);
-    json_object_object_add(rroot, "command", child);
-
-    child = json_object_new_int(0);
-    json_object_object_add(rroot, "code", child);
+    struct json_object *metrics;
+    PCatControllerCodecWriter writer;
 
-    version_str = pcat_pmu_manager_pmu_fw_version_get();
+    metrics = pcat_metrics_json_new();
 
-    child = json_object_new_string(version_str!=NULL ? version_str : "");
-    json_object_object_add(rroot, "version", child);
+    pcat_controller_response_writer_begin(connection_data, &writer, request,
+        command);
+    pcat_controller_codec_writer_int(&writer, "code", 0);
+    pcat_controller_codec_writer_json(&writer, "metrics", metrics);
+    pcat_controller_response_writer_push(connection_data, &writer);
 
-    pcat_controller_unix_socket_output_json_push(ctrl_data, connection_data,
-        rroot);
-    json_object_put(rroot);
+    json_object_put(metrics);
 }
 
-static void pcat_controller_command_modem_rfkill_mode_set_func(
+static void pcat_controller_command_command_stats_get_func(
     PCatControllerData *ctrl_data,
     PCatControllerConnectionData *connection_data,
-    const gchar *command, struct json_object *root)
+    const gchar *command, const PCatControllerRequest *request)
 {
-    struct json_object *rroot, *child;
-    gboolean state = FALSE;
+    const PCatControllerCommandStatsData *stats;
+    const PCatControllerCommandStageStatsData *stage_stats;
+    PCatControllerCodecWriter writer;
+    gint reset = 0;
+    guint i, j, k;
+
+    pcat_controller_response_writer_begin(connection_data, &writer, request,
+        command);
+    pcat_controller_codec_writer_int(&writer, "code", 0);
+    pcat_controller_codec_writer_string(&writer, "unit", "us");
+
+    pcat_controller_codec_writer_array_begin(&writer, "bounds");
+    for(i=0;i<G_N_ELEMENTS(g_pcat_controller_command_stats_bound_list);i++)
+    {
+        pcat_controller_codec_writer_int(&writer, NULL,
+            g_pcat_controller_command_stats_bound_list[i]);
+    }
+    pcat_controller_codec_writer_array_end(&writer);
 
-    rroot = json_object_new_object();
+    pcat_controller_codec_writer_object_begin(&writer, "commands");
+    for(i=0;i<PCAT_CONTROLLER_COMMAND_LAST;i++)
+    {
+        stats = &(ctrl_data->command_stats[i]);
+        if(stats->count==0 && stats->stage[
+           PCAT_CONTROLLER_COMMAND_STAGE_HANDLER].count==0)
+        {
+            continue;
+        }
 
-    child = json_object_new_string(command);
-    json_object_object_add(rroot, "command", child);
+        pcat_controller_codec_writer_object_begin(&writer,
+            g_pcat_controller_command_info_list[i].command);
+        pcat_controller_codec_writer_int(&writer, "count", stats->count);
+        pcat_controller_codec_writer_int(&writer, "output-bytes",
+            stats->output_bytes);
 
-    child = json_object_new_int(0);
-    json_object_object_add(rroot, "code", child);
+        for(j=0;j<PCAT_CONTROLLER_COMMAND_STAGE_LAST;j++)
+        {
+            stage_stats = &(stats->stage[j]);
+
+            pcat_controller_codec_writer_object_begin(&writer,
+                g_pcat_controller_command_stage_name_list[j]);
+            pcat_controller_codec_writer_int(&writer, "count",
+                stage_stats->count);
+            pcat_controller_codec_writer_int(&writer, "sum",
+                stage_stats->sum);
+            pcat_controller_codec_writer_int(&writer, "max",
+                stage_stats->max);
+            pcat_controller_codec_writer_array_begin(&writer, "buckets");
+            for(k=0;k<PCAT_CONTROLLER_COMMAND_STATS_BUCKET_COUNT;k++)
+            {
+                pcat_controller_codec_writer_int(&writer, NULL,
+                    stage_stats->buckets[k]);
+            }
+            pcat_controller_codec_writer_array_end(&writer);
+            pcat_controller_codec_writer_object_end(&writer);
+        }
 
-    if(json_object_object_get_ex(root, "state", &child))
-    {
-        state = (json_object_get_int(child)!=0);
+        pcat_controller_codec_writer_object_end(&writer);
     }
+    pcat_controller_codec_writer_object_end(&writer);
 
-    pcat_modem_manager_device_rfkill_mode_set(state);
+    pcat_controller_response_writer_push(connection_data, &writer);
 
-    pcat_controller_unix_socket_output_json_push(ctrl_data, connection_data,
-        rroot);
-    json_object_put(rroot);
+    if(pcat_controller_request_int_get(request, 0, "reset", &reset) &&
+       reset!=0)
+    {
+        memset(ctrl_data->command_stats, 0,
+            sizeof(ctrl_data->command_stats));
+    }
 }
 
-static void pcat_controller_command_modem_network_setup_func(
+static void pcat_controller_command_batch_continue(
     PCatControllerData *ctrl_data,
-    PCatControllerConnectionData *connection_data,
-    const gchar *command, struct json_object *root)
+    PCatControllerConnectionData *connection_data)
 {
-    struct json_object *rroot, *child;
-    const gchar *apn_str = NULL;
-    const gchar *user_str = NULL;
-    const gchar *password_str = NULL;
-    const gchar *auth_str = NULL;
-    PCatManagerUserConfigData *uconfig_data;
-    gboolean disable_5g_fail_auto_reset = FALSE;
-
-    rroot = json_object_new_object();
-
-    child = json_object_new_string(command);
-    json_object_object_add(rroot, "command", child);
+    struct json_object *rroot, *child, *array, *node, *responses;
+    PCatControllerRequest request;
+    const gchar *sub_command;
+    gint command_id;
+    gint64 start;
+    PCatControllerCommandCallback callback;
 
-    child = json_object_new_int(0);
-    json_object_object_add(rroot, "code", child);
+    json_object_object_get_ex(connection_data->batch_root, "commands",
+        &array);
 
-    if(json_object_object_get_ex(root, "apn", &child))
+    for(;connection_data->batch_index<connection_data->batch_length;
+        connection_data->batch_index++)
     {
-        apn_str = json_object_get_string(child);
-        if(apn_str!=NULL && *apn_str=='\0')
-        {
-            apn_str = NULL;
-        }
-    }
+        node = json_object_array_get_idx(array,
+            connection_data->batch_index);
 
-    if(json_object_object_get_ex(root, "user", &child))
-    {
-        user_str = json_object_get_string(child);
-        if(user_str!=NULL && *user_str=='\0')
-        {
-            user_str = NULL;
-        }
-    }
-    if(json_object_object_get_ex(root, "password", &child))
-    {
-        password_str = json_object_get_string(child);
-        if(password_str!=NULL && *password_str=='\0')
+        callback = NULL;
+        command_id = -1;
+        sub_command = NULL;
+        if(pcat_controller_request_json_init(&request, node))
         {
-            password_str = NULL;
+            command_id = pcat_controller_command_parse(&request,
+                &sub_command);
         }
-    }
-    if(json_object_object_get_ex(root, "auth", &child))
-    {
-        auth_str = json_object_get_string(child);
-        if(auth_str!=NULL && *auth_str=='\0')
+        if(command_id >= 0 && !(g_pcat_controller_command_info_list[
+            command_id].flags & PCAT_CONTROLLER_COMMAND_FLAG_NO_BATCH))
         {
-            auth_str = NULL;
-        }
-    }
-    if(json_object_object_get_ex(root, "connection-5g-fail-auto-reset",
-        &child))
-    {
-        disable_5g_fail_auto_reset = (json_object_get_int(child)!=0);
-    }
-
-    uconfig_data = pcat_main_user_config_data_get();
-    g_free(uconfig_data->modem_dial_apn);
-    uconfig_data->modem_dial_apn = g_strdup(apn_str);
-    g_free(uconfig_data->modem_dial_user);
-    uconfig_data->modem_dial_user = g_strdup(user_str);
-    g_free(uconfig_data->modem_dial_password);
-    uconfig_data->modem_dial_password = g_strdup(password_str);
-    g_free(uconfig_data->modem_dial_auth);
-    uconfig_data->modem_dial_auth = g_strdup(auth_str);
-    uconfig_data->modem_disable_5g_fail_auto_reset =
-        disable_5g_fail_auto_reset;
+            callback = g_pcat_controller_command_callback_list[command_id];
+        }
 
-    uconfig_data->dirty = TRUE;
+        if(callback!=NULL && !pcat_controller_command_admit(ctrl_data,
+           connection_data, &request, command_id, sub_command))
+        {
+            /* Answered as busy, the rest of the batch carries on. */
+            pcat_controller_request_clear(&request);
+            continue;
+        }
 
-    pcat_main_user_config_data_sync();
+        /* Sub-commands are counted and timed under their own command as
+         * well, their output is written with the batch response. */
+        if(callback!=NULL)
+        {
+            ctrl_data->command_stats[command_id].count++;
+        }
 
-    pcat_controller_unix_socket_output_json_push(ctrl_data, connection_data,
-        rroot);
-    json_object_put(rroot);
-}
+        if(callback!=NULL && (g_pcat_controller_command_info_list[
+            command_id].flags & PCAT_CONTROLLER_COMMAND_FLAG_WRITE))
+        {
+            pcat_controller_request_clear(&request);
 
-static void pcat_controller_command_modem_network_get_func(
-    PCatControllerData *ctrl_data,
-    PCatControllerConnectionData *connection_data,
-    const gchar *command, struct json_object *root)
-{
-    struct json_object *rroot, *child;
-    const PCatManagerUserConfigData *uconfig_data;
+            /* Resumed from the job completion. */
+            pcat_controller_command_job_submit(connection_data, command_id,
+                json_object_get(node));
 
-    rroot = json_object_new_object();
+            return;
+        }
+        else if(callback!=NULL)
+        {
+            start = g_get_monotonic_time();
+            callback(ctrl_data, connection_data, sub_command, &request);
+            pcat_controller_command_stats_observe(ctrl_data, command_id,
+                PCAT_CONTROLLER_COMMAND_STAGE_HANDLER,
+                g_get_monotonic_time() - start);
+        }
+        else
+        {
+            pcat_controller_response_code_push(connection_data, &request,
+                sub_command!=NULL ? sub_command : "", 1);
+        }
 
-    child = json_object_new_string(command);
-    json_object_object_add(rroot, "command", child);
+        pcat_controller_request_clear(&request);
+    }
 
-    child = json_object_new_int(0);
-    json_object_object_add(rroot, "code", child);
+    responses = connection_data->batch_responses;
+    connection_data->batch_responses = NULL;
 
-    uconfig_data = pcat_main_user_config_data_get();
+    rroot = json_object_new_object();
 
-    child = json_object_new_string(uconfig_data->modem_dial_apn!=NULL ?
-        uconfig_data->modem_dial_apn : "");
-    json_object_object_add(rroot, "apn", child);
+    if(json_object_object_get_ex(connection_data->batch_root, "id",
+       &child) && child!=NULL && !json_object_is_type(child,
+       json_type_object) && !json_object_is_type(child, json_type_array))
+    {
+        json_object_object_add(rroot, "id", json_object_get(child));
+    }
 
-    child = json_object_new_string(uconfig_data->modem_dial_user!=NULL ?
-        uconfig_data->modem_dial_user : "");
-    json_object_object_add(rroot, "user", child);
+    json_object_put(connection_data->batch_root);
+    connection_data->batch_root = NULL;
 
-    child = json_object_new_string(uconfig_data->modem_dial_password!=NULL ?
-        uconfig_data->modem_dial_password : "");
-    json_object_object_add(rroot, "password", child);
+    child = json_object_new_string("batch");
+    json_object_object_add(rroot, "command", child);
 
-    child = json_object_new_string(uconfig_data->modem_dial_auth!=NULL ?
-        uconfig_data->modem_dial_auth : "");
-    json_object_object_add(rroot, "auth", child);
+    child = json_object_new_int(connection_data->batch_code);
+    json_object_object_add(rroot, "code", child);
 
-    child = json_object_new_int(uconfig_data->modem_disable_5g_fail_auto_reset
-        ? 1 : 0);
-    json_object_object_add(rroot, "connection-5g-fail-auto-reset", child);
+    json_object_object_add(rroot, "responses", responses);
 
     pcat_controller_unix_socket_output_json_push(ctrl_data, connection_data,
         rroot);
     json_object_put(rroot);
 }
 
-static PCatControllerCommandData g_pcat_controller_command_list[] =
+static void pcat_controller_command_batch_func(
+    PCatControllerData *ctrl_data,
+    PCatControllerConnectionData *connection_data,
+    const gchar *command, const PCatControllerRequest *request)
 {
+    gint array;
+
+    if(connection_data->batch_responses!=NULL)
     {
-        .command = "pmu-status",
-        .callback = pcat_controller_command_pmu_status_func
-    },
-    {
-        .command = "schedule-power-event-set",
-        .callback = pcat_controller_command_schedule_power_event_set_func
-    },
-    {
-        .command = "schedule-power-event-get",
-        .callback = pcat_controller_command_schedule_power_event_get_func
-    },
-    {
-        .command = "modem-status-get",
-        .callback = pcat_controller_command_modem_status_get_func,
-    },
-    {
-        .command = "network-route-mode-get",
-        .callback = pcat_controller_command_network_route_mode_get_func,
-    },
-    {
-        .command = "charger-on-auto-start-set",
-        .callback = pcat_controller_command_charger_on_auto_start_set_func,
-    },
-    {
-        .command = "charger-on-auto-start-get",
-        .callback = pcat_controller_command_charger_on_auto_start_get_func,
-    },
-    {
-        .command = "pmu-fw-version-get",
-        .callback = pcat_controller_command_pmu_fw_version_get_func,
-    },
-    {
-        .command = "modem-rfkill-mode-set",
-        .callback = pcat_controller_command_modem_rfkill_mode_set_func,
-    },
+        return;
+    }
+
+    /* The batch may resume after a job, so keep it beyond the input. */
+    connection_data->batch_responses = json_object_new_array();
+    connection_data->batch_root = pcat_controller_request_json_new(request,
+        0);
+    connection_data->batch_index = 0;
+    connection_data->batch_length = 0;
+    connection_data->batch_code = 0;
+
+    array = pcat_controller_request_member_get(request, 0, "commands");
+    if(pcat_controller_request_type_get(request, array)==
+       PCAT_CONTROLLER_REQUEST_TYPE_ARRAY)
     {
-        .command = "modem-network-setup",
-        .callback = pcat_controller_command_modem_network_setup_func,
-    },
+        connection_data->batch_length = pcat_controller_request_length_get(
+            request, array);
+        if(connection_data->batch_length > PCAT_CONTROLLER_BATCH_COMMAND_MAX)
+        {
+            connection_data->batch_length = PCAT_CONTROLLER_BATCH_COMMAND_MAX;
+            connection_data->batch_code = 1;
+        }
+    }
+    else
     {
-        .command = "modem-network-get",
-        .callback = pcat_controller_command_modem_network_get_func,
-    },
-    { NULL, NULL }
+        connection_data->batch_code = 1;
+    }
+
+    pcat_controller_command_batch_continue(ctrl_data, connection_data);
+}
+
+static const PCatControllerCommandCallback
+    g_pcat_controller_command_callback_list[PCAT_CONTROLLER_COMMAND_LAST] =
+{
+    [PCAT_CONTROLLER_COMMAND_PMU_STATUS] =
+        pcat_controller_command_pmu_status_func,
+    [PCAT_CONTROLLER_COMMAND_SCHEDULE_POWER_EVENT_SET] =
+        pcat_controller_command_schedule_power_event_set_func,
+    [PCAT_CONTROLLER_COMMAND_SCHEDULE_POWER_EVENT_GET] =
+        pcat_controller_command_schedule_power_event_get_func,
+    [PCAT_CONTROLLER_COMMAND_MODEM_STATUS_GET] =
+        pcat_controller_command_modem_status_get_func,
+    [PCAT_CONTROLLER_COMMAND_NETWORK_ROUTE_MODE_GET] =
+        pcat_controller_command_network_route_mode_get_func,
+    [PCAT_CONTROLLER_COMMAND_CHARGER_ON_AUTO_START_SET] =
+        pcat_controller_command_charger_on_auto_start_set_func,
+    [PCAT_CONTROLLER_COMMAND_CHARGER_ON_AUTO_START_GET] =
+        pcat_controller_command_charger_on_auto_start_get_func,
+    [PCAT_CONTROLLER_COMMAND_PMU_FW_VERSION_GET] =
+        pcat_controller_command_pmu_fw_version_get_func,
+    [PCAT_CONTROLLER_COMMAND_MODEM_RFKILL_MODE_SET] =
+        pcat_controller_command_modem_rfkill_mode_set_func,
+    [PCAT_CONTROLLER_COMMAND_MODEM_NETWORK_SETUP] =
+        pcat_controller_command_modem_network_setup_func,
+    [PCAT_CONTROLLER_COMMAND_MODEM_NETWORK_GET] =
+        pcat_controller_command_modem_network_get_func,
+    [PCAT_CONTROLLER_COMMAND_BATCH] =
+        pcat_controller_command_batch_func,
+    [PCAT_CONTROLLER_COMMAND_HELLO] =
+        pcat_controller_command_hello_func,
+    [PCAT_CONTROLLER_COMMAND_SUBSCRIBE] =
+        pcat_controller_command_subscribe_func,
+    [PCAT_CONTROLLER_COMMAND_UNSUBSCRIBE] =
+        pcat_controller_command_unsubscribe_func,
+    [PCAT_CONTROLLER_COMMAND_METRICS_GET] =
+        pcat_controller_command_metrics_get_func,
+    [PCAT_CONTROLLER_COMMAND_COMMAND_STATS_GET] =
+        pcat_controller_command_command_stats_get_func,
+    [PCAT_CONTROLLER_COMMAND_SYSTEM_STATUS] =
+        pcat_controller_command_system_status_func,
 };
 
 static gboolean pcat_controller_unix_socket_open(
@@ -1244,30 +3949,123 @@ static gboolean pcat_controller_unix_socket_open(
 
     g_object_unref(address);
 
+    g_remove(PCAT_CONTROLLER_SEQPACKET_SOCKET_FILE);
+
+    address = g_unix_socket_address_new(
+        PCAT_CONTROLLER_SEQPACKET_SOCKET_FILE);
+    if(address!=NULL)
+    {
+        if(!g_socket_listener_add_address(G_SOCKET_LISTENER(service),
+            address, G_SOCKET_TYPE_SEQPACKET, G_SOCKET_PROTOCOL_DEFAULT,
+            NULL, NULL, &error))
+        {
+            g_warning("Failed to listen to unix seqpacket socket %s: %s",
+                PCAT_CONTROLLER_SEQPACKET_SOCKET_FILE, error!=NULL ?
+                error->message : "Unknown");
+
+            g_clear_error(&error);
+        }
+
+        g_object_unref(address);
+    }
+
     ctrl_data->control_socket_service = service;
     ctrl_data->control_connection_table = g_hash_table_new_full(
         g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)
-        pcat_controller_connection_data_free);
+        pcat_controller_connection_data_close);
     g_socket_service_start(ctrl_data->control_socket_service);
     g_signal_connect(service, "incoming",
         G_CALLBACK(pcat_controller_unix_socket_incoming_func), ctrl_data);
 
-    ctrl_data->connection_check_timeout_id = g_timeout_add_seconds(
-        1, pcat_controller_unix_socket_connection_check_timeout_func,
-        ctrl_data);
-
     return TRUE;
 }
 
-static void pcat_controller_unix_socket_close(
-    PCatControllerData *ctrl_data)
+static GBytes *pcat_controller_http_handler_func(const gchar *path,
+    const gchar **content_type, gpointer user_data)
+{
+    PCatControllerData *ctrl_data = (PCatControllerData *)user_data;
+    GBytes *message;
+    gchar *text;
+    gint64 now;
+
+    if(strcmp(path, "/status")==0)
+    {
+        message = pcat_controller_encoded_data_get(
+            pcat_controller_system_status_cache_get(ctrl_data,
+            PCAT_CONTROLLER_SYSTEM_STATUS_SECTION_ALL),
+            PCAT_CONTROLLER_CODEC_JSON);
+        if(message==NULL)
+        {
+            return NULL;
+        }
+
+        /* Same bytes as the socket response, minus the NUL delimiter. */
+        *content_type = "application/json";
+
+        return g_bytes_new_from_bytes(message, 0,
+            g_bytes_get_size(message) - 1);
+    }
+    else if(strcmp(path, "/metrics")==0)
+    {
+        /* Scrapers arriving together share one rendering. */
+        now = g_get_monotonic_time();
+        if(ctrl_data->http_metrics_text==NULL ||
+           now - ctrl_data->http_metrics_timestamp >=
+           PCAT_CONTROLLER_HTTP_METRICS_CACHE_TIME)
+        {
+            if(ctrl_data->http_metrics_text!=NULL)
+            {
+                g_bytes_unref(ctrl_data->http_metrics_text);
+            }
+
+            text = pcat_metrics_prometheus_text_new();
+            ctrl_data->http_metrics_text = g_bytes_new_take(text,
+                strlen(text));
+            ctrl_data->http_metrics_timestamp = now;
+        }
+
+        *content_type = "text/plain; version=0.0.4; charset=utf-8";
+
+        return g_bytes_ref(ctrl_data->http_metrics_text);
+    }
+
+    return NULL;
+}
+
+static void pcat_controller_http_open(PCatControllerData *ctrl_data,
+    const PCatManagerMainConfigData *main_config_data)
+{
+    if(main_config_data->ctrl_http_port==0)
+    {
+        return;
+    }
+
+    ctrl_data->http_server = pcat_controller_http_server_new(
+        ctrl_data->context, main_config_data->ctrl_http_address,
+        main_config_data->ctrl_http_port,
+        PCAT_CONTROLLER_HTTP_CONNECTION_MAX,
+        ctrl_data->connection_idle_timeout,
+        pcat_controller_http_handler_func, ctrl_data);
+}
+
+static void pcat_controller_http_close(PCatControllerData *ctrl_data)
 {
-    if(ctrl_data->connection_check_timeout_id > 0)
+    if(ctrl_data->http_server!=NULL)
+    {
+        pcat_controller_http_server_free(ctrl_data->http_server);
+        ctrl_data->http_server = NULL;
+    }
+
+    if(ctrl_data->http_metrics_text!=NULL)
     {
-        g_source_remove(ctrl_data->connection_check_timeout_id);
-        ctrl_data->connection_check_timeout_id = 0;
+        g_bytes_unref(ctrl_data->http_metrics_text);
+        ctrl_data->http_metrics_text = NULL;
     }
+}
 
+static void pcat_controller_unix_socket_close(
+    PCatControllerData *ctrl_data)
+{
     if(ctrl_data->control_connection_table!=NULL)
     {
         g_hash_table_unref(ctrl_data->control_connection_table);
@@ -1281,53 +4079,403 @@ static void pcat_controller_unix_socket_close(
     }
 
     g_remove(PCAT_CONTROLLER_SOCKET_FILE);
+    g_remove(PCAT_CONTROLLER_SEQPACKET_SOCKET_FILE);
 }
 
-gboolean pcat_controller_init()
+static gpointer pcat_controller_thread_func(gpointer user_data)
+{
+    PCatControllerData *ctrl_data = (PCatControllerData *)user_data;
+
+    g_main_context_push_thread_default(ctrl_data->context);
+    g_main_loop_run(ctrl_data->loop);
+    g_main_context_pop_thread_default(ctrl_data->context);
+
+    return NULL;
+}
+
+static gboolean pcat_controller_thread_quit_func(gpointer user_data)
+{
+    PCatControllerData *ctrl_data = (PCatControllerData *)user_data;
+
+    g_main_loop_quit(ctrl_data->loop);
+
+    return FALSE;
+}
+
+static gboolean pcat_controller_topic_subscribed(
+    PCatControllerData *ctrl_data, PCatControllerTopic topic)
+{
+    GHashTableIter iter;
+    PCatControllerConnectionData *connection_data;
+
+    if(ctrl_data->control_connection_table==NULL)
+    {
+        return FALSE;
+    }
+
+    g_hash_table_iter_init(&iter, ctrl_data->control_connection_table);
+    while(g_hash_table_iter_next(&iter, NULL, (gpointer *)&connection_data))
+    {
+        if(connection_data->topic_mask & (1U << topic))
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean pcat_controller_topic_changed_func(gpointer user_data)
+{
+    PCatControllerData *ctrl_data = (PCatControllerData *)user_data;
+    guint mask;
+    guint topic;
+
+    mask = g_atomic_int_and(&(ctrl_data->topic_changed_mask), 0);
+
+    for(topic=0;topic<PCAT_CONTROLLER_TOPIC_LAST;topic++)
+    {
+        if(!(mask & (1U << topic)))
+        {
+            continue;
+        }
+
+        if(!pcat_controller_topic_subscribed(ctrl_data, topic))
+        {
+            /* Only invalidate the caches keyed by the generation, the
+             * event is built again by the next subscribe. */
+            pcat_controller_encoded_data_clear(
+                &(ctrl_data->topic_message[topic]));
+            ctrl_data->topic_generation[topic]++;
+
+            continue;
+        }
+
+        if(pcat_controller_topic_message_update(ctrl_data, topic))
+        {
+            pcat_controller_topic_publish(ctrl_data, topic);
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean pcat_controller_gpio_event_func(gpointer user_data)
+{
+    PCatControllerData *ctrl_data = &g_pcat_controller_data;
+    struct json_object *rroot = (struct json_object *)user_data;
+
+    pcat_controller_encoded_data_set(&(ctrl_data->topic_message[
+        PCAT_CONTROLLER_TOPIC_GPIO]), rroot);
+    pcat_controller_topic_publish(ctrl_data, PCAT_CONTROLLER_TOPIC_GPIO);
+
+    return FALSE;
+}
+
+static void pcat_controller_fd_limit_raise(guint connection_max)
+{
+    struct rlimit limit;
+    rlim_t wanted;
+
+    if(getrlimit(RLIMIT_NOFILE, &limit)!=0)
+    {
+        return;
+    }
+
+    wanted = (rlim_t)connection_max + 64;
+    if(limit.rlim_cur >= wanted)
+    {
+        return;
+    }
+
+    limit.rlim_cur = (limit.rlim_max!=RLIM_INFINITY &&
+        limit.rlim_max < wanted) ? limit.rlim_max : wanted;
+    if(setrlimit(RLIMIT_NOFILE, &limit)!=0)
+    {
+        g_warning("Failed to raise open file limit for %u controller "
+            "clients: %s", connection_max, g_strerror(errno));
+    }
+}
+
+static void pcat_controller_metrics_register(PCatControllerData *ctrl_data)
 {
     guint i;
 
+    ctrl_data->output_slow_consumer_metric = pcat_metrics_counter_register(
+        "pcat_controller_slow_consumers_total", NULL, NULL,
+        "Controller clients that overflowed their output queue.");
+    ctrl_data->output_dropped_messages_metric =
+        pcat_metrics_counter_register(
+        "pcat_controller_output_dropped_messages_total", NULL, NULL,
+        "Controller output messages dropped by queue quotas.");
+    ctrl_data->output_dropped_bytes_metric = pcat_metrics_counter_register(
+        "pcat_controller_output_dropped_bytes_total", NULL, NULL,
+        "Controller output bytes dropped by queue quotas.");
+    ctrl_data->output_coalesced_messages_metric =
+        pcat_metrics_counter_register(
+        "pcat_controller_output_coalesced_messages_total", NULL, NULL,
+        "Topic events replaced by a newer event before being sent.");
+    ctrl_data->connection_metric = pcat_metrics_gauge_register(
+        "pcat_controller_connections", NULL, NULL,
+        "Controller clients currently connected.");
+    ctrl_data->connection_total_metric = pcat_metrics_counter_register(
+        "pcat_controller_connections_total", NULL, NULL,
+        "Controller clients accepted.");
+    ctrl_data->connection_rejected_metric = pcat_metrics_counter_register(
+        "pcat_controller_connections_rejected_total", NULL, NULL,
+        "Controller clients rejected by the connection limit.");
+    ctrl_data->connection_reaped_metric = pcat_metrics_counter_register(
+        "pcat_controller_connections_reaped_total", NULL, NULL,
+        "Controller clients closed for idling or not reading.");
+
+    for(i=0;i<PCAT_CONTROLLER_COMMAND_LAST;i++)
+    {
+        ctrl_data->command_metric[i] = pcat_metrics_counter_register(
+            "pcat_controller_commands_total", "command",
+            g_pcat_controller_command_info_list[i].command,
+            "Controller commands received.");
+        ctrl_data->command_throttled_metric[i] =
+            pcat_metrics_counter_register(
+            "pcat_controller_commands_throttled_total", "command",
+            g_pcat_controller_command_info_list[i].command,
+            "Controller commands rejected as busy by the rate limit.");
+    }
+}
+
+static void pcat_controller_command_rate_set(PCatControllerData *ctrl_data,
+    PCatControllerCommandRateClass rate_class, guint rate, guint burst)
+{
+    /* Rates are in commands per minute, the bucket holds burst commands
+     * and is refilled one command per interval. Rate 0 is unlimited. */
+    if(rate==0)
+    {
+        ctrl_data->command_rate_interval[rate_class] = 0;
+        ctrl_data->command_rate_tolerance[rate_class] = 0;
+
+        return;
+    }
+
+    ctrl_data->command_rate_interval[rate_class] =
+        (gint64)60 * G_USEC_PER_SEC / rate;
+    ctrl_data->command_rate_tolerance[rate_class] =
+        ctrl_data->command_rate_interval[rate_class] *
+        (gint64)(MAX(burst, 1) - 1);
+}
+
+gboolean pcat_controller_init()
+{
+    PCatManagerMainConfigData *main_config_data;
+    gboolean ret;
+
     if(g_pcat_controller_data.initialized)
     {
         return TRUE;
     }
 
-    if(!pcat_controller_unix_socket_open(&g_pcat_controller_data))
+    main_config_data = pcat_main_config_data_get();
+    g_pcat_controller_data.output_queue_size_max =
+        main_config_data->ctrl_output_queue_size_max;
+    g_pcat_controller_data.output_queue_message_max =
+        main_config_data->ctrl_output_queue_message_max;
+    g_pcat_controller_data.connection_max =
+        main_config_data->ctrl_connection_max;
+    g_pcat_controller_data.connection_idle_timeout =
+        (gint64)main_config_data->ctrl_connection_idle_timeout *
+        G_USEC_PER_SEC;
+    g_pcat_controller_data.connection_write_timeout =
+        (gint64)main_config_data->ctrl_connection_write_timeout *
+        G_USEC_PER_SEC;
+    g_pcat_controller_data.command_current = -1;
+    pcat_controller_command_rate_set(&g_pcat_controller_data,
+        PCAT_CONTROLLER_COMMAND_RATE_CLASS_READ,
+        main_config_data->ctrl_read_command_rate,
+        main_config_data->ctrl_read_command_burst);
+    pcat_controller_command_rate_set(&g_pcat_controller_data,
+        PCAT_CONTROLLER_COMMAND_RATE_CLASS_WRITE,
+        main_config_data->ctrl_write_command_rate,
+        main_config_data->ctrl_write_command_burst);
+
+    pcat_controller_fd_limit_raise(g_pcat_controller_data.connection_max);
+
+    pcat_controller_metrics_register(&g_pcat_controller_data);
+
+    /* Socket service and connection sources live in the controller
+     * context, so client traffic never delays the PMU serial link on the
+     * default context. */
+    g_pcat_controller_data.context = g_main_context_new();
+
+    g_main_context_push_thread_default(g_pcat_controller_data.context);
+    ret = pcat_controller_unix_socket_open(&g_pcat_controller_data);
+    if(ret)
     {
-        g_warning("Failed to open controller socket!");
-
-        return FALSE;
+        pcat_controller_http_open(&g_pcat_controller_data,
+            main_config_data);
     }
+    g_main_context_pop_thread_default(g_pcat_controller_data.context);
 
-    g_pcat_controller_data.command_table = g_hash_table_new_full(
-        g_str_hash, g_str_equal, g_free, NULL);
-    for(i=0;g_pcat_controller_command_list[i].command!=NULL;i++)
+    if(!ret)
     {
-        g_hash_table_replace(g_pcat_controller_data.command_table,
-            g_strdup(g_pcat_controller_command_list[i].command),
-            g_pcat_controller_command_list[i].callback);
+        g_warning("Failed to open controller socket!");
+
+        g_main_context_unref(g_pcat_controller_data.context);
+        g_pcat_controller_data.context = NULL;
+
+        return FALSE;
     }
 
+    g_pcat_controller_data.loop = g_main_loop_new(
+        g_pcat_controller_data.context, FALSE);
+    g_mutex_lock(&(g_pcat_controller_data.context_mutex));
     g_pcat_controller_data.initialized = TRUE;
+    g_mutex_unlock(&(g_pcat_controller_data.context_mutex));
+    g_pcat_controller_data.thread = g_thread_new("pcat-controller",
+        pcat_controller_thread_func, &g_pcat_controller_data);
 
     return TRUE;
 }
 
 void pcat_controller_uninit()
 {
+    guint i;
+
     if(!g_pcat_controller_data.initialized)
     {
         return;
     }
 
+    /* The PMU and modem threads are still running, from here on they
+     * no longer get the context to post to. */
+    g_mutex_lock(&(g_pcat_controller_data.context_mutex));
+    g_pcat_controller_data.initialized = FALSE;
+    g_mutex_unlock(&(g_pcat_controller_data.context_mutex));
+
+    g_main_context_invoke(g_pcat_controller_data.context,
+        pcat_controller_thread_quit_func, &g_pcat_controller_data);
+    g_thread_join(g_pcat_controller_data.thread);
+    g_pcat_controller_data.thread = NULL;
+
+    g_main_context_push_thread_default(g_pcat_controller_data.context);
+
+    pcat_controller_http_close(&g_pcat_controller_data);
     pcat_controller_unix_socket_close(&g_pcat_controller_data);
 
-    if(g_pcat_controller_data.command_table!=NULL)
+    for(i=0;i<PCAT_CONTROLLER_TOPIC_LAST;i++)
+    {
+        pcat_controller_encoded_data_clear(
+            &(g_pcat_controller_data.topic_message[i]));
+    }
+    for(i=0;i<PCAT_CONTROLLER_RESPONSE_CACHE_LAST;i++)
+    {
+        pcat_controller_encoded_data_clear(
+            &(g_pcat_controller_data.response_cache[i].message));
+    }
+    for(i=0;i<G_N_ELEMENTS(g_pcat_controller_data.system_status_cache);i++)
+    {
+        pcat_controller_encoded_data_clear(
+            &(g_pcat_controller_data.system_status_cache[i].message));
+    }
+
+    g_main_context_pop_thread_default(g_pcat_controller_data.context);
+
+    g_main_loop_unref(g_pcat_controller_data.loop);
+    g_pcat_controller_data.loop = NULL;
+    g_main_context_unref(g_pcat_controller_data.context);
+    g_pcat_controller_data.context = NULL;
+}
+
+static gboolean pcat_controller_context_post(GSourceFunc func,
+    gpointer data, GDestroyNotify notify)
+{
+    GSource *source;
+    gboolean ret = FALSE;
+
+    /* Called from the PMU and modem threads. Unlike invoking, attaching
+     * never runs the function in the calling thread, and the lock keeps
+     * the context alive until the source is attached. */
+    g_mutex_lock(&(g_pcat_controller_data.context_mutex));
+    if(g_pcat_controller_data.initialized)
     {
-        g_hash_table_unref(g_pcat_controller_data.command_table);
-        g_pcat_controller_data.command_table = NULL;
+        source = g_idle_source_new();
+        g_source_set_priority(source, G_PRIORITY_DEFAULT);
+        g_source_set_callback(source, func, data, notify);
+        g_source_attach(source, g_pcat_controller_data.context);
+        g_source_unref(source);
+        ret = TRUE;
     }
+    g_mutex_unlock(&(g_pcat_controller_data.context_mutex));
 
-    g_pcat_controller_data.initialized = FALSE;
+    if(!ret && notify!=NULL)
+    {
+        notify(data);
+    }
+
+    return ret;
+}
+
+void pcat_controller_pmu_gpio_event_push(gint64 timestamp,
+    guint16 gpio_input, guint16 gpio_input_changed, guint16 gpio_output,
+    guint16 gpio_output_changed)
+{
+    struct json_object *rroot, *child;
+
+    if(!g_atomic_int_get(&(g_pcat_controller_data.initialized)))
+    {
+        return;
+    }
+
+    rroot = json_object_new_object();
+
+    child = json_object_new_string("event");
+    json_object_object_add(rroot, "command", child);
+
+    child = json_object_new_string("gpio");
+    json_object_object_add(rroot, "topic", child);
+
+    child = json_object_new_int(0);
+    json_object_object_add(rroot, "code", child);
+
+    child = json_object_new_int64(timestamp);
+    json_object_object_add(rroot, "timestamp", child);
+
+    child = json_object_new_int(gpio_input);
+    json_object_object_add(rroot, "gpio-input", child);
+
+    child = json_object_new_int(gpio_input_changed & gpio_input);
+    json_object_object_add(rroot, "gpio-input-rising", child);
+
+    child = json_object_new_int(gpio_input_changed & ~gpio_input & 0xFFFF);
+    json_object_object_add(rroot, "gpio-input-falling", child);
+
+    child = json_object_new_int(gpio_output);
+    json_object_object_add(rroot, "gpio-output", child);
+
+    child = json_object_new_int(gpio_output_changed & gpio_output);
+    json_object_object_add(rroot, "gpio-output-rising", child);
+
+    child = json_object_new_int(gpio_output_changed & ~gpio_output & 0xFFFF);
+    json_object_object_add(rroot, "gpio-output-falling", child);
+
+    pcat_controller_context_post(pcat_controller_gpio_event_func, rroot,
+        (GDestroyNotify)json_object_put);
+
+    g_debug("PMU GPIO changed, input %X (changed %X), output %X "
+        "(changed %X).", gpio_input, gpio_input_changed, gpio_output,
+        gpio_output_changed);
 }
 
+void pcat_controller_topic_state_changed(PCatControllerTopic topic)
+{
+    if(topic >= PCAT_CONTROLLER_TOPIC_LAST)
+    {
+        return;
+    }
+
+    /* May be called from any thread, changes are folded into one update
+     * on the controller context. */
+    if(g_atomic_int_or(&(g_pcat_controller_data.topic_changed_mask),
+        1U << topic)==0)
+    {
+        pcat_controller_context_post(pcat_controller_topic_changed_func,
+            &g_pcat_controller_data, NULL);
+    }
+}
@@ -5,8 +5,23 @@
 
 G_BEGIN_DECLS
 
+typedef enum
+{
+    PCAT_CONTROLLER_TOPIC_BATTERY = 0,
+    PCAT_CONTROLLER_TOPIC_CHARGER,
+    PCAT_CONTROLLER_TOPIC_MODEM,
+    PCAT_CONTROLLER_TOPIC_ROUTE,
+    PCAT_CONTROLLER_TOPIC_SCHEDULE,
+    PCAT_CONTROLLER_TOPIC_GPIO,
+    PCAT_CONTROLLER_TOPIC_LAST
+}PCatControllerTopic;
+
 gboolean pcat_controller_init();
 void pcat_controller_uninit();
+void pcat_controller_pmu_gpio_event_push(gint64 timestamp,
+    guint16 gpio_input, guint16 gpio_input_changed, guint16 gpio_output,
+    guint16 gpio_output_changed);
+void pcat_controller_topic_state_changed(PCatControllerTopic topic);
 
 G_END_DECLS
 
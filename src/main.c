@@ -1,4 +1,5 @@
 #include <unistd.h>
+#include <fcntl.h>
 #include <string.h>
 #include <stdio.h>
 #include <signal.h>
@@ -11,12 +12,14 @@
 #include "modem-manager.h"
 #include "pmu-manager.h"
 #include "controller.h"
+#include "metrics.h"
 
 #define PCAT_MAIN_MWAN_STATUS_CHECK_TIMEOUT 30
 #define PCAT_MAIN_MWAN_STATUS_CHECK_BOOT_WAIT 120
 
 #define PCAT_MAIN_CONFIG_FILE "/etc/pcat-manager.conf"
 #define PCAT_MAIN_USER_CONFIG_FILE "/etc/pcat-manager-userdata.conf"
+#define PCAT_MAIN_USER_CONFIG_SAVE_DELAY 2000
 #define PCAT_MAIN_SHUTDOWN_REQUEST_FILE "/tmp/pcat-shutdown.tmp"
 
 #define PCAT_MAIN_LOG_FILE "/tmp/pcat-manager.log"
@@ -58,6 +61,7 @@ static const guint g_pcat_main_shutdown_wait_max = 30;
 
 static gboolean g_pcat_main_cmd_daemonsize = FALSE;
 static gboolean g_pcat_main_cmd_distro = FALSE;
+static gboolean g_pcat_main_cmd_stub_hardware = FALSE;
 
 static GMainLoop *g_pcat_main_loop = NULL;
 static gboolean g_pcat_main_shutdown = FALSE;
@@ -78,8 +82,28 @@ static gboolean g_pcat_main_mwan_route_check_flag = TRUE;
 static gboolean g_pcat_main_connection_check_flag = TRUE;
 
 static PCatManagerMainConfigData g_pcat_main_config_data = {0};
-static PCatManagerUserConfigData g_pcat_main_user_config_data =
-    {0};
+static PCatManagerUserConfigData *g_pcat_main_user_config_data = NULL;
+static GMutex g_pcat_main_user_config_mutex;
+static GMutex g_pcat_main_user_config_edit_mutex;
+static guint g_pcat_main_user_config_written_version = 0;
+
+static GThread *g_pcat_main_user_config_writer_thread = NULL;
+static GMutex g_pcat_main_user_config_writer_mutex;
+static GCond g_pcat_main_user_config_writer_cond;
+static guint g_pcat_main_user_config_writer_request_serial = 0;
+static guint g_pcat_main_user_config_writer_done_serial = 0;
+static gint64 g_pcat_main_user_config_writer_deadline = 0;
+static gboolean g_pcat_main_user_config_writer_flush = FALSE;
+static gboolean g_pcat_main_user_config_writer_quit = FALSE;
+
+static PCatMetricsItem *g_pcat_main_loop_latency_metric = NULL;
+static PCatMetricsItem *g_pcat_main_spawn_metric = NULL;
+static PCatMetricsItem *g_pcat_main_user_config_write_metric = NULL;
+
+static const gdouble g_pcat_main_loop_latency_bounds[] =
+{
+    0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1.0, 5.0
+};
 
 static FILE *g_pcat_main_debug_log_file_fp = NULL;
 
@@ -89,6 +113,10 @@ static GOptionEntry g_pcat_cmd_entries[] =
         "Run as a daemon", NULL },
     { "distro", 0, 0, G_OPTION_ARG_NONE, &g_pcat_main_cmd_distro,
         "Run this program on normal Linux distros (not OpenWRT)", NULL },
+    { "stub-hardware", 0, 0, G_OPTION_ARG_NONE,
+        &g_pcat_main_cmd_stub_hardware,
+        "Do not touch PMU, modem and network hardware (for benchmarks)",
+        NULL },
     { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
 };
 
@@ -96,6 +124,8 @@ static void pcat_main_config_data_clear()
 {
     g_free(g_pcat_main_config_data.pm_serial_device);
     g_pcat_main_config_data.pm_serial_device = NULL;
+    g_free(g_pcat_main_config_data.ctrl_http_address);
+    g_pcat_main_config_data.ctrl_http_address = NULL;
 
     g_pcat_main_config_data.valid = FALSE;
 }
@@ -239,6 +269,38 @@ static gboolean pcat_main_config_data_load()
         "SerialBaud", NULL);
     g_pcat_main_config_data.pm_serial_baud = ivalue;
 
+    ivalue = g_key_file_get_integer(keyfile, "PowerManager",
+        "SerialLowLatency", NULL);
+    g_pcat_main_config_data.pm_serial_low_latency = (ivalue!=0);
+
+    /* VMIN 0 is valid, only fall back to 1 when the key is absent. */
+    g_pcat_main_config_data.pm_serial_read_vmin = 1;
+    if(g_key_file_has_key(keyfile, "PowerManager", "SerialReadVMin", NULL))
+    {
+        ivalue = g_key_file_get_integer(keyfile, "PowerManager",
+            "SerialReadVMin", &error);
+        if(error==NULL && ivalue >= 0 && ivalue <= 255)
+        {
+            g_pcat_main_config_data.pm_serial_read_vmin = ivalue;
+        }
+        else
+        {
+            g_warning("Invalid SerialReadVMin, using 1!");
+        }
+        g_clear_error(&error);
+    }
+
+    ivalue = g_key_file_get_integer(keyfile, "PowerManager",
+        "SerialReadVTime", NULL);
+    if(ivalue > 0 && ivalue <= 255)
+    {
+        g_pcat_main_config_data.pm_serial_read_vtime = ivalue;
+    }
+    else
+    {
+        g_pcat_main_config_data.pm_serial_read_vtime = 0;
+    }
+
     ivalue = g_key_file_get_integer(keyfile, "PowerManager",
         "AutoShutdownVoltageGeneral", NULL);
     if(ivalue >= 3000 && ivalue < 3700)
@@ -360,6 +422,128 @@ static gboolean pcat_main_config_data_load()
         g_pcat_main_config_data.pm_battery_full_threshold = 0;
     }
 
+    ivalue = g_key_file_get_integer(keyfile, "Controller",
+        "OutputQueueSizeMax", NULL);
+    if(ivalue >= 65536)
+    {
+        g_pcat_main_config_data.ctrl_output_queue_size_max = ivalue;
+    }
+    else
+    {
+        g_pcat_main_config_data.ctrl_output_queue_size_max = 2097152;
+    }
+
+    ivalue = g_key_file_get_integer(keyfile, "Controller",
+        "OutputQueueMessageMax", NULL);
+    if(ivalue >= 16)
+    {
+        g_pcat_main_config_data.ctrl_output_queue_message_max = ivalue;
+    }
+    else
+    {
+        g_pcat_main_config_data.ctrl_output_queue_message_max = 1024;
+    }
+
+    ivalue = g_key_file_get_integer(keyfile, "Controller",
+        "ConnectionMax", NULL);
+    if(ivalue > 0)
+    {
+        g_pcat_main_config_data.ctrl_connection_max = ivalue;
+    }
+    else
+    {
+        g_pcat_main_config_data.ctrl_connection_max = 2048;
+    }
+
+    ivalue = g_key_file_get_integer(keyfile, "Controller",
+        "ConnectionIdleTimeout", NULL);
+    if(ivalue > 0)
+    {
+        g_pcat_main_config_data.ctrl_connection_idle_timeout = ivalue;
+    }
+    else
+    {
+        g_pcat_main_config_data.ctrl_connection_idle_timeout = 600;
+    }
+
+    ivalue = g_key_file_get_integer(keyfile, "Controller",
+        "ConnectionWriteTimeout", NULL);
+    if(ivalue > 0)
+    {
+        g_pcat_main_config_data.ctrl_connection_write_timeout = ivalue;
+    }
+    else
+    {
+        g_pcat_main_config_data.ctrl_connection_write_timeout = 30;
+    }
+
+    ivalue = g_key_file_get_integer(keyfile, "Controller",
+        "ReadCommandRate", NULL);
+    if(ivalue > 0)
+    {
+        g_pcat_main_config_data.ctrl_read_command_rate = ivalue;
+    }
+    else
+    {
+        /* Unlimited, reads are cheap and served from caches. */
+        g_pcat_main_config_data.ctrl_read_command_rate = 0;
+    }
+
+    ivalue = g_key_file_get_integer(keyfile, "Controller",
+        "ReadCommandBurst", NULL);
+    if(ivalue > 0)
+    {
+        g_pcat_main_config_data.ctrl_read_command_burst = ivalue;
+    }
+    else
+    {
+        g_pcat_main_config_data.ctrl_read_command_burst = 64;
+    }
+
+    ivalue = g_key_file_get_integer(keyfile, "Controller",
+        "WriteCommandRate", NULL);
+    if(ivalue > 0)
+    {
+        g_pcat_main_config_data.ctrl_write_command_rate = ivalue;
+    }
+    else
+    {
+        g_pcat_main_config_data.ctrl_write_command_rate = 12;
+    }
+
+    ivalue = g_key_file_get_integer(keyfile, "Controller",
+        "WriteCommandBurst", NULL);
+    if(ivalue > 0)
+    {
+        g_pcat_main_config_data.ctrl_write_command_burst = ivalue;
+    }
+    else
+    {
+        g_pcat_main_config_data.ctrl_write_command_burst = 4;
+    }
+
+    if(g_pcat_main_config_data.ctrl_http_address!=NULL)
+    {
+        g_free(g_pcat_main_config_data.ctrl_http_address);
+    }
+    g_pcat_main_config_data.ctrl_http_address = g_key_file_get_string(
+        keyfile, "Controller", "HttpAddress", NULL);
+    if(g_pcat_main_config_data.ctrl_http_address==NULL)
+    {
+        g_pcat_main_config_data.ctrl_http_address = g_strdup("127.0.0.1");
+    }
+
+    ivalue = g_key_file_get_integer(keyfile, "Controller",
+        "HttpPort", NULL);
+    if(ivalue > 0 && ivalue <= 65535)
+    {
+        g_pcat_main_config_data.ctrl_http_port = ivalue;
+    }
+    else
+    {
+        g_pcat_main_config_data.ctrl_http_port = 0;
+    }
+
     ivalue = g_key_file_get_integer(keyfile, "Debug",
         "ModemExternalExecStdoutLog", NULL);
     g_pcat_main_config_data.debug_modem_external_exec_stdout_log =
@@ -376,6 +560,34 @@ static gboolean pcat_main_config_data_load()
     return TRUE;
 }
 
+static void pcat_main_user_config_data_free(
+    PCatManagerUserConfigData *uconfig_data)
+{
+    if(uconfig_data->power_schedule_data!=NULL)
+    {
+        g_ptr_array_unref(uconfig_data->power_schedule_data);
+    }
+    g_free(uconfig_data->modem_dial_apn);
+    g_free(uconfig_data->modem_dial_user);
+    g_free(uconfig_data->modem_dial_password);
+    g_free(uconfig_data->modem_dial_auth);
+    g_free(uconfig_data);
+}
+
+static void pcat_main_user_config_data_publish(
+    PCatManagerUserConfigData *uconfig_data)
+{
+    PCatManagerUserConfigData *old_data;
+
+    g_mutex_lock(&g_pcat_main_user_config_mutex);
+    old_data = g_pcat_main_user_config_data;
+    uconfig_data->version = old_data!=NULL ? old_data->version + 1 : 1;
+    g_pcat_main_user_config_data = uconfig_data;
+    g_mutex_unlock(&g_pcat_main_user_config_mutex);
+
+    pcat_main_user_config_data_unref(old_data);
+}
+
 static gboolean pcat_main_user_config_data_load()
 {
     GKeyFile *keyfile;
@@ -384,11 +596,13 @@ static gboolean pcat_main_user_config_data_load()
     gchar *sv;
     guint i;
     gchar item_name[32] = {0};
-    PCatManagerUserConfigData *uconfig_data =
-        &g_pcat_main_user_config_data;
+    PCatManagerUserConfigData *uconfig_data;
     PCatManagerPowerScheduleData *sdata;
 
-    uconfig_data->valid = FALSE;
+    uconfig_data = g_new0(PCatManagerUserConfigData, 1);
+    uconfig_data->ref_count = 1;
+    uconfig_data->power_schedule_data = g_ptr_array_new_with_free_func(g_free);
+    uconfig_data->modem_5g_fail_timeout = 600;
 
     keyfile = g_key_file_new();
 
@@ -400,15 +614,13 @@ static gboolean pcat_main_user_config_data_load()
             error->message!=NULL ? error->message : "Unknown");
 
         g_clear_error(&error);
+        g_key_file_unref(keyfile);
 
-        return FALSE;
-    }
+        pcat_main_user_config_data_publish(uconfig_data);
+        g_pcat_main_user_config_written_version = uconfig_data->version;
 
-    if(uconfig_data->power_schedule_data!=NULL)
-    {
-        g_ptr_array_unref(uconfig_data->power_schedule_data);
+        return FALSE;
     }
-    uconfig_data->power_schedule_data = g_ptr_array_new_with_free_func(g_free);
 
     for(i=0;;i++)
     {
@@ -461,7 +673,6 @@ static gboolean pcat_main_user_config_data_load()
         g_key_file_get_integer(keyfile, "General",
         "ChargerOnAutoStartTimeout", NULL);
 
-    g_free(uconfig_data->modem_dial_apn);
     sv = g_key_file_get_string(keyfile, "Modem", "APN", NULL);
     if(sv!=NULL && *sv!='\0')
     {
@@ -472,7 +683,6 @@ static gboolean pcat_main_user_config_data_load()
         uconfig_data->modem_dial_apn = NULL;
     }
 
-    g_free(uconfig_data->modem_dial_user);
     sv = g_key_file_get_string(keyfile, "Modem", "User", NULL);
     if(sv!=NULL && *sv!='\0')
     {
@@ -483,7 +693,6 @@ static gboolean pcat_main_user_config_data_load()
         uconfig_data->modem_dial_user = NULL;
     }
 
-    g_free(uconfig_data->modem_dial_password);
     sv = g_key_file_get_string(keyfile, "Modem", "Password", NULL);
     if(sv!=NULL && *sv!='\0')
     {
@@ -494,7 +703,6 @@ static gboolean pcat_main_user_config_data_load()
         uconfig_data->modem_dial_password = NULL;
     }
 
-    g_free(uconfig_data->modem_dial_auth);
     sv = g_key_file_get_string(keyfile, "Modem", "Auth", NULL);
     if(sv!=NULL && *sv!='\0')
     {
@@ -521,27 +729,20 @@ static gboolean pcat_main_user_config_data_load()
 
     g_key_file_unref(keyfile);
 
-    uconfig_data->valid = TRUE;
-    uconfig_data->dirty = FALSE;
+    pcat_main_user_config_data_publish(uconfig_data);
+    g_pcat_main_user_config_written_version = uconfig_data->version;
 
     return TRUE;
 }
 
-static gboolean pcat_main_user_config_data_save()
+static gchar *pcat_main_user_config_data_serialize(
+    const PCatManagerUserConfigData *uconfig_data, gsize *length)
 {
     GKeyFile *keyfile;
-    GError *error = NULL;
+    gchar *data;
     guint i;
     gchar item_name[32] = {0};
-    PCatManagerUserConfigData *uconfig_data =
-        &g_pcat_main_user_config_data;
-    PCatManagerPowerScheduleData *sdata;
-    gboolean ret;
-
-    if(!uconfig_data->dirty)
-    {
-        return TRUE;
-    }
+    const PCatManagerPowerScheduleData *sdata;
 
     keyfile = g_key_file_new();
 
@@ -607,24 +808,209 @@ static gboolean pcat_main_user_config_data_save()
     g_key_file_set_integer(keyfile, "Modem", "Connection5GFailTimeout",
         uconfig_data->modem_5g_fail_timeout);
 
-    ret = g_key_file_save_to_file(keyfile, PCAT_MAIN_USER_CONFIG_FILE,
-        &error);
-    if(ret)
+    data = g_key_file_to_data(keyfile, length, NULL);
+
+    g_key_file_unref(keyfile);
+
+    return data;
+}
+
+static gboolean pcat_main_user_config_file_write(const gchar *data,
+    gsize length)
+{
+    gchar *tmp_path, *dir_path;
+    gint fd, dir_fd;
+    gssize wsize;
+    gsize written = 0;
+
+    tmp_path = g_strdup_printf("%s.tmp", PCAT_MAIN_USER_CONFIG_FILE);
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0)
     {
-        uconfig_data->dirty = FALSE;
+        g_warning("Failed to open user configuration temporary file "
+            "%s: %s", tmp_path, g_strerror(errno));
+        g_free(tmp_path);
+
+        return FALSE;
     }
-    else
+
+    while(written < length)
+    {
+        wsize = write(fd, data + written, length - written);
+        if(wsize < 0)
+        {
+            if(errno==EINTR)
+            {
+                continue;
+            }
+
+            break;
+        }
+        written += wsize;
+    }
+
+    if(written < length || fsync(fd)!=0)
+    {
+        g_warning("Failed to write user configuration temporary file "
+            "%s: %s", tmp_path, g_strerror(errno));
+        close(fd);
+        unlink(tmp_path);
+        g_free(tmp_path);
+
+        return FALSE;
+    }
+    close(fd);
+
+    if(rename(tmp_path, PCAT_MAIN_USER_CONFIG_FILE)!=0)
     {
         g_warning("Failed to save user configuration data to file %s: %s",
-            PCAT_MAIN_USER_CONFIG_FILE, error->message!=NULL ?
-            error->message : "Unknown");
+            PCAT_MAIN_USER_CONFIG_FILE, g_strerror(errno));
+        unlink(tmp_path);
+        g_free(tmp_path);
+
+        return FALSE;
     }
+    g_free(tmp_path);
 
-    g_key_file_unref(keyfile);
+    dir_path = g_path_get_dirname(PCAT_MAIN_USER_CONFIG_FILE);
+    dir_fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dir_fd >= 0)
+    {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    g_free(dir_path);
 
     return TRUE;
 }
 
+static gpointer pcat_main_user_config_writer_thread_func(gpointer user_data)
+{
+    guint serial;
+    gchar *data;
+    gsize length = 0;
+    const PCatManagerUserConfigData *uconfig_data;
+
+    g_mutex_lock(&g_pcat_main_user_config_writer_mutex);
+
+    while(TRUE)
+    {
+        if(g_pcat_main_user_config_writer_done_serial==
+            g_pcat_main_user_config_writer_request_serial)
+        {
+            if(g_pcat_main_user_config_writer_quit)
+            {
+                break;
+            }
+
+            g_cond_wait(&g_pcat_main_user_config_writer_cond,
+                &g_pcat_main_user_config_writer_mutex);
+
+            continue;
+        }
+
+        if(!g_pcat_main_user_config_writer_flush &&
+            !g_pcat_main_user_config_writer_quit &&
+            g_get_monotonic_time() < g_pcat_main_user_config_writer_deadline)
+        {
+            g_cond_wait_until(&g_pcat_main_user_config_writer_cond,
+                &g_pcat_main_user_config_writer_mutex,
+                g_pcat_main_user_config_writer_deadline);
+
+            continue;
+        }
+
+        serial = g_pcat_main_user_config_writer_request_serial;
+
+        g_mutex_unlock(&g_pcat_main_user_config_writer_mutex);
+
+        uconfig_data = pcat_main_user_config_data_get();
+
+        if(uconfig_data->version!=g_pcat_main_user_config_written_version)
+        {
+            data = pcat_main_user_config_data_serialize(uconfig_data,
+                &length);
+
+            if(pcat_main_user_config_file_write(data, length))
+            {
+                g_pcat_main_user_config_written_version =
+                    uconfig_data->version;
+                pcat_metrics_counter_add(
+                    g_pcat_main_user_config_write_metric, 1);
+            }
+
+            g_free(data);
+        }
+
+        pcat_main_user_config_data_unref(uconfig_data);
+
+        g_mutex_lock(&g_pcat_main_user_config_writer_mutex);
+
+        g_pcat_main_user_config_writer_done_serial = serial;
+        if(serial==g_pcat_main_user_config_writer_request_serial)
+        {
+            g_pcat_main_user_config_writer_flush = FALSE;
+        }
+
+        g_cond_broadcast(&g_pcat_main_user_config_writer_cond);
+    }
+
+    g_mutex_unlock(&g_pcat_main_user_config_writer_mutex);
+
+    return NULL;
+}
+
+static void pcat_main_user_config_writer_flush()
+{
+    guint serial;
+
+    if(g_pcat_main_user_config_writer_thread==NULL)
+    {
+        return;
+    }
+
+    g_mutex_lock(&g_pcat_main_user_config_writer_mutex);
+
+    serial = g_pcat_main_user_config_writer_request_serial;
+    g_pcat_main_user_config_writer_flush = TRUE;
+    g_cond_broadcast(&g_pcat_main_user_config_writer_cond);
+
+    while((gint)(g_pcat_main_user_config_writer_done_serial - serial) < 0)
+    {
+        g_cond_wait(&g_pcat_main_user_config_writer_cond,
+            &g_pcat_main_user_config_writer_mutex);
+    }
+
+    g_mutex_unlock(&g_pcat_main_user_config_writer_mutex);
+}
+
+static void pcat_main_user_config_writer_start()
+{
+    g_pcat_main_user_config_writer_quit = FALSE;
+    g_pcat_main_user_config_writer_thread = g_thread_new(
+        "pcat-uconfig-writer", pcat_main_user_config_writer_thread_func,
+        NULL);
+}
+
+static void pcat_main_user_config_writer_stop()
+{
+    if(g_pcat_main_user_config_writer_thread==NULL)
+    {
+        return;
+    }
+
+    pcat_main_user_config_writer_flush();
+
+    g_mutex_lock(&g_pcat_main_user_config_writer_mutex);
+    g_pcat_main_user_config_writer_quit = TRUE;
+    g_cond_broadcast(&g_pcat_main_user_config_writer_cond);
+    g_mutex_unlock(&g_pcat_main_user_config_writer_mutex);
+
+    g_thread_join(g_pcat_main_user_config_writer_thread);
+    g_pcat_main_user_config_writer_thread = NULL;
+}
+
 static gboolean pcat_main_shutdown_check_timeout_func(
     gpointer user_data)
 {
@@ -795,6 +1181,7 @@ static void *pcat_main_mwan_policy_check_thread_func(void *user_data)
                 g_pcat_main_iface_names[i]);
             g_spawn_command_line_sync(command, &interface_status_stdout,
                 NULL, NULL, NULL);
+            pcat_metrics_counter_add(g_pcat_main_spawn_metric, 1);
             g_free(command);
 
             G_STMT_START
@@ -862,6 +1249,7 @@ static void *pcat_main_mwan_policy_check_thread_func(void *user_data)
 
         g_spawn_command_line_sync("ubus call mwan3 status", &mwan3_stdout,
             NULL, NULL, NULL);
+        pcat_metrics_counter_add(g_pcat_main_spawn_metric, 1);
 
         ret = FALSE;
 
@@ -1138,6 +1526,7 @@ static void *pcat_main_connection_check_thread_func(void *user_data)
             {
                 command = g_strdup_printf("ping -W 3 -w 3 -c 1 -q %s",
                     check_address_list[i]);
+                pcat_metrics_counter_add(g_pcat_main_spawn_metric, 1);
                 if(g_spawn_command_line_sync(command, NULL,
                     NULL, &wstatus, NULL))
                 {
@@ -1176,6 +1565,8 @@ static void *pcat_main_connection_check_thread_func(void *user_data)
 
 static gboolean pcat_main_status_check_timeout_func(gpointer user_data)
 {
+    pcat_main_loop_latency_sample();
+
     if(g_pcat_main_net_status_led_applied_mode!=
            g_pcat_main_network_route_mode)
     {
@@ -1225,6 +1616,8 @@ static gboolean pcat_main_status_check_timeout_func(gpointer user_data)
 
         g_pcat_main_net_status_led_applied_mode =
             g_pcat_main_network_route_mode;
+
+        pcat_controller_topic_state_changed(PCAT_CONTROLLER_TOPIC_ROUTE);
     }
 
     return TRUE;
@@ -1347,6 +1740,20 @@ int main(int argc, char *argv[])
         g_warning("Failed to load user config data, use default one!");
     }
 
+    pcat_metrics_init();
+
+    g_pcat_main_loop_latency_metric = pcat_metrics_histogram_register(
+        "pcat_main_loop_latency_seconds", NULL, NULL,
+        "Delay of a periodic timer on the main loop past its deadline.",
+        g_pcat_main_loop_latency_bounds,
+        G_N_ELEMENTS(g_pcat_main_loop_latency_bounds));
+    g_pcat_main_spawn_metric = pcat_metrics_counter_register(
+        "pcat_subprocess_spawns_total", "module", "main",
+        "Subprocesses spawned by pcat-manager.");
+    g_pcat_main_user_config_write_metric = pcat_metrics_counter_register(
+        "pcat_user_config_writes_total", NULL, NULL,
+        "User configuration file writes.");
+
     if(g_pcat_main_cmd_daemonsize)
     {
         daemon(0, 0);
@@ -1358,16 +1765,26 @@ int main(int argc, char *argv[])
 
     g_pcat_main_loop = g_main_loop_new(NULL, FALSE);
 
-    if(!pcat_pmu_manager_init())
+    pcat_main_user_config_writer_start();
+
+    if(g_pcat_main_cmd_stub_hardware)
     {
-        g_warning("Failed to initialize PMU manager, "
-            "power management may not work!");
+        g_message("Running with stubbed hardware, PMU and modem "
+            "managers are disabled.");
     }
-
-    if(!pcat_modem_manager_init())
+    else
     {
-        g_warning("Failed to initialize modem manager, "
-            "LTE/5G modem may not work!");
+        if(!pcat_pmu_manager_init())
+        {
+            g_warning("Failed to initialize PMU manager, "
+                "power management may not work!");
+        }
+
+        if(!pcat_modem_manager_init())
+        {
+            g_warning("Failed to initialize modem manager, "
+                "LTE/5G modem may not work!");
+        }
     }
     if(!pcat_controller_init())
     {
@@ -1375,7 +1792,7 @@ int main(int argc, char *argv[])
             "communicate with other processes.");
     }
 
-    if(!g_pcat_main_cmd_distro)
+    if(!g_pcat_main_cmd_distro && !g_pcat_main_cmd_stub_hardware)
     {
         if(pthread_create(&mwan_policy_check_thread, NULL,
             pcat_main_mwan_policy_check_thread_func, NULL)!=0)
@@ -1418,8 +1835,12 @@ int main(int argc, char *argv[])
     g_pcat_main_loop = NULL;
 
     pcat_controller_uninit();
+    pcat_main_user_config_writer_stop();
     pcat_modem_manager_uninit();
     pcat_pmu_manager_uninit();
+    pcat_metrics_uninit();
+    pcat_main_user_config_data_unref(g_pcat_main_user_config_data);
+    g_pcat_main_user_config_data = NULL;
     g_option_context_free(context);
     pcat_main_config_data_clear();
 
@@ -1437,9 +1858,28 @@ PCatManagerMainConfigData *pcat_main_config_data_get()
     return &g_pcat_main_config_data;
 }
 
-PCatManagerUserConfigData *pcat_main_user_config_data_get()
+const PCatManagerUserConfigData *pcat_main_user_config_data_get()
 {
-    return &g_pcat_main_user_config_data;
+    PCatManagerUserConfigData *uconfig_data;
+
+    g_mutex_lock(&g_pcat_main_user_config_mutex);
+    uconfig_data = g_pcat_main_user_config_data;
+    g_atomic_int_inc(&uconfig_data->ref_count);
+    g_mutex_unlock(&g_pcat_main_user_config_mutex);
+
+    return uconfig_data;
+}
+
+void pcat_main_user_config_data_unref(const PCatManagerUserConfigData *data)
+{
+    PCatManagerUserConfigData *uconfig_data =
+        (PCatManagerUserConfigData *)data;
+
+    if(uconfig_data!=NULL &&
+        g_atomic_int_dec_and_test(&uconfig_data->ref_count))
+    {
+        pcat_main_user_config_data_free(uconfig_data);
+    }
 }
 
 void pcat_main_request_shutdown(gboolean send_pmu_request)
@@ -1447,11 +1887,93 @@ void pcat_main_request_shutdown(gboolean send_pmu_request)
     g_pcat_main_request_shutdown = TRUE;
     g_pcat_main_request_shutdown_send_pmu_request = send_pmu_request;
     g_spawn_command_line_async("poweroff", NULL);
+    pcat_metrics_counter_add(g_pcat_main_spawn_metric, 1);
 }
 
-void pcat_main_user_config_data_sync()
+static gboolean pcat_main_user_config_data_sync()
 {
-    pcat_main_user_config_data_save();
+    const PCatManagerUserConfigData *uconfig_data;
+    gchar *data;
+    gsize length = 0;
+    gboolean ret = TRUE;
+
+    if(g_pcat_main_user_config_writer_thread==NULL)
+    {
+        /* Edits outside the main loop run are written right away. */
+        uconfig_data = pcat_main_user_config_data_get();
+
+        if(uconfig_data->version!=g_pcat_main_user_config_written_version)
+        {
+            data = pcat_main_user_config_data_serialize(uconfig_data,
+                &length);
+            ret = pcat_main_user_config_file_write(data, length);
+            if(ret)
+            {
+                g_pcat_main_user_config_written_version =
+                    uconfig_data->version;
+                pcat_metrics_counter_add(
+                    g_pcat_main_user_config_write_metric, 1);
+            }
+            else
+            {
+                g_warning("Failed to save user configuration, the change "
+                    "is kept in memory only!");
+            }
+
+            g_free(data);
+        }
+
+        pcat_main_user_config_data_unref(uconfig_data);
+
+        return ret;
+    }
+
+    g_mutex_lock(&g_pcat_main_user_config_writer_mutex);
+
+    if(g_pcat_main_user_config_writer_done_serial==
+        g_pcat_main_user_config_writer_request_serial)
+    {
+        g_pcat_main_user_config_writer_deadline = g_get_monotonic_time() +
+            (gint64)PCAT_MAIN_USER_CONFIG_SAVE_DELAY * 1000;
+    }
+    g_pcat_main_user_config_writer_request_serial++;
+    g_cond_broadcast(&g_pcat_main_user_config_writer_cond);
+
+    g_mutex_unlock(&g_pcat_main_user_config_writer_mutex);
+
+    return TRUE;
+}
+
+PCatManagerUserConfigData *pcat_main_user_config_data_edit()
+{
+    const PCatManagerUserConfigData *current;
+    PCatManagerUserConfigData *uconfig_data;
+
+    g_mutex_lock(&g_pcat_main_user_config_edit_mutex);
+
+    /* Only editors replace the snapshot, holding the edit lock pins it. */
+    current = g_pcat_main_user_config_data;
+
+    uconfig_data = g_new(PCatManagerUserConfigData, 1);
+    *uconfig_data = *current;
+    uconfig_data->ref_count = 1;
+    uconfig_data->power_schedule_data = g_ptr_array_ref(
+        current->power_schedule_data);
+    uconfig_data->modem_dial_apn = g_strdup(current->modem_dial_apn);
+    uconfig_data->modem_dial_user = g_strdup(current->modem_dial_user);
+    uconfig_data->modem_dial_password = g_strdup(
+        current->modem_dial_password);
+    uconfig_data->modem_dial_auth = g_strdup(current->modem_dial_auth);
+
+    return uconfig_data;
+}
+
+gboolean pcat_main_user_config_data_commit(PCatManagerUserConfigData *data)
+{
+    pcat_main_user_config_data_publish(data);
+    g_mutex_unlock(&g_pcat_main_user_config_edit_mutex);
+
+    return pcat_main_user_config_data_sync();
 }
 
 PCatManagerRouteMode pcat_main_network_route_mode_get()
@@ -1463,3 +1985,26 @@ gboolean pcat_main_is_running_on_distro()
 {
     return g_pcat_main_cmd_distro;
 }
+
+void pcat_main_loop_latency_sample()
+{
+    GSource *source;
+    gint64 ready_time;
+
+    /* Called from periodic timeouts on the main loop, their next
+     * expiration is only set after the callback returns. */
+    source = g_main_current_source();
+    if(source==NULL)
+    {
+        return;
+    }
+
+    ready_time = g_source_get_ready_time(source);
+    if(ready_time < 0)
+    {
+        return;
+    }
+
+    pcat_metrics_histogram_observe(g_pcat_main_loop_latency_metric,
+        MAX(g_get_monotonic_time() - ready_time, 0) / 1000000.0);
+}
@@ -0,0 +1,500 @@
+#include <string.h>
+#include <glib/gstdio.h>
+#include "metrics.h"
+
+#define PCAT_METRICS_EXPORT_DIRECTORY "/run/pcat-manager"
+#define PCAT_METRICS_EXPORT_FILE PCAT_METRICS_EXPORT_DIRECTORY"/metrics.prom"
+#define PCAT_METRICS_EXPORT_INTERVAL 15
+
+struct _PCatMetricsItem
+{
+    PCatMetricsType type;
+    gchar *name;
+    gchar *label_name;
+    gchar *label_value;
+    gchar *help;
+    guint64 counter;
+    gdouble gauge;
+    gdouble *bounds;
+    guint64 *bucket_counts;
+    guint bound_count;
+    guint64 sample_count;
+    gdouble sample_sum;
+};
+
+typedef struct _PCatMetricsData
+{
+    gboolean initialized;
+    GMutex mutex;
+    GPtrArray *item_list;
+    guint export_timeout_id;
+}PCatMetricsData;
+
+static PCatMetricsData g_pcat_metrics_data = {0};
+
+static const gchar * const g_pcat_metrics_type_name_list[] =
+{
+    [PCAT_METRICS_TYPE_COUNTER] = "counter",
+    [PCAT_METRICS_TYPE_GAUGE] = "gauge",
+    [PCAT_METRICS_TYPE_HISTOGRAM] = "histogram"
+};
+
+static PCatMetricsItem *pcat_metrics_item_register(PCatMetricsType type,
+    const gchar *name, const gchar *label_name, const gchar *label_value,
+    const gchar *help, const gdouble *bounds, guint bound_count)
+{
+    PCatMetricsData *metrics_data = &g_pcat_metrics_data;
+    PCatMetricsItem *item = NULL;
+    guint i;
+
+    g_mutex_lock(&metrics_data->mutex);
+
+    if(metrics_data->item_list==NULL)
+    {
+        metrics_data->item_list = g_ptr_array_new();
+    }
+
+    for(i=0;i<metrics_data->item_list->len;i++)
+    {
+        item = g_ptr_array_index(metrics_data->item_list, i);
+        if(item->type==type && g_strcmp0(item->name, name)==0 &&
+           g_strcmp0(item->label_value, label_value)==0)
+        {
+            g_mutex_unlock(&metrics_data->mutex);
+
+            return item;
+        }
+    }
+
+    item = g_new0(PCatMetricsItem, 1);
+    item->type = type;
+    item->name = g_strdup(name);
+    item->label_name = g_strdup(label_name);
+    item->label_value = g_strdup(label_value);
+    item->help = g_strdup(help);
+
+    if(type==PCAT_METRICS_TYPE_HISTOGRAM && bound_count > 0)
+    {
+        item->bounds = g_new(gdouble, bound_count);
+        memcpy(item->bounds, bounds, sizeof(gdouble) * bound_count);
+        item->bucket_counts = g_new0(guint64, bound_count);
+        item->bound_count = bound_count;
+    }
+
+    g_ptr_array_add(metrics_data->item_list, item);
+
+    g_mutex_unlock(&metrics_data->mutex);
+
+    return item;
+}
+
+static void pcat_metrics_prometheus_escaped_append(GString *str,
+    const gchar *value, gboolean escape_quote)
+{
+    const gchar *p;
+
+    /* The exposition format escapes backslash and newline, and quote in
+     * label values. */
+    for(p=value;*p!='\0';p++)
+    {
+        switch(*p)
+        {
+            case '\\':
+            {
+                g_string_append(str, "\\\\");
+                break;
+            }
+            case '"':
+            {
+                g_string_append(str, escape_quote ? "\\\"" : "\"");
+                break;
+            }
+            case '\n':
+            {
+                g_string_append(str, "\\n");
+                break;
+            }
+            default:
+            {
+                g_string_append_c(str, *p);
+                break;
+            }
+        }
+    }
+}
+
+static void pcat_metrics_prometheus_labels_append(GString *str,
+    const PCatMetricsItem *item, const gchar *le)
+{
+    if(item->label_name==NULL && le==NULL)
+    {
+        return;
+    }
+
+    g_string_append_c(str, '{');
+    if(item->label_name!=NULL)
+    {
+        g_string_append_printf(str, "%s=\"", item->label_name);
+        pcat_metrics_prometheus_escaped_append(str,
+            item->label_value!=NULL ? item->label_value : "", TRUE);
+        g_string_append_c(str, '"');
+    }
+    if(le!=NULL)
+    {
+        g_string_append_printf(str, "%sle=\"%s\"",
+            item->label_name!=NULL ? "," : "", le);
+    }
+    g_string_append_c(str, '}');
+}
+
+static void pcat_metrics_prometheus_item_append(GString *str,
+    const PCatMetricsItem *item)
+{
+    gchar number[G_ASCII_DTOSTR_BUF_SIZE];
+    guint64 cumulative = 0;
+    guint i;
+
+    switch(item->type)
+    {
+        case PCAT_METRICS_TYPE_COUNTER:
+        {
+            g_string_append(str, item->name);
+            pcat_metrics_prometheus_labels_append(str, item, NULL);
+            g_string_append_printf(str, " %"G_GUINT64_FORMAT"\n",
+                item->counter);
+
+            break;
+        }
+        case PCAT_METRICS_TYPE_GAUGE:
+        {
+            g_string_append(str, item->name);
+            pcat_metrics_prometheus_labels_append(str, item, NULL);
+            g_string_append_printf(str, " %s\n", g_ascii_dtostr(number,
+                G_ASCII_DTOSTR_BUF_SIZE, item->gauge));
+
+            break;
+        }
+        case PCAT_METRICS_TYPE_HISTOGRAM:
+        {
+            for(i=0;i<item->bound_count;i++)
+            {
+                cumulative += item->bucket_counts[i];
+                g_string_append_printf(str, "%s_bucket", item->name);
+                pcat_metrics_prometheus_labels_append(str, item,
+                    g_ascii_dtostr(number, G_ASCII_DTOSTR_BUF_SIZE,
+                    item->bounds[i]));
+                g_string_append_printf(str, " %"G_GUINT64_FORMAT"\n",
+                    cumulative);
+            }
+
+            g_string_append_printf(str, "%s_bucket", item->name);
+            pcat_metrics_prometheus_labels_append(str, item, "+Inf");
+            g_string_append_printf(str, " %"G_GUINT64_FORMAT"\n",
+                item->sample_count);
+
+            g_string_append_printf(str, "%s_sum", item->name);
+            pcat_metrics_prometheus_labels_append(str, item, NULL);
+            g_string_append_printf(str, " %s\n", g_ascii_dtostr(number,
+                G_ASCII_DTOSTR_BUF_SIZE, item->sample_sum));
+
+            g_string_append_printf(str, "%s_count", item->name);
+            pcat_metrics_prometheus_labels_append(str, item, NULL);
+            g_string_append_printf(str, " %"G_GUINT64_FORMAT"\n",
+                item->sample_count);
+
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+}
+
+static gboolean pcat_metrics_export_timeout_func(gpointer user_data)
+{
+    gchar *text;
+    GError *error = NULL;
+
+    text = pcat_metrics_prometheus_text_new();
+
+    if(!g_file_set_contents(PCAT_METRICS_EXPORT_FILE, text, -1, &error))
+    {
+        g_warning("Failed to export metrics to file %s: %s",
+            PCAT_METRICS_EXPORT_FILE, error!=NULL ? error->message :
+            "Unknown");
+        g_clear_error(&error);
+    }
+
+    g_free(text);
+
+    return TRUE;
+}
+
+gboolean pcat_metrics_init()
+{
+    if(g_pcat_metrics_data.initialized)
+    {
+        return TRUE;
+    }
+
+    if(g_mkdir_with_parents(PCAT_METRICS_EXPORT_DIRECTORY, 0755)!=0)
+    {
+        g_warning("Failed to create metrics export directory %s!",
+            PCAT_METRICS_EXPORT_DIRECTORY);
+    }
+
+    g_pcat_metrics_data.export_timeout_id = g_timeout_add_seconds(
+        PCAT_METRICS_EXPORT_INTERVAL, pcat_metrics_export_timeout_func,
+        &g_pcat_metrics_data);
+
+    g_pcat_metrics_data.initialized = TRUE;
+
+    return TRUE;
+}
+
+void pcat_metrics_uninit()
+{
+    if(!g_pcat_metrics_data.initialized)
+    {
+        return;
+    }
+
+    if(g_pcat_metrics_data.export_timeout_id > 0)
+    {
+        g_source_remove(g_pcat_metrics_data.export_timeout_id);
+        g_pcat_metrics_data.export_timeout_id = 0;
+    }
+
+    /* Items stay registered, detached worker threads may still update
+     * them while the daemon exits. */
+    g_unlink(PCAT_METRICS_EXPORT_FILE);
+
+    g_pcat_metrics_data.initialized = FALSE;
+}
+
+PCatMetricsItem *pcat_metrics_counter_register(const gchar *name,
+    const gchar *label_name, const gchar *label_value, const gchar *help)
+{
+    return pcat_metrics_item_register(PCAT_METRICS_TYPE_COUNTER, name,
+        label_name, label_value, help, NULL, 0);
+}
+
+PCatMetricsItem *pcat_metrics_gauge_register(const gchar *name,
+    const gchar *label_name, const gchar *label_value, const gchar *help)
+{
+    return pcat_metrics_item_register(PCAT_METRICS_TYPE_GAUGE, name,
+        label_name, label_value, help, NULL, 0);
+}
+
+PCatMetricsItem *pcat_metrics_histogram_register(const gchar *name,
+    const gchar *label_name, const gchar *label_value, const gchar *help,
+    const gdouble *bounds, guint bound_count)
+{
+    return pcat_metrics_item_register(PCAT_METRICS_TYPE_HISTOGRAM, name,
+        label_name, label_value, help, bounds, bound_count);
+}
+
+void pcat_metrics_counter_add(PCatMetricsItem *item, guint64 value)
+{
+    if(item==NULL)
+    {
+        return;
+    }
+
+    g_mutex_lock(&g_pcat_metrics_data.mutex);
+    item->counter += value;
+    g_mutex_unlock(&g_pcat_metrics_data.mutex);
+}
+
+void pcat_metrics_gauge_set(PCatMetricsItem *item, gdouble value)
+{
+    if(item==NULL)
+    {
+        return;
+    }
+
+    g_mutex_lock(&g_pcat_metrics_data.mutex);
+    item->gauge = value;
+    g_mutex_unlock(&g_pcat_metrics_data.mutex);
+}
+
+void pcat_metrics_gauge_add(PCatMetricsItem *item, gdouble value)
+{
+    if(item==NULL)
+    {
+        return;
+    }
+
+    g_mutex_lock(&g_pcat_metrics_data.mutex);
+    item->gauge += value;
+    g_mutex_unlock(&g_pcat_metrics_data.mutex);
+}
+
+void pcat_metrics_histogram_observe(PCatMetricsItem *item, gdouble value)
+{
+    guint i;
+
+    if(item==NULL)
+    {
+        return;
+    }
+
+    g_mutex_lock(&g_pcat_metrics_data.mutex);
+
+    for(i=0;i<item->bound_count;i++)
+    {
+        if(value <= item->bounds[i])
+        {
+            item->bucket_counts[i]++;
+
+            break;
+        }
+    }
+    item->sample_count++;
+    item->sample_sum += value;
+
+    g_mutex_unlock(&g_pcat_metrics_data.mutex);
+}
+
+struct json_object *pcat_metrics_json_new()
+{
+    PCatMetricsData *metrics_data = &g_pcat_metrics_data;
+    const PCatMetricsItem *item;
+    struct json_object *array, *node, *child, *buckets, *bucket;
+    guint64 cumulative;
+    guint i, j;
+
+    array = json_object_new_array();
+
+    g_mutex_lock(&metrics_data->mutex);
+
+    for(i=0;metrics_data->item_list!=NULL &&
+        i<metrics_data->item_list->len;i++)
+    {
+        item = g_ptr_array_index(metrics_data->item_list, i);
+
+        node = json_object_new_object();
+
+        child = json_object_new_string(item->name);
+        json_object_object_add(node, "name", child);
+
+        child = json_object_new_string(
+            g_pcat_metrics_type_name_list[item->type]);
+        json_object_object_add(node, "type", child);
+
+        if(item->label_name!=NULL)
+        {
+            child = json_object_new_object();
+            json_object_object_add(child, item->label_name,
+                json_object_new_string(item->label_value!=NULL ?
+                item->label_value : ""));
+            json_object_object_add(node, "labels", child);
+        }
+
+        switch(item->type)
+        {
+            case PCAT_METRICS_TYPE_COUNTER:
+            {
+                child = json_object_new_int64(item->counter);
+                json_object_object_add(node, "value", child);
+
+                break;
+            }
+            case PCAT_METRICS_TYPE_GAUGE:
+            {
+                child = json_object_new_double(item->gauge);
+                json_object_object_add(node, "value", child);
+
+                break;
+            }
+            case PCAT_METRICS_TYPE_HISTOGRAM:
+            {
+                buckets = json_object_new_array();
+                cumulative = 0;
+                for(j=0;j<item->bound_count;j++)
+                {
+                    cumulative += item->bucket_counts[j];
+
+                    bucket = json_object_new_object();
+                    child = json_object_new_double(item->bounds[j]);
+                    json_object_object_add(bucket, "le", child);
+                    child = json_object_new_int64(cumulative);
+                    json_object_object_add(bucket, "count", child);
+                    json_object_array_add(buckets, bucket);
+                }
+                json_object_object_add(node, "buckets", buckets);
+
+                child = json_object_new_int64(item->sample_count);
+                json_object_object_add(node, "count", child);
+
+                child = json_object_new_double(item->sample_sum);
+                json_object_object_add(node, "sum", child);
+
+                break;
+            }
+            default:
+            {
+                break;
+            }
+        }
+
+        json_object_array_add(array, node);
+    }
+
+    g_mutex_unlock(&metrics_data->mutex);
+
+    return array;
+}
+
+gchar *pcat_metrics_prometheus_text_new()
+{
+    PCatMetricsData *metrics_data = &g_pcat_metrics_data;
+    const PCatMetricsItem *item, *other;
+    GString *str;
+    guint i, j;
+
+    str = g_string_sized_new(4096);
+
+    g_mutex_lock(&metrics_data->mutex);
+
+    /* Series sharing a name are grouped under one HELP/TYPE header. */
+    for(i=0;metrics_data->item_list!=NULL &&
+        i<metrics_data->item_list->len;i++)
+    {
+        item = g_ptr_array_index(metrics_data->item_list, i);
+
+        for(j=0;j<i;j++)
+        {
+            other = g_ptr_array_index(metrics_data->item_list, j);
+            if(strcmp(other->name, item->name)==0)
+            {
+                break;
+            }
+        }
+        if(j < i)
+        {
+            continue;
+        }
+
+        g_string_append_printf(str, "# HELP %s ", item->name);
+        pcat_metrics_prometheus_escaped_append(str,
+            item->help!=NULL ? item->help : "", FALSE);
+        g_string_append_c(str, '\n');
+        g_string_append_printf(str, "# TYPE %s %s\n", item->name,
+            g_pcat_metrics_type_name_list[item->type]);
+
+        for(j=i;j<metrics_data->item_list->len;j++)
+        {
+            other = g_ptr_array_index(metrics_data->item_list, j);
+            if(strcmp(other->name, item->name)==0)
+            {
+                pcat_metrics_prometheus_item_append(str, other);
+            }
+        }
+    }
+
+    g_mutex_unlock(&metrics_data->mutex);
+
+    return g_string_free(str, FALSE);
+}
@@ -0,0 +1,37 @@
+#ifndef HAVE_PCAT_METRICS_H
+#define HAVE_PCAT_METRICS_H
+
+#include <glib.h>
+#include <json.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+    PCAT_METRICS_TYPE_COUNTER = 0,
+    PCAT_METRICS_TYPE_GAUGE,
+    PCAT_METRICS_TYPE_HISTOGRAM
+}PCatMetricsType;
+
+typedef struct _PCatMetricsItem PCatMetricsItem;
+
+gboolean pcat_metrics_init();
+void pcat_metrics_uninit();
+PCatMetricsItem *pcat_metrics_counter_register(const gchar *name,
+    const gchar *label_name, const gchar *label_value, const gchar *help);
+PCatMetricsItem *pcat_metrics_gauge_register(const gchar *name,
+    const gchar *label_name, const gchar *label_value, const gchar *help);
+PCatMetricsItem *pcat_metrics_histogram_register(const gchar *name,
+    const gchar *label_name, const gchar *label_value, const gchar *help,
+    const gdouble *bounds, guint bound_count);
+void pcat_metrics_counter_add(PCatMetricsItem *item, guint64 value);
+void pcat_metrics_gauge_set(PCatMetricsItem *item, gdouble value);
+void pcat_metrics_gauge_add(PCatMetricsItem *item, gdouble value);
+void pcat_metrics_histogram_observe(PCatMetricsItem *item, gdouble value);
+struct json_object *pcat_metrics_json_new();
+gchar *pcat_metrics_prometheus_text_new();
+
+G_END_DECLS
+
+#endif
+
@@ -5,6 +5,8 @@
 #include <libusb.h>
 #include <gio/gio.h>
 #include "modem-manager.h"
+#include "controller.h"
+#include "metrics.h"
 #include "common.h"
 
 #define PCAT_MODEM_MANAGER_POWER_WAIT_TIME 50
@@ -42,6 +44,10 @@ typedef struct _PCatModemManagerData
     gchar *isp_name;
     gchar *isp_plmn;
 
+    PCatMetricsItem *spawn_metric;
+    PCatMetricsItem *signal_strength_metric;
+    PCatMetricsItem *mode_metric;
+
     libusb_context *usb_ctx;
 
     struct gpiod_chip *gpio_modem_power_chip;
@@ -321,6 +327,8 @@ static inline void pcat_modem_manager_external_control_exec_line_parser(
         str->len = 0;
     }
 
+    g_mutex_lock(&(mm_data->mutex));
+
     for(i=0;i<str->len;i++)
     {
         if(str->str[i]=='\n')
@@ -367,6 +375,7 @@ static inline void pcat_modem_manager_external_control_exec_line_parser(
                     }
 
                     mm_data->modem_mode = modem_mode;
+                    pcat_metrics_gauge_set(mm_data->mode_metric, modem_mode);
 
                     if(mm_data->modem_mode==PCAT_MODEM_MANAGER_MODE_5G)
                     {
@@ -461,6 +470,8 @@ static inline void pcat_modem_manager_external_control_exec_line_parser(
                     G_STMT_END;
 
                     mm_data->modem_signal_strength = signal_value;
+                    pcat_metrics_gauge_set(mm_data->signal_strength_metric,
+                        signal_value);
                     g_message("Modem signal strength: %d", signal_value);
                 }
                 else if(g_strcmp0(cmd, "SIMSTATUS")==0)
@@ -514,9 +525,13 @@ static inline void pcat_modem_manager_external_control_exec_line_parser(
         }
     }
 
+    g_mutex_unlock(&(mm_data->mutex));
+
     if(used_size > 0)
     {
         g_string_erase(str, 0, used_size);
+
+        pcat_controller_topic_state_changed(PCAT_CONTROLLER_TOPIC_MODEM);
     }
 }
 
@@ -578,7 +593,7 @@ static inline gboolean pcat_modem_manager_run_external_exec(
 {
     GError *error = NULL;
     gboolean ret = TRUE;
-    PCatManagerUserConfigData *uconfig_data;
+    const PCatManagerUserConfigData *uconfig_data;
 
     if(mm_data==NULL || usb_data==NULL ||
         usb_data->external_control_exec==NULL)
@@ -679,6 +694,8 @@ static inline gboolean pcat_modem_manager_run_external_exec(
                 break;
             }
 
+            pcat_metrics_counter_add(mm_data->spawn_metric, 1);
+
             mm_data->external_control_exec_stdout_stream =
                 g_subprocess_get_stdout_pipe(
                 mm_data->external_control_exec_process);
@@ -712,6 +729,8 @@ static inline gboolean pcat_modem_manager_run_external_exec(
         /* TODO: Run external control exec as daemon. */
     }
 
+    pcat_main_user_config_data_unref(uconfig_data);
+
     return ret;
 }
 
@@ -786,12 +805,14 @@ static void pcat_modem_manager_scan_usb_devs(PCatModemManagerData *mm_data)
         {
             g_spawn_command_line_async("ModemManagerSwitch.sh disable",
                 NULL);
+            pcat_metrics_counter_add(mm_data->spawn_metric, 1);
             pcat_modem_manager_run_external_exec(mm_data, usb_data);
         }
         else
         {
             g_spawn_command_line_async("ModemManagerSwitch.sh enable",
                 NULL);
+            pcat_metrics_counter_add(mm_data->spawn_metric, 1);
         }
     }
 
@@ -916,6 +937,8 @@ static gboolean pcat_modem_scan_timeout_func(gpointer user_data)
         }
     }
 
+    pcat_main_user_config_data_unref(uconfig_data);
+
     return TRUE;
 }
 
@@ -934,6 +957,16 @@ gboolean pcat_modem_manager_init()
 
     main_config_data = pcat_main_config_data_get();
 
+    g_pcat_modem_manager_data.spawn_metric = pcat_metrics_counter_register(
+        "pcat_subprocess_spawns_total", "module", "modem",
+        "Subprocesses spawned by pcat-manager.");
+    g_pcat_modem_manager_data.signal_strength_metric =
+        pcat_metrics_gauge_register("pcat_modem_signal_strength", NULL, NULL,
+        "Modem signal strength in percent.");
+    g_pcat_modem_manager_data.mode_metric = pcat_metrics_gauge_register(
+        "pcat_modem_mode", NULL, NULL,
+        "Modem network mode (0 none, 1 2G, 2 3G, 3 LTE, 4 5G).");
+
     g_pcat_modem_manager_data.work_flag = TRUE;
     g_mutex_init(&(g_pcat_modem_manager_data.mutex));
 
@@ -979,6 +1012,7 @@ gboolean pcat_modem_manager_init()
 
     g_spawn_async(NULL, command, NULL, G_SPAWN_DEFAULT,
         NULL, NULL, NULL, NULL);
+    pcat_metrics_counter_add(g_pcat_modem_manager_data.spawn_metric, 1);
 
     g_pcat_modem_manager_data.scanning_timeout_id = g_timeout_add_seconds(5,
         pcat_modem_scan_timeout_func, &g_pcat_modem_manager_data);
@@ -1045,6 +1079,8 @@ gboolean pcat_modem_manager_status_get(PCatModemManagerMode *mode,
         return FALSE;
     }
 
+    g_mutex_lock(&(g_pcat_modem_manager_data.mutex));
+
     if(mode!=NULL)
     {
         *mode = g_pcat_modem_manager_data.modem_mode;
@@ -1070,6 +1106,8 @@ gboolean pcat_modem_manager_status_get(PCatModemManagerMode *mode,
         *isp_plmn = g_strdup(g_pcat_modem_manager_data.isp_plmn);
     }
 
+    g_mutex_unlock(&(g_pcat_modem_manager_data.mutex));
+
     return TRUE;
 }
 
@@ -1089,7 +1127,12 @@ void pcat_modem_manager_device_rfkill_mode_set(gboolean state)
         return;
     }
 
+    g_mutex_lock(&(g_pcat_modem_manager_data.mutex));
     g_pcat_modem_manager_data.modem_rfkill_state = state;
+    g_mutex_unlock(&(g_pcat_modem_manager_data.mutex));
+
+    pcat_controller_topic_state_changed(PCAT_CONTROLLER_TOPIC_MODEM);
+
     main_config_data = pcat_main_config_data_get();
 
     if(state)
@@ -1098,6 +1141,7 @@ void pcat_modem_manager_device_rfkill_mode_set(gboolean state)
     }
     g_spawn_async(NULL, command, NULL, G_SPAWN_DEFAULT,
         NULL, NULL, NULL, NULL);
+    pcat_metrics_counter_add(g_pcat_modem_manager_data.spawn_metric, 1);
 
     if(g_pcat_modem_manager_data.gpio_modem_rf_kill_line!=NULL)
     {
@@ -18,7 +18,7 @@ void pcat_pmu_manager_schedule_time_update();
 void pcat_pmu_manager_charger_on_auto_start(gboolean state);
 void pcat_pmu_manager_net_status_led_setup(guint on_time, guint down_time,
     guint repeat);
-const gchar *pcat_pmu_manager_pmu_fw_version_get();
+gchar *pcat_pmu_manager_pmu_fw_version_get();
 gint64 pcat_pmu_manager_charger_on_auto_start_last_timestamp_get();
 void pcat_pmu_manager_voltage_threshold_set(guint led_vh, guint led_vm,
     guint led_vl, guint startup_voltage, guint charger_voltage,
@@ -0,0 +1,105 @@
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+#include <linux/serial.h>
+#include "serial-port.h"
+
+#define PCAT_SERIAL_PORT_BAUD_DEFAULT 115200
+#define PCAT_SERIAL_PORT_BAUD_MAX 4000000
+#define PCAT_SERIAL_PORT_BAUD_TOLERANCE_PERCENT 2
+
+static void pcat_serial_port_low_latency_set(int fd)
+{
+    struct serial_struct serial_info;
+
+    if(ioctl(fd, TIOCGSERIAL, &serial_info) < 0)
+    {
+        g_message("Serial port does not support low latency mode: %s",
+            strerror(errno));
+
+        return;
+    }
+
+    serial_info.flags |= ASYNC_LOW_LATENCY;
+
+    if(ioctl(fd, TIOCSSERIAL, &serial_info) < 0)
+    {
+        g_message("Failed to enable serial port low latency mode: %s",
+            strerror(errno));
+    }
+}
+
+gboolean pcat_serial_port_setup(int fd, guint baud, gboolean low_latency,
+    guint read_vmin, guint read_vtime)
+{
+    struct termios2 options;
+    guint actual_baud;
+
+    if(baud==0 || baud > PCAT_SERIAL_PORT_BAUD_MAX)
+    {
+        g_warning("Invalid serial speed %u, set to default speed at %u.",
+            baud, PCAT_SERIAL_PORT_BAUD_DEFAULT);
+        baud = PCAT_SERIAL_PORT_BAUD_DEFAULT;
+    }
+    if(read_vmin > 255)
+    {
+        read_vmin = 255;
+    }
+    if(read_vtime > 255)
+    {
+        read_vtime = 255;
+    }
+
+    if(ioctl(fd, TCGETS2, &options) < 0)
+    {
+        g_warning("Failed to get serial port attributes: %s",
+            strerror(errno));
+
+        return FALSE;
+    }
+
+    options.c_iflag &= ~(IGNBRK | BRKINT | ICRNL | IGNCR | IGNPAR |
+        INLCR | PARMRK | INPCK | ISTRIP | IXON | IXOFF | IXANY);
+    options.c_oflag &= ~OPOST;
+    options.c_lflag &= ~(ICANON | ECHO | ECHOE | ECHONL | ISIG | IEXTEN);
+    options.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS |
+        CBAUD | (CBAUD << IBSHIFT));
+    options.c_cflag |= (CS8 | CLOCAL | CREAD | BOTHER | (BOTHER << IBSHIFT));
+    options.c_ispeed = baud;
+    options.c_ospeed = baud;
+    options.c_cc[VMIN] = read_vmin;
+    options.c_cc[VTIME] = read_vtime;
+
+    ioctl(fd, TCFLSH, TCIOFLUSH);
+
+    if(ioctl(fd, TCSETS2, &options) < 0)
+    {
+        g_warning("Failed to set serial port speed %u: %s", baud,
+            strerror(errno));
+
+        return FALSE;
+    }
+
+    if(ioctl(fd, TCGETS2, &options)==0)
+    {
+        actual_baud = options.c_ospeed;
+        if(actual_baud * 100 < baud *
+           (100 - PCAT_SERIAL_PORT_BAUD_TOLERANCE_PERCENT) ||
+           actual_baud * 100 > baud *
+           (100 + PCAT_SERIAL_PORT_BAUD_TOLERANCE_PERCENT))
+        {
+            g_warning("Serial port speed %u is not supported by the "
+                "device, got %u.", baud, actual_baud);
+
+            return FALSE;
+        }
+    }
+
+    if(low_latency)
+    {
+        pcat_serial_port_low_latency_set(fd);
+    }
+
+    return TRUE;
+}
@@ -0,0 +1,14 @@
+#ifndef HAVE_PCAT_SERIAL_PORT_H
+#define HAVE_PCAT_SERIAL_PORT_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+gboolean pcat_serial_port_setup(int fd, guint baud, gboolean low_latency,
+    guint read_vmin, guint read_vtime);
+
+G_END_DECLS
+
+#endif
+
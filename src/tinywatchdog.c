@@ -1,7 +1,8 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <errno.h>
-#include <termios.h>
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -37,8 +38,7 @@ static inline uint16_t compute_crc16(const uint8_t *data, size_t len)
 int main(int argc, char *argv[])
 {
     int fd;
-    struct termios options;
-    int rspeed = B115200;
+    struct termios2 options;
     int speed = 115200;
     const char *serial_device = "/dev/ttyS4";
     uint8_t buffer[13] = {0xA5, 0x01, 0x81, 0x0, 0x0, 0x3, 0x0,
@@ -69,65 +69,42 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    switch(speed)
+    if(speed <= 0)
     {
-        case 4800:
-        {
-            rspeed = B4800;
-            break;
-        }
-        case 9600:
-        {
-            rspeed = B9600;
-            break;
-        }
-        case 19200:
-        {
-            rspeed = B19200;
-            break;
-        }
-        case 38400:
-        {
-            rspeed = B38400;
-            break;
-        }
-        case 57600:
-        {
-            rspeed = B57600;
-            break;
-        }
-        case 115200:
-        {
-            rspeed = B115200;
-            break;
-        }
-        default:
-        {
-            fprintf(stderr, "Invalid serial speed, "
-                "set to default speed at %u.", 115200);
-            break;
-        }
+        fprintf(stderr, "Invalid serial speed, "
+            "set to default speed at %u.", 115200);
+        speed = 115200;
     }
 
-    tcgetattr(fd, &options);
-    cfmakeraw(&options);
-    cfsetispeed(&options, rspeed);
-    cfsetospeed(&options, rspeed);
-    options.c_cflag &= ~CSIZE;
-    options.c_cflag &= ~PARENB;
-    options.c_cflag &= ~PARODD;
-    options.c_cflag &= ~CSTOPB;
-    options.c_cflag &= ~CRTSCTS;
-    options.c_cflag |= CS8;
-    options.c_cflag |= (CLOCAL | CREAD);
-    options.c_iflag &= ~(IGNBRK | BRKINT | ICRNL |
+    if(ioctl(fd, TCGETS2, &options) < 0)
+    {
+        fprintf(stderr, "Failed to get serial port attributes: %s",
+            strerror(errno));
+        close(fd);
+
+        return 1;
+    }
+
+    options.c_iflag &= ~(IGNBRK | BRKINT | ICRNL | IGNCR | IGNPAR |
         INLCR | PARMRK | INPCK | ISTRIP | IXON | IXOFF | IXANY);
-    options.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG | IEXTEN);
     options.c_oflag &= ~OPOST;
+    options.c_lflag &= ~(ICANON | ECHO | ECHOE | ECHONL | ISIG | IEXTEN);
+    options.c_cflag &= ~(CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS |
+        CBAUD | (CBAUD << IBSHIFT));
+    options.c_cflag |= (CS8 | CLOCAL | CREAD | BOTHER | (BOTHER << IBSHIFT));
+    options.c_ispeed = speed;
+    options.c_ospeed = speed;
     options.c_cc[VMIN] = 1;
     options.c_cc[VTIME] = 0;
-    tcflush(fd, TCIOFLUSH);
-    tcsetattr(fd, TCSANOW, &options);
+    ioctl(fd, TCFLSH, TCIOFLUSH);
+    if(ioctl(fd, TCSETS2, &options) < 0)
+    {
+        fprintf(stderr, "Failed to set serial port speed %d: %s",
+            speed, strerror(errno));
+        close(fd);
+
+        return 1;
+    }
 
     while(1)
     {